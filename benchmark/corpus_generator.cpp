@@ -0,0 +1,130 @@
+#include "corpus_generator.h"
+
+#include <random>
+
+using namespace std;
+
+namespace {
+
+string MakeWord(size_t index) {
+    string word;
+
+    do {
+        word.push_back(static_cast<char>('a' + index % 26));
+        index /= 26;
+    } while (index > 0);
+
+    return word;
+}
+
+discrete_distribution<size_t> MakeZipfDistribution(size_t vocabulary_size, double exponent) {
+    vector<double> weights(vocabulary_size);
+
+    for (size_t rank = 0; rank < vocabulary_size; ++rank) {
+        weights[rank] = 1.0 / pow(static_cast<double>(rank + 1), exponent);
+    }
+
+    return { weights.begin(), weights.end() };
+}
+
+} // namespace
+
+Corpus GenerateCorpus(const CorpusOptions& options) {
+    if (options.vocabulary_size == 0 || options.min_document_length == 0
+        || options.min_document_length > options.max_document_length) {
+        throw invalid_argument("Invalid corpus options"s);
+    }
+
+    mt19937 generator(options.seed);
+    auto word_distribution = MakeZipfDistribution(options.vocabulary_size, options.zipf_exponent);
+    uniform_int_distribution<size_t> length_distribution(options.min_document_length, options.max_document_length);
+    uniform_real_distribution<double> share_distribution(0.0, 1.0);
+    uniform_int_distribution<int> rating_distribution(-10, 10);
+
+    constexpr DocumentStatus OTHER_STATUSES[] = { DocumentStatus::IRRELEVANT, DocumentStatus::BANNED, DocumentStatus::REMOVED };
+
+    Corpus corpus;
+
+    corpus.vocabulary.reserve(options.vocabulary_size);
+    for (size_t i = 0; i < options.vocabulary_size; ++i) {
+        corpus.vocabulary.push_back(MakeWord(i));
+    }
+
+    vector<string_view> words;
+
+    for (size_t id = 0; id < options.document_count; ++id) {
+        words.clear();
+
+        if (id > 0 && share_distribution(generator) < options.duplicate_share) {
+            const size_t original = uniform_int_distribution<size_t>(0, id - 1)(generator);
+
+            words = SplitIntoWords(corpus.documents[original]);
+            shuffle(words.begin(), words.end(), generator);
+        } else {
+            const size_t length = length_distribution(generator);
+
+            for (size_t i = 0; i < length; ++i) {
+                words.push_back(corpus.vocabulary[word_distribution(generator)]);
+            }
+        }
+
+        string text;
+        for (string_view word : words) {
+            if (!text.empty()) {
+                text.push_back(' ');
+            }
+            text.append(word);
+        }
+
+        corpus.documents.push_back(move(text));
+
+        corpus.statuses.push_back(share_distribution(generator) < options.actual_share
+                                      ? DocumentStatus::ACTUAL
+                                      : OTHER_STATUSES[id % size(OTHER_STATUSES)]);
+
+        corpus.ratings.push_back({ rating_distribution(generator), rating_distribution(generator), rating_distribution(generator) });
+    }
+
+    return corpus;
+}
+
+vector<string> GenerateQueries(const Corpus& corpus, const CorpusOptions& options, size_t query_count,
+                               size_t plus_word_count, size_t minus_word_count) {
+    mt19937 generator(options.seed + 1);
+    auto word_distribution = MakeZipfDistribution(corpus.vocabulary.size(), options.zipf_exponent);
+
+    vector<string> queries;
+    queries.reserve(query_count);
+
+    for (size_t i = 0; i < query_count; ++i) {
+        string query;
+
+        for (size_t j = 0; j < plus_word_count + minus_word_count; ++j) {
+            if (!query.empty()) {
+                query.push_back(' ');
+            }
+
+            if (j >= plus_word_count) {
+                query.push_back('-');
+            }
+
+            query += corpus.vocabulary[word_distribution(generator)];
+        }
+
+        queries.push_back(move(query));
+    }
+
+    return queries;
+}
+
+void AddCorpus(SearchServer& search_server, const Corpus& corpus) {
+    for (size_t id = 0; id < corpus.documents.size(); ++id) {
+        search_server.AddDocument(static_cast<int>(id), corpus.documents[id], corpus.statuses[id], corpus.ratings[id]);
+    }
+}
+
+void AddCorpus(ShardedSearchServer& search_server, const Corpus& corpus) {
+    for (size_t id = 0; id < corpus.documents.size(); ++id) {
+        search_server.AddDocument(static_cast<int>(id), corpus.documents[id], corpus.statuses[id], corpus.ratings[id]);
+    }
+}
@@ -0,0 +1,39 @@
+#pragma once
+
+#include "search_server.h"
+#include "sharded_search_server.h"
+
+#include <cstdint>
+#include <string>
+#include <vector>
+
+struct CorpusOptions {
+    size_t document_count = 10000;
+    size_t vocabulary_size = 10000;
+    // word of rank k is taken with probability ~ 1 / k^zipf_exponent
+    double zipf_exponent = 1.0;
+    size_t min_document_length = 10;
+    size_t max_document_length = 100;
+    // the rest of documents get IRRELEVANT, BANNED and REMOVED statuses evenly
+    double actual_share = 0.8;
+    // share of documents which repeat the words of an earlier document in another order
+    double duplicate_share = 0.05;
+    uint32_t seed = 42;
+};
+
+struct Corpus {
+    std::vector<std::string> vocabulary; // sorted by frequency rank
+    std::vector<std::string> documents;
+    std::vector<DocumentStatus> statuses;
+    std::vector<std::vector<int>> ratings;
+};
+
+Corpus GenerateCorpus(const CorpusOptions& options);
+
+// Queries are built from the same Zipf distribution as documents, so popular words
+// with long postings appear in queries as often as they do in real traffic
+std::vector<std::string> GenerateQueries(const Corpus& corpus, const CorpusOptions& options, size_t query_count,
+                                         size_t plus_word_count, size_t minus_word_count);
+
+void AddCorpus(SearchServer& search_server, const Corpus& corpus);
+void AddCorpus(ShardedSearchServer& search_server, const Corpus& corpus);
@@ -0,0 +1,465 @@
+#include "corpus_generator.h"
+#include "process_queries.h"
+#include "query_scheduler.h"
+#include "remove_duplicates.h"
+#include "search_server.h"
+#include "write_ahead_log.h"
+
+#include <benchmark/benchmark.h>
+
+#include <filesystem>
+#include <map>
+#include <memory>
+
+// Run with --benchmark_format=json or --benchmark_out=<file> for machine-readable results
+
+using namespace std;
+
+namespace {
+
+constexpr size_t QUERY_COUNT = 256;
+
+CorpusOptions MakeOptions(int64_t document_count) {
+    CorpusOptions options;
+    options.document_count = static_cast<size_t>(document_count);
+    options.vocabulary_size = max<size_t>(1000, options.document_count);
+    return options;
+}
+
+const Corpus& GetCorpus(int64_t document_count) {
+    static map<int64_t, Corpus> corpora;
+
+    auto it = corpora.find(document_count);
+    if (it == corpora.end()) {
+        it = corpora.emplace(document_count, GenerateCorpus(MakeOptions(document_count))).first;
+    }
+
+    return it->second;
+}
+
+// SearchServer keeps string_views into its own storage, so it is never copied,
+// read-only benchmarks share one instance per corpus size
+const SearchServer& GetSearchServer(int64_t document_count, ScoringMode scoring_mode = ScoringMode::DOUBLE) {
+    static map<pair<int64_t, ScoringMode>, unique_ptr<SearchServer>> servers;
+
+    auto& server = servers[{ document_count, scoring_mode }];
+    if (!server) {
+        server = make_unique<SearchServer>(""s);
+        server->SetScoringMode(scoring_mode);
+        AddCorpus(*server, GetCorpus(document_count));
+    }
+
+    return *server;
+}
+
+const SearchServer& GetImpactOrderedSearchServer(int64_t document_count) {
+    static map<int64_t, unique_ptr<SearchServer>> servers;
+
+    auto& server = servers[document_count];
+    if (!server) {
+        server = make_unique<SearchServer>(""s);
+        server->SetImpactOrderedPostingsEnabled(true);
+        AddCorpus(*server, GetCorpus(document_count));
+    }
+
+    return *server;
+}
+
+const SearchServer& GetFuzzySearchServer(int64_t document_count) {
+    static map<int64_t, unique_ptr<SearchServer>> servers;
+
+    auto& server = servers[document_count];
+    if (!server) {
+        server = make_unique<SearchServer>(""s);
+        server->SetMaxEditDistance(2);
+        AddCorpus(*server, GetCorpus(document_count));
+    }
+
+    return *server;
+}
+
+const ShardedSearchServer& GetShardedSearchServer(int64_t document_count) {
+    static map<int64_t, unique_ptr<ShardedSearchServer>> servers;
+
+    auto& server = servers[document_count];
+    if (!server) {
+        server = make_unique<ShardedSearchServer>(4, ""s);
+        AddCorpus(*server, GetCorpus(document_count));
+    }
+
+    return *server;
+}
+
+const vector<string>& GetQueries(int64_t document_count) {
+    static map<int64_t, vector<string>> queries;
+
+    auto it = queries.find(document_count);
+    if (it == queries.end()) {
+        it = queries.emplace(document_count, GenerateQueries(GetCorpus(document_count), MakeOptions(document_count), QUERY_COUNT, 3, 1)).first;
+    }
+
+    return it->second;
+}
+
+// The same queries with every plus word required
+const vector<string>& GetRequiredQueries(int64_t document_count) {
+    static map<int64_t, vector<string>> queries;
+
+    auto it = queries.find(document_count);
+    if (it == queries.end()) {
+        vector<string> required_queries;
+
+        for (const string& query : GetQueries(document_count)) {
+            string required_query;
+
+            for (string_view word : SplitIntoWords(query)) {
+                required_query += required_query.empty() ? ""s : " "s;
+                required_query += word[0] == '-' ? string(word) : "+"s + string(word);
+            }
+
+            required_queries.push_back(move(required_query));
+        }
+
+        it = queries.emplace(document_count, move(required_queries)).first;
+    }
+
+    return it->second;
+}
+
+// RemoveDuplicates reports every duplicate to cout
+class CoutSilencer {
+public:
+    CoutSilencer()
+        : buffer_(cout.rdbuf(nullptr)) {
+    }
+
+    ~CoutSilencer() {
+        cout.rdbuf(buffer_);
+    }
+
+private:
+    streambuf* buffer_;
+};
+
+void BM_SplitIntoWords(benchmark::State& state) {
+    const auto& corpus = GetCorpus(state.range(0));
+    size_t i = 0;
+
+    for (auto _ : state) {
+        benchmark::DoNotOptimize(SplitIntoWords(corpus.documents[i++ % corpus.documents.size()]));
+    }
+
+    state.SetItemsProcessed(state.iterations());
+}
+
+void BM_AddDocument(benchmark::State& state) {
+    const auto& corpus = GetCorpus(state.range(0));
+
+    for (auto _ : state) {
+        SearchServer search_server(""s);
+        AddCorpus(search_server, corpus);
+        benchmark::DoNotOptimize(search_server.GetDocumentCount());
+    }
+
+    state.SetItemsProcessed(state.iterations() * corpus.documents.size());
+}
+
+template <typename ExecutionPolicy>
+void BM_FindTopDocuments(benchmark::State& state, ExecutionPolicy policy, ScoringMode scoring_mode = ScoringMode::DOUBLE) {
+    const auto& search_server = GetSearchServer(state.range(0), scoring_mode);
+    const auto& queries = GetQueries(state.range(0));
+    size_t i = 0;
+
+    for (auto _ : state) {
+        benchmark::DoNotOptimize(search_server.FindTopDocuments(policy, queries[i++ % queries.size()]));
+    }
+
+    state.SetItemsProcessed(state.iterations());
+}
+
+void BM_FindTopDocumentsSeq(benchmark::State& state) {
+    BM_FindTopDocuments(state, execution::seq);
+}
+
+void BM_FindTopDocumentsPar(benchmark::State& state) {
+    BM_FindTopDocuments(state, execution::par);
+}
+
+void BM_FindTopDocumentsFloatSeq(benchmark::State& state) {
+    BM_FindTopDocuments(state, execution::seq, ScoringMode::FLOAT);
+}
+
+void BM_FindTopDocumentsFloatPar(benchmark::State& state) {
+    BM_FindTopDocuments(state, execution::par, ScoringMode::FLOAT);
+}
+
+void BM_FindTopDocumentsRequired(benchmark::State& state) {
+    const auto& search_server = GetSearchServer(state.range(0));
+    const auto& queries = GetRequiredQueries(state.range(0));
+    size_t i = 0;
+
+    for (auto _ : state) {
+        benchmark::DoNotOptimize(search_server.FindTopDocuments(queries[i++ % queries.size()]));
+    }
+
+    state.SetItemsProcessed(state.iterations());
+}
+
+void BM_FindTopDocumentsImpact(benchmark::State& state) {
+    const auto& search_server = GetImpactOrderedSearchServer(state.range(0));
+    const auto& queries = GetQueries(state.range(0));
+    size_t i = 0;
+
+    for (auto _ : state) {
+        benchmark::DoNotOptimize(search_server.FindTopDocuments(queries[i++ % queries.size()]));
+    }
+
+    state.SetItemsProcessed(state.iterations());
+}
+
+void BM_FindTopDocumentsFuzzy(benchmark::State& state) {
+    const auto& search_server = GetFuzzySearchServer(state.range(0));
+    const auto& queries = GetQueries(state.range(0));
+    size_t i = 0;
+
+    for (auto _ : state) {
+        benchmark::DoNotOptimize(search_server.FindTopDocuments(queries[i++ % queries.size()]));
+    }
+
+    state.SetItemsProcessed(state.iterations());
+}
+
+void BM_FindTopDocumentsSharded(benchmark::State& state) {
+    const auto& search_server = GetShardedSearchServer(state.range(0));
+    const auto& queries = GetQueries(state.range(0));
+    size_t i = 0;
+
+    for (auto _ : state) {
+        benchmark::DoNotOptimize(search_server.FindTopDocuments(queries[i++ % queries.size()]));
+    }
+
+    state.SetItemsProcessed(state.iterations());
+}
+
+// a batch of queries on the scheduler threads, every one with a generous deadline
+void BM_FindTopDocumentsAsync(benchmark::State& state) {
+    const auto& search_server = GetSearchServer(state.range(0));
+    const auto& queries = GetQueries(state.range(0));
+    QueryScheduler scheduler(search_server, 4);
+
+    for (auto _ : state) {
+        vector<future<vector<Document>>> results;
+        results.reserve(queries.size());
+
+        for (const string& query : queries) {
+            results.push_back(scheduler.FindTopDocuments(query, CancellationToken(CancellationToken::Clock::now() + 1s)));
+        }
+
+        for (auto& result : results) {
+            benchmark::DoNotOptimize(result.get());
+        }
+    }
+
+    state.SetItemsProcessed(state.iterations() * queries.size());
+}
+
+// approximate search with a budget of a tenth of the documents, the cost estimation
+// comes on top of the search, as in the admission control of QueryScheduler
+void BM_FindTopDocumentsPruned(benchmark::State& state) {
+    const auto& search_server = GetSearchServer(state.range(0));
+    const auto& queries = GetQueries(state.range(0));
+    const size_t max_query_cost = static_cast<size_t>(state.range(0) / 10);
+    const CancellationToken cancellation;
+    size_t i = 0;
+
+    for (auto _ : state) {
+        const string& query = queries[i++ % queries.size()];
+        benchmark::DoNotOptimize(search_server.EstimateQueryCost(query));
+        benchmark::DoNotOptimize(search_server.FindTopDocumentsPruned(cancellation, query, max_query_cost, DocumentStatusPredicate{}));
+    }
+
+    state.SetItemsProcessed(state.iterations());
+}
+
+// type-ahead on the first two letters of every query
+void BM_CompleteWord(benchmark::State& state) {
+    const auto& search_server = GetSearchServer(state.range(0));
+    const auto& queries = GetQueries(state.range(0));
+    size_t i = 0;
+
+    for (auto _ : state) {
+        const string_view query = queries[i++ % queries.size()];
+        benchmark::DoNotOptimize(search_server.CompleteWord(query.substr(0, 2), 10));
+    }
+
+    state.SetItemsProcessed(state.iterations());
+}
+
+void BM_MatchDocument(benchmark::State& state) {
+    const auto& search_server = GetSearchServer(state.range(0));
+    const auto& queries = GetQueries(state.range(0));
+    const int document_count = search_server.GetDocumentCount();
+    size_t i = 0;
+
+    for (auto _ : state) {
+        benchmark::DoNotOptimize(search_server.MatchDocument(queries[i % queries.size()], static_cast<int>(i % document_count)));
+        ++i;
+    }
+
+    state.SetItemsProcessed(state.iterations());
+}
+
+void BM_RemoveDocument(benchmark::State& state) {
+    const auto& corpus = GetCorpus(state.range(0));
+    const int remove_count = max<int>(1, static_cast<int>(corpus.documents.size() / 100));
+
+    for (auto _ : state) {
+        state.PauseTiming();
+        auto search_server = make_unique<SearchServer>(""s);
+        AddCorpus(*search_server, corpus);
+        state.ResumeTiming();
+
+        for (int id = 0; id < remove_count; ++id) {
+            search_server->RemoveDocument(id);
+        }
+
+        // destruction of the server is not a part of the measurement
+        state.PauseTiming();
+        search_server.reset();
+        state.ResumeTiming();
+    }
+
+    state.SetItemsProcessed(state.iterations() * remove_count);
+}
+
+void BM_RemoveDuplicates(benchmark::State& state) {
+    const auto& corpus = GetCorpus(state.range(0));
+    CoutSilencer silencer;
+
+    for (auto _ : state) {
+        state.PauseTiming();
+        auto search_server = make_unique<SearchServer>(""s);
+        AddCorpus(*search_server, corpus);
+        state.ResumeTiming();
+
+        RemoveDuplicates(*search_server);
+
+        // destruction of the server is not a part of the measurement
+        state.PauseTiming();
+        search_server.reset();
+        state.ResumeTiming();
+    }
+
+    state.SetItemsProcessed(state.iterations() * corpus.documents.size());
+}
+
+string GetWriteAheadLogPath() {
+    return (filesystem::temp_directory_path() / "search_server_benchmark.wal"s).string();
+}
+
+void RemoveWriteAheadLog() {
+    filesystem::remove(GetWriteAheadLogPath());
+    filesystem::remove(GetWriteAheadLogPath() + ".snapshot"s);
+}
+
+// ingest of the corpus with every document logged, the argument is a LogSyncPolicy
+void BM_WriteAheadLogAppend(benchmark::State& state) {
+    const auto& corpus = GetCorpus(1 << 13);
+    WriteAheadLogOptions options;
+    options.sync_policy = static_cast<LogSyncPolicy>(state.range(0));
+
+    for (auto _ : state) {
+        state.PauseTiming();
+        RemoveWriteAheadLog();
+        auto search_server = make_unique<SearchServer>(""s);
+        state.ResumeTiming();
+
+        {
+            WriteAheadLog log(GetWriteAheadLogPath(), *search_server, options);
+
+            for (size_t i = 0; i < corpus.documents.size(); ++i) {
+                search_server->AddDocument(static_cast<int>(i), corpus.documents[i], corpus.statuses[i], corpus.ratings[i]);
+                log.Commit(log.AppendAddDocument(static_cast<int>(i), corpus.documents[i], corpus.statuses[i], corpus.ratings[i]));
+            }
+        }
+
+        state.PauseTiming();
+        search_server.reset();
+        state.ResumeTiming();
+    }
+
+    RemoveWriteAheadLog();
+    state.SetItemsProcessed(state.iterations() * corpus.documents.size());
+}
+
+// restart with a log of the corpus and removes of a tenth of it
+void BM_WriteAheadLogRecover(benchmark::State& state) {
+    const auto& corpus = GetCorpus(state.range(0));
+    RemoveWriteAheadLog();
+
+    {
+        SearchServer search_server(""s);
+        WriteAheadLogOptions options;
+        options.sync_policy = LogSyncPolicy::NONE;
+        WriteAheadLog log(GetWriteAheadLogPath(), search_server, options);
+
+        for (size_t i = 0; i < corpus.documents.size(); ++i) {
+            log.AppendAddDocument(static_cast<int>(i), corpus.documents[i], corpus.statuses[i], corpus.ratings[i]);
+        }
+
+        for (size_t i = 0; i < corpus.documents.size(); i += 10) {
+            log.AppendRemoveDocument(static_cast<int>(i));
+        }
+    }
+
+    for (auto _ : state) {
+        auto search_server = make_unique<SearchServer>(""s);
+        WriteAheadLog log(GetWriteAheadLogPath(), *search_server);
+        benchmark::DoNotOptimize(search_server->GetDocumentCount());
+
+        state.PauseTiming();
+        search_server.reset();
+        state.ResumeTiming();
+    }
+
+    RemoveWriteAheadLog();
+    state.SetItemsProcessed(state.iterations() * corpus.documents.size());
+}
+
+void BM_ProcessQueries(benchmark::State& state) {
+    const auto& search_server = GetSearchServer(state.range(0));
+    const auto& queries = GetQueries(state.range(0));
+
+    for (auto _ : state) {
+        benchmark::DoNotOptimize(ProcessQueries(search_server, queries));
+    }
+
+    state.SetItemsProcessed(state.iterations() * queries.size());
+}
+
+} // namespace
+
+// document counts of the synthetic corpus
+#define CORPUS_SCALES RangeMultiplier(8)->Range(1 << 10, 1 << 16)
+
+BENCHMARK(BM_SplitIntoWords)->Arg(1 << 10);
+BENCHMARK(BM_AddDocument)->CORPUS_SCALES->Unit(benchmark::kMillisecond);
+BENCHMARK(BM_FindTopDocumentsSeq)->CORPUS_SCALES->Unit(benchmark::kMicrosecond);
+BENCHMARK(BM_FindTopDocumentsPar)->CORPUS_SCALES->Unit(benchmark::kMicrosecond);
+BENCHMARK(BM_FindTopDocumentsFloatSeq)->CORPUS_SCALES->Unit(benchmark::kMicrosecond);
+BENCHMARK(BM_FindTopDocumentsFloatPar)->CORPUS_SCALES->Unit(benchmark::kMicrosecond);
+BENCHMARK(BM_FindTopDocumentsRequired)->CORPUS_SCALES->Unit(benchmark::kMicrosecond);
+BENCHMARK(BM_FindTopDocumentsImpact)->CORPUS_SCALES->Unit(benchmark::kMicrosecond);
+BENCHMARK(BM_FindTopDocumentsFuzzy)->CORPUS_SCALES->Unit(benchmark::kMicrosecond);
+BENCHMARK(BM_FindTopDocumentsSharded)->CORPUS_SCALES->Unit(benchmark::kMicrosecond);
+BENCHMARK(BM_FindTopDocumentsAsync)->CORPUS_SCALES->Unit(benchmark::kMillisecond);
+BENCHMARK(BM_FindTopDocumentsPruned)->CORPUS_SCALES->Unit(benchmark::kMicrosecond);
+BENCHMARK(BM_CompleteWord)->CORPUS_SCALES->Unit(benchmark::kMicrosecond);
+BENCHMARK(BM_MatchDocument)->CORPUS_SCALES->Unit(benchmark::kMicrosecond);
+BENCHMARK(BM_RemoveDocument)->CORPUS_SCALES->Unit(benchmark::kMillisecond);
+BENCHMARK(BM_RemoveDuplicates)->CORPUS_SCALES->Unit(benchmark::kMillisecond);
+BENCHMARK(BM_WriteAheadLogAppend)->DenseRange(0, 2)->Unit(benchmark::kMillisecond);
+BENCHMARK(BM_WriteAheadLogRecover)->CORPUS_SCALES->Unit(benchmark::kMillisecond);
+BENCHMARK(BM_ProcessQueries)->CORPUS_SCALES->Unit(benchmark::kMillisecond);
+
+BENCHMARK_MAIN();
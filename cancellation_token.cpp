@@ -0,0 +1,38 @@
+#include "cancellation_token.h"
+
+using namespace std;
+
+CancellationToken::CancellationToken()
+    : state_(make_shared<State>()) {
+}
+
+CancellationToken::CancellationToken(Clock::time_point deadline)
+    : CancellationToken() {
+    state_->deadline = deadline;
+}
+
+void CancellationToken::Cancel() {
+    state_->is_cancelled.store(true, memory_order_relaxed);
+}
+
+bool CancellationToken::IsCancelled() const {
+    if (state_->is_cancelled.load(memory_order_relaxed)) {
+        return true;
+    }
+
+    if (state_->deadline != Clock::time_point::max() && Clock::now() >= state_->deadline) {
+        // later checks skip the clock
+        state_->is_cancelled.store(true, memory_order_relaxed);
+        return true;
+    }
+
+    return false;
+}
+
+void CancellationToken::ThrowIfCancelled() const {
+    if (IsCancelled()) {
+        throw QueryCancelledError(state_->deadline != Clock::time_point::max() && Clock::now() >= state_->deadline
+                                      ? "Query deadline has passed"s
+                                      : "Query is cancelled"s);
+    }
+}
@@ -0,0 +1,40 @@
+#pragma once
+
+#include <atomic>
+#include <chrono>
+#include <memory>
+#include <stdexcept>
+
+// Thrown by a search stopped by its CancellationToken
+class QueryCancelledError : public std::runtime_error {
+public:
+    using std::runtime_error::runtime_error;
+};
+
+// Cooperative cancellation of a search. Copies share the state, so a client keeps one copy
+// to cancel the search running with another. Searches check the token between chunks of
+// postings, so a cancelled search stops within microseconds rather than at once
+class CancellationToken {
+public:
+    using Clock = std::chrono::steady_clock;
+
+    // Cancelled only by Cancel
+    CancellationToken();
+
+    // Cancelled by Cancel or once the deadline passes
+    explicit CancellationToken(Clock::time_point deadline);
+
+    void Cancel();
+    bool IsCancelled() const;
+
+    // Throws QueryCancelledError if the token is cancelled
+    void ThrowIfCancelled() const;
+
+private:
+    struct State {
+        std::atomic<bool> is_cancelled = false;
+        Clock::time_point deadline = Clock::time_point::max();
+    };
+
+    std::shared_ptr<State> state_;
+};
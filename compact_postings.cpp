@@ -0,0 +1,115 @@
+#include "compact_postings.h"
+
+#include <algorithm>
+
+using namespace std;
+
+CompactPostings::CompactPostings(pmr::memory_resource* resource)
+    : resource_(resource)
+    , terms_(resource)
+    , document_lengths_(resource) {
+}
+
+void CompactPostings::Add(uint32_t term_id, uint32_t ordinal, float term_freq) {
+    while (terms_.size() <= term_id) {
+        terms_.emplace_back(resource_);
+    }
+
+    Term& term = terms_[term_id];
+
+    // new documents get the largest ordinal, so this is an append in practice
+    const auto it = lower_bound(term.ordinals.begin(), term.ordinals.end(), ordinal);
+    const auto position = it - term.ordinals.begin();
+
+    term.ordinals.insert(it, ordinal);
+    term.term_freqs.insert(term.term_freqs.begin() + position, term_freq);
+}
+
+void CompactPostings::Remove(uint32_t term_id, uint32_t ordinal) {
+    if (term_id >= terms_.size()) {
+        return;
+    }
+
+    Term& term = terms_[term_id];
+
+    const auto it = lower_bound(term.ordinals.begin(), term.ordinals.end(), ordinal);
+
+    if (it == term.ordinals.end() || *it != ordinal) {
+        return;
+    }
+
+    term.term_freqs.erase(term.term_freqs.begin() + (it - term.ordinals.begin()));
+    term.ordinals.erase(it);
+}
+
+void CompactPostings::RemoveFromAllTerms(uint32_t ordinal) {
+    for (uint32_t term_id = 0; term_id < terms_.size(); ++term_id) {
+        Remove(term_id, ordinal);
+    }
+}
+
+void CompactPostings::SetDocumentLength(uint32_t ordinal, uint32_t length) {
+    if (document_lengths_.size() <= ordinal) {
+        document_lengths_.resize(ordinal + 1);
+    }
+
+    document_lengths_[ordinal] = length;
+}
+
+void CompactPostings::Clear() {
+    terms_.clear();
+    terms_.shrink_to_fit();
+    document_lengths_.clear();
+    document_lengths_.shrink_to_fit();
+}
+
+CompactPostings::TermPostings CompactPostings::Get(uint32_t term_id) const {
+    if (term_id >= terms_.size()) {
+        return {};
+    }
+
+    const Term& term = terms_[term_id];
+
+    return { term.ordinals.data(), term.term_freqs.data(), term.ordinals.size() };
+}
+
+size_t CompactPostings::GetMemoryUsage() const {
+    size_t memory_usage = terms_.capacity() * sizeof(Term) + document_lengths_.capacity() * sizeof(uint32_t);
+
+    for (const Term& term : terms_) {
+        memory_usage += term.ordinals.capacity() * sizeof(uint32_t) + term.term_freqs.capacity() * sizeof(float);
+    }
+
+    return memory_usage;
+}
+
+void CompactPostings::Exclude(const TermPostings& postings, ScoreBuffer& buffer, uint32_t begin, uint32_t end) {
+    const auto [first, last] = FindRange(postings, begin, end);
+
+    uint8_t* touched = buffer.touched_.data();
+
+    for (size_t i = first; i < last; ++i) {
+        if (touched[postings.ordinals[i]]) {
+            touched[postings.ordinals[i]] = ScoreBuffer::EXCLUDED;
+        }
+    }
+}
+
+void CompactPostings::ScoreBuffer::Reset(size_t ordinal_count) {
+    for (const uint32_t ordinal : touched_ordinals_) {
+        accumulators_[ordinal] = 0.0f;
+        touched_[ordinal] = 0;
+    }
+
+    touched_ordinals_.clear();
+
+    if (accumulators_.size() < ordinal_count) {
+        accumulators_.resize(ordinal_count);
+        touched_.resize(ordinal_count);
+    }
+}
+
+CompactPostings::ScoreBuffer& CompactPostings::GetThreadScoreBuffer() {
+    thread_local ScoreBuffer buffer;
+    return buffer;
+}
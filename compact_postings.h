@@ -0,0 +1,200 @@
+#pragma once
+
+#include "cancellation_token.h"
+
+#include <algorithm>
+#include <cstdint>
+#include <cstring>
+#include <memory_resource>
+#include <utility>
+#include <vector>
+
+// Scoring copy of the postings: for every term id, ascending document ordinals and
+// float term frequencies as two plain arrays. Scoring reads 8 bytes per posting from
+// contiguous memory instead of walking tree nodes with double values.
+class CompactPostings {
+public:
+    struct TermPostings {
+        const uint32_t* ordinals = nullptr;
+        const float* term_freqs = nullptr;
+        size_t size = 0;
+    };
+
+    // Scores of the documents a query matched, indexed by ordinal. The arrays stay zeroed
+    // between queries and Reset zeroes only the slots that were touched, so a buffer is
+    // reused by every query and a query costs its postings, not the collection size
+    class ScoreBuffer {
+    public:
+        // Zeroes the touched slots and makes room for ordinals below ordinal_count
+        void Reset(size_t ordinal_count);
+
+        float GetScore(uint32_t ordinal) const {
+            return accumulators_[ordinal];
+        }
+
+        // Calls callback(ordinal) for every touched ordinal in [begin, end) in ascending order.
+        // A few touched ordinals are sorted, many are found by skipping untouched ones eight
+        // at a time
+        template <typename Callback>
+        void ForEachTouched(uint32_t begin, uint32_t end, Callback callback) {
+            if (touched_ordinals_.size() < (end - begin) / MAX_SORTED_SHARE) {
+                std::sort(touched_ordinals_.begin(), touched_ordinals_.end());
+
+                for (const uint32_t ordinal : touched_ordinals_) {
+                    if (touched_[ordinal]) {
+                        callback(ordinal);
+                    }
+                }
+
+                return;
+            }
+
+            size_t ordinal = begin;
+
+            while (ordinal < end) {
+                if (ordinal + sizeof(uint64_t) <= end) {
+                    uint64_t block;
+                    std::memcpy(&block, touched_.data() + ordinal, sizeof(block));
+
+                    if (block == 0) {
+                        ordinal += sizeof(uint64_t);
+                        continue;
+                    }
+                }
+
+                if (touched_[ordinal]) {
+                    callback(static_cast<uint32_t>(ordinal));
+                }
+
+                ++ordinal;
+            }
+        }
+
+        // Whether a minus word removed the touched ordinal
+        bool IsExcluded(uint32_t ordinal) const {
+            return touched_[ordinal] == EXCLUDED;
+        }
+
+        // Number of ordinals touched since Reset, excluded ones included
+        size_t GetTouchedCount() const {
+            return touched_ordinals_.size();
+        }
+
+    private:
+        friend class CompactPostings;
+
+        static constexpr size_t MAX_SORTED_SHARE = 64;
+        static constexpr uint8_t EXCLUDED = 2;
+
+        std::vector<float> accumulators_;
+        std::vector<uint8_t> touched_;
+        std::vector<uint32_t> touched_ordinals_;
+    };
+
+    // The buffer of the calling thread. It is used by one query at a time as long as
+    // nothing run between its Reset and its last read uses it too
+    static ScoreBuffer& GetThreadScoreBuffer();
+
+    explicit CompactPostings(std::pmr::memory_resource* resource);
+
+    void Add(uint32_t term_id, uint32_t ordinal, float term_freq);
+    void Remove(uint32_t term_id, uint32_t ordinal);
+
+    // Removes the ordinal from every term, for callers that don't know the document's words
+    void RemoveFromAllTerms(uint32_t ordinal);
+
+    // Number of non-stop words of the document, used by length-normalizing rankings
+    void SetDocumentLength(uint32_t ordinal, uint32_t length);
+
+    void Clear();
+
+    TermPostings Get(uint32_t term_id) const;
+
+    size_t GetMemoryUsage() const;
+
+    // Adds the scores of postings with ordinal in [begin, end) to the buffer, which must be
+    // Reset for all of them. Checks the cancellation token, if any, before every
+    // check_interval postings and returns false, with the postings partly accumulated,
+    // once it is cancelled
+    template <typename Ranking>
+    bool Accumulate(const TermPostings& postings, const Ranking& ranking, float term_weight, float average_document_length,
+                    ScoreBuffer& buffer, uint32_t begin, uint32_t end,
+                    const CancellationToken* cancellation, size_t check_interval) const {
+        const auto [first, last] = FindRange(postings, begin, end);
+
+        const uint32_t* __restrict ordinals = postings.ordinals;
+        const float* __restrict term_freqs = postings.term_freqs;
+        const uint32_t* __restrict document_lengths = document_lengths_.data();
+        float* __restrict accumulators = buffer.accumulators_.data();
+        uint8_t* __restrict touched = buffer.touched_.data();
+
+        // scores are computed a block at a time with no stores to the accumulators in between, so
+        // the arithmetic is vectorized; the loads of the lengths and the scattered adds are not
+        alignas(32) float scores[ACCUMULATE_BLOCK_SIZE];
+
+        size_t next_check = first;
+
+        for (size_t block = first; block < last; block += ACCUMULATE_BLOCK_SIZE) {
+            if (cancellation && block >= next_check) {
+                if (cancellation->IsCancelled()) {
+                    return false;
+                }
+
+                next_check = block + check_interval;
+            }
+
+            const size_t size = std::min(ACCUMULATE_BLOCK_SIZE, last - block);
+
+            for (size_t i = 0; i < size; ++i) {
+                // lengths fit into int32_t, unlike uint32_t it converts to float with one instruction
+                const auto document_length = static_cast<int32_t>(document_lengths[ordinals[block + i]]);
+
+                scores[i] = ranking.ComputeScore(term_weight, term_freqs[block + i], static_cast<float>(document_length), average_document_length);
+            }
+
+            for (size_t i = 0; i < size; ++i) {
+                const uint32_t ordinal = ordinals[block + i];
+
+                accumulators[ordinal] += scores[i];
+
+                if (!touched[ordinal]) {
+                    touched[ordinal] = 1;
+                    buffer.touched_ordinals_.push_back(ordinal);
+                }
+            }
+        }
+
+        return true;
+    }
+
+    // Marks the touched ordinals of postings in [begin, end) as excluded, they are still
+    // visited by ForEachTouched
+    static void Exclude(const TermPostings& postings, ScoreBuffer& buffer, uint32_t begin, uint32_t end);
+
+private:
+    static constexpr size_t ACCUMULATE_BLOCK_SIZE = 256;
+
+    // [first, last) range of postings with ordinals in [begin, end)
+    static std::pair<size_t, size_t> FindRange(const TermPostings& postings, uint32_t begin, uint32_t end) {
+        const uint32_t* postings_end = postings.ordinals + postings.size;
+
+        const uint32_t* first = begin == 0 ? postings.ordinals : std::lower_bound(postings.ordinals, postings_end, begin);
+        const uint32_t* last = std::lower_bound(first, postings_end, end);
+
+        return { static_cast<size_t>(first - postings.ordinals), static_cast<size_t>(last - postings.ordinals) };
+    }
+
+    struct Term {
+        explicit Term(std::pmr::memory_resource* resource)
+            : ordinals(resource)
+            , term_freqs(resource) {
+        }
+
+        std::pmr::vector<uint32_t> ordinals;
+        std::pmr::vector<float> term_freqs;
+    };
+
+    std::pmr::memory_resource* resource_;
+    std::pmr::vector<Term> terms_;
+    std::pmr::vector<uint32_t> document_lengths_;
+};
@@ -0,0 +1,259 @@
+// Load test of the search daemon: every connection keeps --depth requests in flight,
+// so a few connections saturate the workers of the daemon
+//
+//   search_server_load_test [--port N | --unix PATH] [--connections N] [--depth N] [--seconds N] [--requests FILE]
+//                           [--mutations N]
+//
+// FILE holds request lines, FIND lines over a few words are sent without it.
+// --mutations checks the order of pipelined requests instead: every connection sends N
+// triples of ADD, MATCH and REMOVE of a new document, each request depends on the previous
+// one, and any error fails the test
+
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <cstring>
+#include <deque>
+#include <fstream>
+#include <iostream>
+#include <mutex>
+#include <stdexcept>
+#include <string>
+#include <thread>
+#include <vector>
+
+using namespace std;
+using Clock = chrono::steady_clock;
+
+namespace {
+
+int Connect(int port, const string& unix_path) {
+    int fd;
+    int result;
+
+    if (!unix_path.empty()) {
+        fd = socket(AF_UNIX, SOCK_STREAM, 0);
+
+        sockaddr_un address{};
+        address.sun_family = AF_UNIX;
+        strncpy(address.sun_path, unix_path.c_str(), sizeof(address.sun_path) - 1);
+
+        result = connect(fd, reinterpret_cast<const sockaddr*>(&address), sizeof(address));
+    } else {
+        fd = socket(AF_INET, SOCK_STREAM, 0);
+
+        const int one = 1;
+        setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one));
+
+        sockaddr_in address{};
+        address.sin_family = AF_INET;
+        address.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+        address.sin_port = htons(static_cast<uint16_t>(port));
+
+        result = connect(fd, reinterpret_cast<const sockaddr*>(&address), sizeof(address));
+    }
+
+    if (fd < 0 || result < 0) {
+        throw runtime_error("connect: "s + strerror(errno));
+    }
+
+    return fd;
+}
+
+void SendAll(int fd, const string& data) {
+    for (size_t offset = 0; offset < data.size();) {
+        const ssize_t size = send(fd, data.data() + offset, data.size() - offset, MSG_NOSIGNAL);
+
+        if (size <= 0) {
+            throw runtime_error("send: "s + strerror(errno));
+        }
+
+        offset += size;
+    }
+}
+
+struct Results {
+    size_t response_count = 0;
+    size_t error_count = 0;
+    vector<double> latencies_us;
+};
+
+// Sends the requests from first_request on, cycling over them, until the deadline or request_count
+Results RunConnection(int port, const string& unix_path, const vector<string>& requests, size_t depth,
+                      Clock::time_point deadline, size_t first_request, size_t request_count) {
+    const int fd = Connect(port, unix_path);
+
+    Results results;
+    deque<Clock::time_point> send_times;
+    size_t next_request = first_request;
+    const size_t last_request = request_count == SIZE_MAX ? SIZE_MAX : first_request + request_count;
+    string batch;
+
+    const auto send_requests = [&](size_t count) {
+        batch.clear();
+
+        for (size_t i = 0; i < count && next_request < last_request; ++i) {
+            batch += requests[next_request++ % requests.size()];
+            batch += '\n';
+            send_times.push_back(Clock::now());
+        }
+
+        SendAll(fd, batch);
+    };
+
+    send_requests(depth);
+
+    string input;
+    char buffer[64 * 1024];
+
+    while (!send_times.empty()) {
+        const ssize_t size = read(fd, buffer, sizeof(buffer));
+
+        if (size <= 0) {
+            break;
+        }
+
+        input.append(buffer, size);
+
+        size_t begin = 0;
+        size_t completed = 0;
+
+        for (size_t end; (end = input.find('\n', begin)) != string::npos; begin = end + 1) {
+            results.latencies_us.push_back(chrono::duration<double, micro>(Clock::now() - send_times.front()).count());
+            send_times.pop_front();
+
+            results.error_count += input.compare(begin, 5, "ERROR"s) == 0;
+            ++results.response_count;
+            ++completed;
+        }
+
+        input.erase(0, begin);
+
+        if (Clock::now() < deadline && completed > 0) {
+            send_requests(completed);
+        }
+    }
+
+    close(fd);
+
+    return results;
+}
+
+double GetPercentile(vector<double>& values, double share) {
+    if (values.empty()) {
+        return 0.0;
+    }
+
+    const size_t index = min(values.size() - 1, static_cast<size_t>(values.size() * share));
+    nth_element(values.begin(), values.begin() + index, values.end());
+
+    return values[index];
+}
+
+} // namespace
+
+int main(int argc, char* argv[]) {
+    int port = 7700;
+    string unix_path;
+    size_t connection_count = 4;
+    size_t depth = 64;
+    int seconds = 10;
+    vector<string> requests;
+    size_t mutation_count = 0;
+
+    for (int i = 1; i + 1 < argc; i += 2) {
+        const string_view option = argv[i];
+        const string value = argv[i + 1];
+
+        if (option == "--port"sv) {
+            port = stoi(value);
+        } else if (option == "--unix"sv) {
+            unix_path = value;
+        } else if (option == "--connections"sv) {
+            connection_count = max(1, stoi(value));
+        } else if (option == "--depth"sv) {
+            depth = max(1, stoi(value));
+        } else if (option == "--seconds"sv) {
+            seconds = stoi(value);
+        } else if (option == "--mutations"sv) {
+            mutation_count = max(0, stoi(value));
+        } else if (option == "--requests"sv) {
+            ifstream input(value);
+
+            for (string line; getline(input, line);) {
+                if (!line.empty()) {
+                    requests.push_back(line);
+                }
+            }
+        } else {
+            cerr << "Unknown option "s << option << endl;
+            return 1;
+        }
+    }
+
+    if (requests.empty()) {
+        requests = { "FIND curly cat"s, "FIND funny pet -dog"s, "FIND nasty rat"s, "FIND well groomed starling"s };
+    }
+
+    const auto start = Clock::now();
+    const auto deadline = start + chrono::seconds(seconds);
+
+    vector<Results> results(connection_count);
+    vector<thread> threads;
+    atomic<bool> has_failed = false;
+
+    for (size_t i = 0; i < connection_count; ++i) {
+        threads.emplace_back([&, i] {
+            try {
+                if (mutation_count == 0) {
+                    results[i] = RunConnection(port, unix_path, requests, depth, deadline, i * depth, SIZE_MAX);
+                    return;
+                }
+
+                vector<string> mutations;
+
+                for (size_t j = 0; j < mutation_count; ++j) {
+                    const string id = to_string((i + 1) * 1000000 + j);
+
+                    mutations.push_back("ADD "s + id + " ACTUAL 1 word"s + id + " common"s);
+                    mutations.push_back("MATCH "s + id + " word"s + id);
+                    mutations.push_back("REMOVE "s + id);
+                }
+
+                results[i] = RunConnection(port, unix_path, mutations, depth, Clock::time_point::max(), 0, mutations.size());
+            } catch (const exception& e) {
+                cerr << e.what() << endl;
+                has_failed = true;
+            }
+        });
+    }
+
+    for (thread& t : threads) {
+        t.join();
+    }
+
+    const double elapsed = chrono::duration<double>(Clock::now() - start).count();
+
+    Results total;
+
+    for (Results& connection_results : results) {
+        total.response_count += connection_results.response_count;
+        total.error_count += connection_results.error_count;
+        total.latencies_us.insert(total.latencies_us.end(), connection_results.latencies_us.begin(), connection_results.latencies_us.end());
+    }
+
+    cout << "requests: "s << total.response_count << ", errors: "s << total.error_count
+         << ", requests/s: "s << static_cast<size_t>(total.response_count / elapsed) << endl;
+    cout << "latency us: p50 "s << GetPercentile(total.latencies_us, 0.5)
+         << ", p99 "s << GetPercentile(total.latencies_us, 0.99)
+         << ", max "s << GetPercentile(total.latencies_us, 1.0) << endl;
+
+    return has_failed || (mutation_count > 0 && total.error_count > 0) ? 1 : 0;
+}
@@ -0,0 +1,682 @@
+// Standalone search daemon serving the QueryProtocol lines over TCP or a Unix socket
+//
+//   search_server_daemon [--port N | --unix PATH] [--workers N] [--stop-words "and in"] [--load FILE]
+//                        [--wal PATH [--wal-sync every|batch|none]]
+//
+// --load executes the lines of FILE as requests before serving, ADD lines build the index.
+// --wal recovers the documents from the write-ahead log at PATH and logs ADD and REMOVE to it.
+// One thread runs an epoll loop over all connections, parsed requests go to a worker pool.
+// A client may pipeline requests: the requests of one connection run one at a time in their
+// order, so a request sees the mutations sent before it, and different connections run in
+// parallel
+
+#include "query_protocol.h"
+#include "search_server.h"
+#include "write_ahead_log.h"
+
+#include <fcntl.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <sys/epoll.h>
+#include <sys/eventfd.h>
+#include <sys/signalfd.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <cerrno>
+#include <condition_variable>
+#include <csignal>
+#include <cstring>
+#include <deque>
+#include <fstream>
+#include <functional>
+#include <iostream>
+#include <memory>
+#include <mutex>
+#include <stdexcept>
+#include <string>
+#include <thread>
+#include <unordered_map>
+#include <vector>
+
+using namespace std;
+
+namespace {
+
+// requests of one connection waiting for the one being executed, reading the connection
+// pauses at the limit
+constexpr size_t MAX_QUEUED_REQUESTS = 256;
+constexpr size_t MAX_REQUEST_SIZE = 1 << 20;
+constexpr int MAX_EVENTS = 256;
+
+void ThrowSystemError(const string& what) {
+    throw runtime_error(what + ": "s + strerror(errno));
+}
+
+class WorkerPool {
+public:
+    explicit WorkerPool(size_t worker_count) {
+        for (size_t i = 0; i < worker_count; ++i) {
+            workers_.emplace_back([this] { Run(); });
+        }
+    }
+
+    ~WorkerPool() {
+        {
+            lock_guard guard(mutex_);
+            is_stopping_ = true;
+        }
+
+        condition_.notify_all();
+
+        for (thread& worker : workers_) {
+            worker.join();
+        }
+    }
+
+    void Submit(function<void()> task) {
+        {
+            lock_guard guard(mutex_);
+            tasks_.push_back(move(task));
+        }
+
+        condition_.notify_one();
+    }
+
+private:
+    void Run() {
+        while (true) {
+            function<void()> task;
+            {
+                unique_lock lock(mutex_);
+                condition_.wait(lock, [this] { return is_stopping_ || !tasks_.empty(); });
+
+                if (tasks_.empty()) {
+                    return;
+                }
+
+                task = move(tasks_.front());
+                tasks_.pop_front();
+            }
+
+            task();
+        }
+    }
+
+    mutex mutex_;
+    condition_variable condition_;
+    deque<function<void()>> tasks_;
+    bool is_stopping_ = false;
+    vector<thread> workers_;
+};
+
+struct Completion {
+    uint64_t connection_id;
+    string response;
+};
+
+// Workers push responses here, the event loop is woken through an eventfd
+class CompletionQueue {
+public:
+    CompletionQueue()
+        : event_fd_(eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC)) {
+        if (event_fd_ < 0) {
+            ThrowSystemError("eventfd"s);
+        }
+    }
+
+    ~CompletionQueue() {
+        close(event_fd_);
+    }
+
+    int GetFd() const {
+        return event_fd_;
+    }
+
+    void Push(Completion completion) {
+        bool was_empty;
+        {
+            lock_guard guard(mutex_);
+            was_empty = completions_.empty();
+            completions_.push_back(move(completion));
+        }
+
+        // one wake-up serves the whole batch
+        if (was_empty) {
+            const uint64_t one = 1;
+            [[maybe_unused]] const auto written = write(event_fd_, &one, sizeof(one));
+        }
+    }
+
+    vector<Completion> Drain() {
+        uint64_t counter;
+        [[maybe_unused]] const auto read_size = read(event_fd_, &counter, sizeof(counter));
+
+        vector<Completion> completions;
+        {
+            lock_guard guard(mutex_);
+            completions.swap(completions_);
+        }
+
+        return completions;
+    }
+
+private:
+    const int event_fd_;
+    mutex mutex_;
+    vector<Completion> completions_;
+};
+
+struct Connection {
+    int fd = -1;
+    string input;
+    string output;
+    size_t output_offset = 0;
+    deque<string> requests; // parsed, waiting for the one being executed
+    bool is_executing = false;
+    bool is_input_closed = false;
+    bool is_broken = false; // nothing can be sent, it waits for its requests to be closed
+    uint32_t events = 0;
+};
+
+class EventLoop {
+public:
+    EventLoop(int listen_fd, int signal_fd, QueryProtocol& protocol, WorkerPool& workers)
+        : listen_fd_(listen_fd)
+        , signal_fd_(signal_fd)
+        , epoll_fd_(epoll_create1(EPOLL_CLOEXEC))
+        , spare_fd_(open("/dev/null", O_RDONLY | O_CLOEXEC))
+        , protocol_(protocol)
+        , workers_(workers) {
+        if (epoll_fd_ < 0) {
+            ThrowSystemError("epoll_create1"s);
+        }
+
+        AddFd(listen_fd_, LISTEN_ID, EPOLLIN);
+        AddFd(completions_.GetFd(), COMPLETIONS_ID, EPOLLIN);
+        AddFd(signal_fd_, SIGNAL_ID, EPOLLIN);
+    }
+
+    ~EventLoop() {
+        for (auto& [_, connection] : connections_) {
+            close(connection.fd);
+        }
+
+        if (spare_fd_ >= 0) {
+            close(spare_fd_);
+        }
+
+        close(epoll_fd_);
+    }
+
+    // Serves until SIGINT or SIGTERM, then waits for the requests being executed
+    void Run() {
+        epoll_event events[MAX_EVENTS];
+        bool is_stopping = false;
+
+        while (!is_stopping) {
+            const int event_count = epoll_wait(epoll_fd_, events, MAX_EVENTS, -1);
+
+            if (event_count < 0) {
+                if (errno == EINTR) {
+                    continue;
+                }
+
+                ThrowSystemError("epoll_wait"s);
+            }
+
+            for (int i = 0; i < event_count; ++i) {
+                const uint64_t id = events[i].data.u64;
+
+                if (id == LISTEN_ID) {
+                    Accept();
+                } else if (id == COMPLETIONS_ID) {
+                    OnCompletions();
+                } else if (id == SIGNAL_ID) {
+                    is_stopping = true;
+                } else {
+                    OnConnectionEvent(id, events[i].events);
+                }
+            }
+        }
+
+        // responses of the running requests refer to the connections
+        while (in_flight_count_ > 0) {
+            in_flight_count_ -= completions_.Drain().size();
+            this_thread::yield();
+        }
+    }
+
+private:
+    static constexpr uint64_t LISTEN_ID = 0;
+    static constexpr uint64_t COMPLETIONS_ID = 1;
+    static constexpr uint64_t SIGNAL_ID = 2;
+
+    void AddFd(int fd, uint64_t id, uint32_t events) {
+        epoll_event event{};
+        event.events = events;
+        event.data.u64 = id;
+
+        if (epoll_ctl(epoll_fd_, EPOLL_CTL_ADD, fd, &event) < 0) {
+            ThrowSystemError("epoll_ctl"s);
+        }
+    }
+
+    void Accept() {
+        while (true) {
+            const int fd = accept4(listen_fd_, nullptr, nullptr, SOCK_NONBLOCK | SOCK_CLOEXEC);
+
+            if (fd < 0) {
+                if ((errno == EMFILE || errno == ENFILE) && spare_fd_ >= 0) {
+                    // the listen fd stays readable until the connection is taken, so it is
+                    // accepted with the spare descriptor and closed at once
+                    const int error = errno;
+                    close(spare_fd_);
+                    const int rejected_fd = accept4(listen_fd_, nullptr, nullptr, SOCK_CLOEXEC);
+
+                    if (rejected_fd >= 0) {
+                        close(rejected_fd);
+                    }
+
+                    spare_fd_ = open("/dev/null", O_RDONLY | O_CLOEXEC);
+
+                    // the limit is hit before the queue is checked, it may be empty
+                    if (rejected_fd < 0) {
+                        return;
+                    }
+
+                    cerr << "accept: "s << strerror(error) << ", the connection is closed"s << endl;
+                    continue;
+                }
+
+                if (errno != EAGAIN && errno != EWOULDBLOCK && errno != EINTR) {
+                    cerr << "accept: "s << strerror(errno) << endl;
+                }
+
+                return;
+            }
+
+            // pipelined responses are small, they should not wait for Nagle
+            const int one = 1;
+            setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one));
+
+            const uint64_t id = next_connection_id_++;
+            Connection& connection = connections_[id];
+            connection.fd = fd;
+            connection.events = EPOLLIN;
+
+            AddFd(fd, id, connection.events);
+        }
+    }
+
+    void OnConnectionEvent(uint64_t id, uint32_t events) {
+        const auto it = connections_.find(id);
+
+        if (it == connections_.end()) {
+            return;
+        }
+
+        Connection& connection = it->second;
+
+        if (events & (EPOLLERR | EPOLLHUP)) {
+            Break(connection);
+        }
+
+        if ((events & EPOLLIN) && !connection.is_broken) {
+            Read(connection);
+            StartRequests(id, connection);
+        }
+
+        if ((events & EPOLLOUT) && !connection.is_broken) {
+            Write(connection);
+        }
+
+        Update(id, connection);
+    }
+
+    void Break(Connection& connection) {
+        if (!connection.is_broken) {
+            epoll_ctl(epoll_fd_, EPOLL_CTL_DEL, connection.fd, nullptr);
+            connection.is_broken = true;
+            connection.requests.clear();
+            connection.output.clear();
+            connection.output_offset = 0;
+        }
+    }
+
+    void Read(Connection& connection) {
+        char buffer[64 * 1024];
+
+        while (true) {
+            const ssize_t size = read(connection.fd, buffer, sizeof(buffer));
+
+            if (size > 0) {
+                connection.input.append(buffer, size);
+
+                if (connection.input.size() > MAX_REQUEST_SIZE * 2) {
+                    return; // the rest waits until the requests are parsed
+                }
+            } else if (size == 0) {
+                // the peer has sent all of its requests but still reads the responses
+                connection.is_input_closed = true;
+                return;
+            } else {
+                if (errno != EAGAIN && errno != EWOULDBLOCK && errno != EINTR) {
+                    Break(connection);
+                }
+
+                return;
+            }
+        }
+    }
+
+    void StartRequests(uint64_t id, Connection& connection) {
+        if (connection.is_broken) {
+            return;
+        }
+
+        size_t begin = 0;
+
+        while (connection.requests.size() < MAX_QUEUED_REQUESTS) {
+            const size_t end = connection.input.find('\n', begin);
+
+            if (end == string::npos) {
+                break;
+            }
+
+            string request = connection.input.substr(begin, end - begin);
+            begin = end + 1;
+
+            if (!request.empty() && request.back() == '\r') {
+                request.pop_back();
+            }
+
+            connection.requests.push_back(move(request));
+        }
+
+        connection.input.erase(0, begin);
+
+        if (connection.input.size() > MAX_REQUEST_SIZE && connection.input.find('\n') == string::npos) {
+            Break(connection); // a request too long to be one
+            return;
+        }
+
+        ExecuteNextRequest(id, connection);
+    }
+
+    // The next request starts once the previous one is done, so it sees its mutations
+    void ExecuteNextRequest(uint64_t id, Connection& connection) {
+        if (connection.is_executing || connection.requests.empty()) {
+            return;
+        }
+
+        connection.is_executing = true;
+        ++in_flight_count_;
+
+        workers_.Submit([this, id, request = move(connection.requests.front())] {
+            completions_.Push({ id, protocol_.Execute(request) });
+        });
+
+        connection.requests.pop_front();
+    }
+
+    void OnCompletions() {
+        vector<uint64_t> completed_ids;
+
+        for (Completion& completion : completions_.Drain()) {
+            --in_flight_count_;
+
+            const auto it = connections_.find(completion.connection_id);
+
+            if (it == connections_.end()) {
+                continue;
+            }
+
+            Connection& connection = it->second;
+            connection.is_executing = false;
+            completed_ids.push_back(completion.connection_id);
+
+            if (!connection.is_broken) {
+                connection.output += completion.response;
+                connection.output += '\n';
+            }
+        }
+
+        // a connection has one request executing at a time, so it has one completion at most
+        for (const uint64_t id : completed_ids) {
+            Connection& connection = connections_.at(id);
+
+            if (!connection.is_broken) {
+                Write(connection);
+                StartRequests(id, connection);
+            }
+
+            Update(id, connection);
+        }
+    }
+
+    void Write(Connection& connection) {
+        while (connection.output_offset < connection.output.size()) {
+            const ssize_t size = send(connection.fd, connection.output.data() + connection.output_offset,
+                                      connection.output.size() - connection.output_offset, MSG_NOSIGNAL);
+
+            if (size < 0) {
+                if (errno == EAGAIN || errno == EWOULDBLOCK || errno == EINTR) {
+                    return;
+                }
+
+                Break(connection);
+                return;
+            }
+
+            connection.output_offset += size;
+        }
+
+        connection.output.clear();
+        connection.output_offset = 0;
+    }
+
+    // Sets the events to wait for, closes a connection with nothing left to do
+    void Update(uint64_t id, Connection& connection) {
+        const bool has_output = connection.output_offset < connection.output.size();
+        const bool has_requests = connection.is_executing || !connection.requests.empty();
+
+        if ((connection.is_input_closed || connection.is_broken) && !has_output && !has_requests) {
+            close(connection.fd);
+            connections_.erase(id);
+            return;
+        }
+
+        if (connection.is_broken) {
+            return;
+        }
+
+        uint32_t events = 0;
+
+        if (!connection.is_input_closed && connection.requests.size() < MAX_QUEUED_REQUESTS) {
+            events |= EPOLLIN;
+        }
+
+        if (has_output) {
+            events |= EPOLLOUT;
+        }
+
+        if (events != connection.events) {
+            epoll_event event{};
+            event.events = events;
+            event.data.u64 = id;
+            epoll_ctl(epoll_fd_, EPOLL_CTL_MOD, connection.fd, &event);
+            connection.events = events;
+        }
+    }
+
+    const int listen_fd_;
+    const int signal_fd_;
+    const int epoll_fd_;
+    int spare_fd_; // closed to accept a connection over the descriptor limit
+    QueryProtocol& protocol_;
+    WorkerPool& workers_;
+    CompletionQueue completions_;
+    unordered_map<uint64_t, Connection> connections_;
+    uint64_t next_connection_id_ = SIGNAL_ID + 1;
+    size_t in_flight_count_ = 0;
+};
+
+int Listen(int port, const string& unix_path) {
+    int fd;
+
+    if (!unix_path.empty()) {
+        fd = socket(AF_UNIX, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+
+        sockaddr_un address{};
+        address.sun_family = AF_UNIX;
+
+        if (unix_path.size() >= sizeof(address.sun_path)) {
+            throw invalid_argument("Unix socket path is too long"s);
+        }
+
+        strcpy(address.sun_path, unix_path.c_str());
+        unlink(unix_path.c_str());
+
+        if (fd < 0 || bind(fd, reinterpret_cast<const sockaddr*>(&address), sizeof(address)) < 0) {
+            ThrowSystemError("bind "s + unix_path);
+        }
+    } else {
+        fd = socket(AF_INET, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+
+        const int one = 1;
+        setsockopt(fd, SOL_SOCKET, SO_REUSEADDR, &one, sizeof(one));
+
+        sockaddr_in address{};
+        address.sin_family = AF_INET;
+        address.sin_addr.s_addr = htonl(INADDR_ANY);
+        address.sin_port = htons(static_cast<uint16_t>(port));
+
+        if (fd < 0 || bind(fd, reinterpret_cast<const sockaddr*>(&address), sizeof(address)) < 0) {
+            ThrowSystemError("bind port "s + to_string(port));
+        }
+    }
+
+    if (listen(fd, SOMAXCONN) < 0) {
+        ThrowSystemError("listen"s);
+    }
+
+    return fd;
+}
+
+} // namespace
+
+int main(int argc, char* argv[]) {
+    int port = 7700;
+    string unix_path;
+    size_t worker_count = max(1u, thread::hardware_concurrency());
+    string stop_words;
+    string load_path;
+    string log_path;
+    WriteAheadLogOptions log_options;
+
+    for (int i = 1; i < argc; ++i) {
+        const string_view option = argv[i];
+
+        if (i + 1 == argc) {
+            cerr << "No value for "s << option << endl;
+            return 1;
+        }
+
+        const string value = argv[++i];
+
+        if (option == "--port"sv) {
+            port = stoi(value);
+        } else if (option == "--unix"sv) {
+            unix_path = value;
+        } else if (option == "--workers"sv) {
+            worker_count = max(1, stoi(value));
+        } else if (option == "--stop-words"sv) {
+            stop_words = value;
+        } else if (option == "--load"sv) {
+            load_path = value;
+        } else if (option == "--wal"sv) {
+            log_path = value;
+        } else if (option == "--wal-sync"sv) {
+            if (value == "every"sv) {
+                log_options.sync_policy = LogSyncPolicy::EVERY_COMMIT;
+            } else if (value == "batch"sv) {
+                log_options.sync_policy = LogSyncPolicy::BATCH;
+            } else if (value == "none"sv) {
+                log_options.sync_policy = LogSyncPolicy::NONE;
+            } else {
+                cerr << "--wal-sync is every, batch or none"s << endl;
+                return 1;
+            }
+        } else {
+            cerr << "Unknown option "s << option << endl;
+            return 1;
+        }
+    }
+
+    try {
+        SearchServer search_server(stop_words);
+        unique_ptr<WriteAheadLog> log;
+
+        if (!log_path.empty()) {
+            log = make_unique<WriteAheadLog>(log_path, search_server, log_options);
+            cerr << "Recovered "s << search_server.GetDocumentCount() << " documents from "s << log_path << endl;
+        }
+
+        QueryProtocol protocol(search_server, log.get());
+
+        if (!load_path.empty()) {
+            ifstream input(load_path);
+
+            if (!input) {
+                throw runtime_error("Can't open "s + load_path);
+            }
+
+            size_t line_count = 0;
+
+            for (string line; getline(input, line); ++line_count) {
+                const string response = protocol.Execute(line);
+
+                if (response.rfind("ERROR"s, 0) == 0) {
+                    cerr << load_path << ':' << line_count + 1 << ": "s << response << endl;
+                }
+            }
+
+            cerr << "Loaded "s << search_server.GetDocumentCount() << " documents"s << endl;
+        }
+
+        // the signals are read from a signalfd by the event loop, so no thread may take them
+        sigset_t signals;
+        sigemptyset(&signals);
+        sigaddset(&signals, SIGINT);
+        sigaddset(&signals, SIGTERM);
+        pthread_sigmask(SIG_BLOCK, &signals, nullptr);
+
+        const int signal_fd = signalfd(-1, &signals, SFD_NONBLOCK | SFD_CLOEXEC);
+        const int listen_fd = Listen(port, unix_path);
+
+        {
+            WorkerPool workers(worker_count);
+            EventLoop loop(listen_fd, signal_fd, protocol, workers);
+
+            cerr << "Serving on "s << (unix_path.empty() ? "port "s + to_string(port) : unix_path)
+                 << " with "s << worker_count << " workers"s << endl;
+
+            loop.Run();
+        }
+
+        close(listen_fd);
+        close(signal_fd);
+
+        if (!unix_path.empty()) {
+            unlink(unix_path.c_str());
+        }
+    } catch (const exception& e) {
+        cerr << e.what() << endl;
+        return 1;
+    }
+
+    return 0;
+}
@@ -27,6 +27,7 @@ struct DocumentData {
     int rating;
     DocumentStatus status;
     std::string text;
+    size_t word_count = 0; // non-stop words, for length-normalizing rankings
 };
 
 std::ostream& operator<<(std::ostream& out, const Document& document);
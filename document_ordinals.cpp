@@ -0,0 +1,91 @@
+#include "document_ordinals.h"
+
+using namespace std;
+
+DocumentOrdinals::DocumentOrdinals(pmr::memory_resource* resource)
+    : ordinal_to_document_id_(resource)
+    , is_live_(resource)
+    , document_id_to_ordinal_(resource) {
+}
+
+size_t DocumentOrdinals::Add(int document_id) {
+    const size_t ordinal = ordinal_to_document_id_.size();
+
+    ordinal_to_document_id_.push_back(document_id);
+    is_live_.push_back(true);
+    document_id_to_ordinal_.emplace(document_id, ordinal);
+
+    return ordinal;
+}
+
+bool DocumentOrdinals::Remove(int document_id) {
+    const auto it = document_id_to_ordinal_.find(document_id);
+
+    if (it == document_id_to_ordinal_.end()) {
+        return false;
+    }
+
+    is_live_[it->second] = false;
+    document_id_to_ordinal_.erase(it);
+
+    return true;
+}
+
+size_t DocumentOrdinals::Find(int document_id) const {
+    const auto it = document_id_to_ordinal_.find(document_id);
+
+    return it == document_id_to_ordinal_.end() ? NO_ORDINAL : it->second;
+}
+
+bool DocumentOrdinals::Contains(int document_id) const {
+    return document_id_to_ordinal_.count(document_id) != 0;
+}
+
+int DocumentOrdinals::GetDocumentId(size_t ordinal) const {
+    return ordinal_to_document_id_.at(ordinal);
+}
+
+bool DocumentOrdinals::IsLive(size_t ordinal) const {
+    return ordinal < is_live_.size() && is_live_[ordinal];
+}
+
+size_t DocumentOrdinals::size() const {
+    return document_id_to_ordinal_.size();
+}
+
+size_t DocumentOrdinals::GetOrdinalCount() const {
+    return ordinal_to_document_id_.size();
+}
+
+size_t DocumentOrdinals::GetDeadCount() const {
+    return GetOrdinalCount() - size();
+}
+
+void DocumentOrdinals::Compact() {
+    size_t live_ordinal = 0;
+
+    for (size_t ordinal = 0; ordinal < ordinal_to_document_id_.size(); ++ordinal) {
+        if (!is_live_[ordinal]) {
+            continue;
+        }
+
+        const int document_id = ordinal_to_document_id_[ordinal];
+
+        ordinal_to_document_id_[live_ordinal] = document_id;
+        document_id_to_ordinal_[document_id] = live_ordinal;
+        ++live_ordinal;
+    }
+
+    ordinal_to_document_id_.resize(live_ordinal);
+    ordinal_to_document_id_.shrink_to_fit();
+    is_live_.assign(live_ordinal, true);
+    is_live_.shrink_to_fit();
+}
+
+DocumentOrdinals::ConstIterator DocumentOrdinals::begin() const {
+    return { this, 0 };
+}
+
+DocumentOrdinals::ConstIterator DocumentOrdinals::end() const {
+    return { this, ordinal_to_document_id_.size() };
+}
@@ -0,0 +1,108 @@
+#pragma once
+
+#include <cstdint>
+#include <iterator>
+#include <memory_resource>
+#include <unordered_map>
+#include <vector>
+
+// Dense internal numbering of documents. Every added document gets the next ordinal,
+// so ordinals follow the order of addition and can index plain arrays. Removed
+// documents only clear their live bit and iteration skips dead slots; ordinals
+// move only when the owner compacts them.
+class DocumentOrdinals {
+public:
+    static constexpr size_t NO_ORDINAL = static_cast<size_t>(-1);
+
+    class ConstIterator {
+    public:
+        using iterator_category = std::forward_iterator_tag;
+        using value_type = int;
+        using difference_type = std::ptrdiff_t;
+        using pointer = const int*;
+        using reference = const int&;
+
+        ConstIterator() = default;
+
+        ConstIterator(const DocumentOrdinals* ordinals, size_t ordinal)
+            : ordinals_(ordinals)
+            , ordinal_(ordinal) {
+            SkipDead();
+        }
+
+        reference operator*() const {
+            return ordinals_->ordinal_to_document_id_[ordinal_];
+        }
+
+        pointer operator->() const {
+            return &**this;
+        }
+
+        ConstIterator& operator++() {
+            ++ordinal_;
+            SkipDead();
+            return *this;
+        }
+
+        ConstIterator operator++(int) {
+            ConstIterator previous = *this;
+            ++*this;
+            return previous;
+        }
+
+        bool operator==(const ConstIterator& other) const {
+            return ordinal_ == other.ordinal_;
+        }
+
+        bool operator!=(const ConstIterator& other) const {
+            return ordinal_ != other.ordinal_;
+        }
+
+    private:
+        void SkipDead() {
+            while (ordinal_ < ordinals_->is_live_.size() && !ordinals_->is_live_[ordinal_]) {
+                ++ordinal_;
+            }
+        }
+
+        const DocumentOrdinals* ordinals_ = nullptr;
+        size_t ordinal_ = 0;
+    };
+
+    explicit DocumentOrdinals(std::pmr::memory_resource* resource);
+
+    // Returns the ordinal of the new document, the id must not be live already
+    size_t Add(int document_id);
+
+    // Returns false if there is no live document with this id
+    bool Remove(int document_id);
+
+    size_t Find(int document_id) const;
+
+    bool Contains(int document_id) const;
+
+    int GetDocumentId(size_t ordinal) const;
+
+    bool IsLive(size_t ordinal) const;
+
+    // Live documents count
+    size_t size() const;
+
+    // Number of ordinals given so far including removed ones, arrays indexed by ordinal need this size
+    size_t GetOrdinalCount() const;
+
+    // Ordinals of removed documents
+    size_t GetDeadCount() const;
+
+    // Renumbers the live documents from 0 in the same order and frees the dead ordinals.
+    // Everything indexed by ordinal has to be rebuilt after it
+    void Compact();
+
+    ConstIterator begin() const;
+    ConstIterator end() const;
+
+private:
+    std::pmr::vector<int> ordinal_to_document_id_;
+    std::pmr::vector<bool> is_live_;
+    std::pmr::unordered_map<int, size_t> document_id_to_ordinal_;
+};
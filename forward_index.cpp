@@ -0,0 +1,85 @@
+#include "forward_index.h"
+
+#include <algorithm>
+
+using namespace std;
+
+bool WordFrequenciesView::Contains(string_view word) const {
+    const auto it = lower_bound(begin_, end_, word, [this](const ForwardIndexEntry& entry, string_view value) {
+        return words_[entry.term_id] < value;
+    });
+
+    return it != end_ && words_[it->term_id] == word;
+}
+
+ForwardIndex::ForwardIndex(pmr::memory_resource* resource)
+    : entries_(resource)
+    , begins_(resource)
+    , sizes_(resource) {
+}
+
+void ForwardIndex::Add(size_t ordinal, const vector<ForwardIndexEntry>& entries) {
+    if (ordinal >= begins_.size()) {
+        begins_.resize(ordinal + 1, 0);
+        sizes_.resize(ordinal + 1, 0);
+    }
+
+    begins_[ordinal] = entries_.size();
+    sizes_[ordinal] = static_cast<uint32_t>(entries.size());
+
+    entries_.insert(entries_.end(), entries.begin(), entries.end());
+}
+
+void ForwardIndex::Remove(size_t ordinal) {
+    if (ordinal >= sizes_.size()) {
+        return;
+    }
+
+    garbage_count_ += sizes_[ordinal];
+    sizes_[ordinal] = 0;
+
+    if (garbage_count_ > entries_.size() / 2) {
+        Compact();
+    }
+}
+
+WordFrequenciesView ForwardIndex::Get(size_t ordinal, const string_view* words) const {
+    if (ordinal >= sizes_.size()) {
+        return {};
+    }
+
+    const ForwardIndexEntry* begin = entries_.data() + begins_[ordinal];
+
+    return { begin, begin + sizes_[ordinal], words };
+}
+
+void ForwardIndex::Clear() {
+    entries_.clear();
+    entries_.shrink_to_fit();
+    begins_.clear();
+    begins_.shrink_to_fit();
+    sizes_.clear();
+    sizes_.shrink_to_fit();
+    garbage_count_ = 0;
+}
+
+size_t ForwardIndex::GetMemoryUsage() const {
+    return entries_.capacity() * sizeof(ForwardIndexEntry)
+         + begins_.capacity() * sizeof(uint64_t)
+         + sizes_.capacity() * sizeof(uint32_t);
+}
+
+void ForwardIndex::Compact() {
+    pmr::vector<ForwardIndexEntry> entries(entries_.get_allocator());
+    entries.reserve(entries_.size() - garbage_count_);
+
+    for (size_t ordinal = 0; ordinal < begins_.size(); ++ordinal) {
+        const auto begin = entries_.begin() + begins_[ordinal];
+
+        begins_[ordinal] = entries.size();
+        entries.insert(entries.end(), begin, begin + sizes_[ordinal]);
+    }
+
+    entries_ = move(entries);
+    garbage_count_ = 0;
+}
@@ -0,0 +1,132 @@
+#pragma once
+
+#include <cstdint>
+#include <iterator>
+#include <memory_resource>
+#include <string_view>
+#include <utility>
+#include <vector>
+
+struct ForwardIndexEntry {
+    uint32_t term_id;
+    double term_freq;
+};
+
+// Read-only view of one document's words and term frequencies, sorted by word
+class WordFrequenciesView {
+public:
+    class ConstIterator {
+    public:
+        // dereferencing returns a pair by value, which is enough for the algorithms used here
+        using iterator_category = std::forward_iterator_tag;
+        using value_type = std::pair<std::string_view, double>;
+        using difference_type = std::ptrdiff_t;
+        using pointer = void;
+        using reference = value_type;
+
+        struct ArrowProxy {
+            value_type value;
+
+            const value_type* operator->() const {
+                return &value;
+            }
+        };
+
+        ConstIterator() = default;
+
+        ConstIterator(const ForwardIndexEntry* entry, const std::string_view* words)
+            : entry_(entry)
+            , words_(words) {
+        }
+
+        value_type operator*() const {
+            return { words_[entry_->term_id], entry_->term_freq };
+        }
+
+        ArrowProxy operator->() const {
+            return { **this };
+        }
+
+        ConstIterator& operator++() {
+            ++entry_;
+            return *this;
+        }
+
+        ConstIterator operator++(int) {
+            ConstIterator previous = *this;
+            ++entry_;
+            return previous;
+        }
+
+        bool operator==(const ConstIterator& other) const {
+            return entry_ == other.entry_;
+        }
+
+        bool operator!=(const ConstIterator& other) const {
+            return entry_ != other.entry_;
+        }
+
+    private:
+        const ForwardIndexEntry* entry_ = nullptr;
+        const std::string_view* words_ = nullptr;
+    };
+
+    WordFrequenciesView() = default;
+
+    WordFrequenciesView(const ForwardIndexEntry* begin, const ForwardIndexEntry* end, const std::string_view* words)
+        : begin_(begin)
+        , end_(end)
+        , words_(words) {
+    }
+
+    ConstIterator begin() const {
+        return { begin_, words_ };
+    }
+
+    ConstIterator end() const {
+        return { end_, words_ };
+    }
+
+    size_t size() const {
+        return end_ - begin_;
+    }
+
+    bool empty() const {
+        return begin_ == end_;
+    }
+
+    // Binary search, the entries are sorted by word
+    bool Contains(std::string_view word) const;
+
+private:
+    const ForwardIndexEntry* begin_ = nullptr;
+    const ForwardIndexEntry* end_ = nullptr;
+    const std::string_view* words_ = nullptr;
+};
+
+// Words of every document as one contiguous array of (term id, tf) entries, a document
+// is a [begin, begin + size) slice addressed by its ordinal. Removed slices stay in the
+// array as garbage until it outgrows the live entries, then the array is compacted.
+class ForwardIndex {
+public:
+    explicit ForwardIndex(std::pmr::memory_resource* resource);
+
+    // entries must be sorted by word
+    void Add(size_t ordinal, const std::vector<ForwardIndexEntry>& entries);
+
+    void Remove(size_t ordinal);
+
+    WordFrequenciesView Get(size_t ordinal, const std::string_view* words) const;
+
+    void Clear();
+
+    size_t GetMemoryUsage() const;
+
+private:
+    void Compact();
+
+    std::pmr::vector<ForwardIndexEntry> entries_;
+    std::pmr::vector<uint64_t> begins_;
+    std::pmr::vector<uint32_t> sizes_;
+    size_t garbage_count_ = 0;
+};
@@ -0,0 +1,151 @@
+#include "impact_postings.h"
+
+#include <algorithm>
+#include <cmath>
+
+using namespace std;
+
+ImpactPostings::Cursor::Cursor(const Bucket* first, const Bucket* last)
+    : bucket_(first)
+    , last_(last) {
+    SkipEmptyBuckets();
+}
+
+bool ImpactPostings::Cursor::IsValid() const {
+    return bucket_ != last_;
+}
+
+int ImpactPostings::Cursor::GetDocumentId() const {
+    return bucket_->document_ids[position_];
+}
+
+double ImpactPostings::Cursor::GetMaxTermFreq() const {
+    return bucket_->max_term_freq;
+}
+
+void ImpactPostings::Cursor::Next() {
+    ++position_;
+    SkipEmptyBuckets();
+}
+
+void ImpactPostings::Cursor::SkipEmptyBuckets() {
+    while (bucket_ != last_ && position_ == bucket_->document_ids.size()) {
+        ++bucket_;
+        position_ = 0;
+    }
+}
+
+ImpactPostings::ImpactPostings(pmr::memory_resource* resource)
+    : resource_(resource)
+    , terms_(resource) {
+}
+
+uint32_t ImpactPostings::GetBucketIndex(double term_freq) {
+    if (term_freq >= 1.0) {
+        return 0;
+    }
+
+    const double index = -log2(term_freq) * BUCKETS_PER_OCTAVE;
+
+    return index >= MAX_BUCKET_INDEX ? MAX_BUCKET_INDEX : static_cast<uint32_t>(index);
+}
+
+ImpactPostings::Term& ImpactPostings::GetTerm(uint32_t term_id) {
+    // the terms get the resource of the outer vector
+    while (terms_.size() <= term_id) {
+        terms_.emplace_back();
+    }
+
+    return terms_[term_id];
+}
+
+void ImpactPostings::Add(uint32_t term_id, int document_id, double term_freq) {
+    Term& term = GetTerm(term_id);
+    const uint32_t index = GetBucketIndex(term_freq);
+
+    auto it = lower_bound(term.begin(), term.end(), index, [](const Bucket& bucket, uint32_t index) {
+        return bucket.index < index;
+    });
+
+    if (it == term.end() || it->index != index) {
+        // a term has MAX_BUCKET_INDEX buckets at most
+        it = term.emplace(it, index, resource_);
+    }
+
+    it->max_term_freq = max(it->max_term_freq, term_freq);
+    it->document_ids.push_back(document_id);
+}
+
+void ImpactPostings::Remove(uint32_t term_id, int document_id, double term_freq) {
+    if (term_id >= terms_.size()) {
+        return;
+    }
+
+    Term& term = terms_[term_id];
+
+    const auto remove_from = [document_id](Bucket& bucket) {
+        auto& document_ids = bucket.document_ids;
+        const auto it = find(document_ids.begin(), document_ids.end(), document_id);
+
+        if (it == document_ids.end()) {
+            return false;
+        }
+
+        *it = document_ids.back();
+        document_ids.pop_back();
+
+        return true;
+    };
+
+    const uint32_t index = GetBucketIndex(term_freq);
+
+    for (Bucket& bucket : term) {
+        if (bucket.index == index && remove_from(bucket)) {
+            return;
+        }
+    }
+
+    // the frequency was summed up in another order and fell into the next bucket
+    for (Bucket& bucket : term) {
+        if (remove_from(bucket)) {
+            return;
+        }
+    }
+}
+
+void ImpactPostings::Assign(uint32_t term_id, const vector<pair<int, double>>& postings) {
+    GetTerm(term_id).clear();
+
+    for (const auto& [document_id, term_freq] : postings) {
+        Add(term_id, document_id, term_freq);
+    }
+}
+
+void ImpactPostings::Clear() {
+    terms_.clear();
+    terms_.shrink_to_fit();
+}
+
+ImpactPostings::Cursor ImpactPostings::Get(uint32_t term_id) const {
+    if (term_id >= terms_.size()) {
+        return {};
+    }
+
+    const Term& term = terms_[term_id];
+
+    return { term.data(), term.data() + term.size() };
+}
+
+size_t ImpactPostings::GetMemoryUsage() const {
+    size_t memory_usage = terms_.capacity() * sizeof(Term);
+
+    for (const Term& term : terms_) {
+        memory_usage += term.capacity() * sizeof(Bucket);
+
+        for (const Bucket& bucket : term) {
+            memory_usage += bucket.document_ids.capacity() * sizeof(int);
+        }
+    }
+
+    return memory_usage;
+}
@@ -0,0 +1,77 @@
+#pragma once
+
+#include <cstdint>
+#include <memory_resource>
+#include <utility>
+#include <vector>
+
+// Postings of every term id ordered by impact: the inverse document frequency is the same
+// for all postings of a term, so the first postings of a term are the ones contributing
+// most to TF-IDF relevance, which lets top-K evaluation stop before the end of the lists.
+// Postings go to buckets of term frequencies, BUCKETS_PER_OCTAVE per power of two, and are
+// appended to their bucket unordered, so adding a document costs O(1) per word. Readers get
+// an upper bound of the frequencies left instead of the exact ones, 19% above them at most
+class ImpactPostings {
+public:
+    static constexpr int BUCKETS_PER_OCTAVE = 4;
+    // frequencies below 2^-32 share the last bucket
+    static constexpr uint32_t MAX_BUCKET_INDEX = 32 * BUCKETS_PER_OCTAVE;
+
+    struct Bucket {
+        explicit Bucket(uint32_t index, std::pmr::memory_resource* resource)
+            : index(index)
+            , document_ids(resource) {
+        }
+
+        uint32_t index;
+        double max_term_freq = 0.0; // of the postings ever added, may be above the ones left
+        std::pmr::vector<int> document_ids;
+    };
+
+    // Walks the postings of a term from the highest term frequencies
+    class Cursor {
+    public:
+        Cursor() = default;
+        Cursor(const Bucket* first, const Bucket* last);
+
+        bool IsValid() const;
+        int GetDocumentId() const;
+
+        // Not below the term frequency of this posting and all the next ones
+        double GetMaxTermFreq() const;
+
+        void Next();
+
+    private:
+        void SkipEmptyBuckets();
+
+        const Bucket* bucket_ = nullptr;
+        const Bucket* last_ = nullptr;
+        size_t position_ = 0;
+    };
+
+    explicit ImpactPostings(std::pmr::memory_resource* resource);
+
+    void Add(uint32_t term_id, int document_id, double term_freq);
+    void Remove(uint32_t term_id, int document_id, double term_freq);
+
+    // Replaces all postings of the term at once, postings are (document id, term frequency)
+    void Assign(uint32_t term_id, const std::vector<std::pair<int, double>>& postings);
+
+    void Clear();
+
+    Cursor Get(uint32_t term_id) const;
+
+    size_t GetMemoryUsage() const;
+
+    static uint32_t GetBucketIndex(double term_freq);
+
+private:
+    // Buckets ordered by index, so by term frequencies descending
+    using Term = std::pmr::vector<Bucket>;
+
+    Term& GetTerm(uint32_t term_id);
+
+    std::pmr::memory_resource* resource_;
+    std::pmr::vector<Term> terms_;
+};
@@ -24,7 +24,7 @@ public:
 
         const auto end_time = Clock::now();
         const auto dur = end_time - start_time_;
-        out_ << "Operation time"s
+        out_ << id_
              << ": "s << duration_cast<milliseconds>(dur).count() << " ms"s << std::endl;
     }
 
@@ -0,0 +1,286 @@
+#include "metrics.h"
+
+#include <fstream>
+#include <cstdio>
+#include <memory>
+#include <mutex>
+#include <sstream>
+#include <stdexcept>
+#include <vector>
+
+using namespace std;
+
+namespace {
+
+constexpr size_t PHASE_COUNT = static_cast<size_t>(MetricsPhase::COUNT);
+constexpr size_t COUNTER_COUNT = static_cast<size_t>(MetricsCounter::COUNT);
+
+// Only the owner thread writes, so a relaxed load + store is enough and avoids locked instructions
+void Increase(atomic<uint64_t>& value, uint64_t delta) {
+    value.store(value.load(memory_order_relaxed) + delta, memory_order_relaxed);
+}
+
+struct ThreadHistogram {
+    atomic<uint64_t> count{ 0 };
+    atomic<uint64_t> sum_ns{ 0 };
+    atomic<uint64_t> max_ns{ 0 };
+    array<atomic<uint64_t>, LatencyHistogram::BUCKET_COUNT> buckets{};
+};
+
+struct ThreadMetrics {
+    array<ThreadHistogram, PHASE_COUNT> phases;
+    array<atomic<uint64_t>, COUNTER_COUNT> counters{};
+};
+
+// Thread metrics are kept after the thread exits, otherwise its numbers would be lost
+class MetricsRegistry {
+public:
+    ThreadMetrics& Register() {
+        lock_guard guard(mutex_);
+        return *threads_.emplace_back(make_unique<ThreadMetrics>());
+    }
+
+    template <typename Function>
+    void ForEach(Function function) {
+        lock_guard guard(mutex_);
+
+        for (auto& thread_metrics : threads_) {
+            function(*thread_metrics);
+        }
+    }
+
+private:
+    mutex mutex_;
+    vector<unique_ptr<ThreadMetrics>> threads_;
+};
+
+MetricsRegistry& GetRegistry() {
+    static MetricsRegistry registry;
+    return registry;
+}
+
+ThreadMetrics& GetThreadMetrics() {
+    thread_local ThreadMetrics& thread_metrics = GetRegistry().Register();
+    return thread_metrics;
+}
+
+} // namespace
+
+int LatencyHistogram::GetBucketIndex(uint64_t value_ns) {
+    if (value_ns < SUB_BUCKET_COUNT) {
+        return static_cast<int>(value_ns);
+    }
+
+    int magnitude = 63;
+    while ((value_ns >> magnitude) == 0) {
+        --magnitude;
+    }
+
+    const int sub_bucket = static_cast<int>((value_ns >> (magnitude - SUB_BUCKET_BITS)) & (SUB_BUCKET_COUNT - 1));
+
+    return (magnitude - SUB_BUCKET_BITS + 1) * SUB_BUCKET_COUNT + sub_bucket;
+}
+
+uint64_t LatencyHistogram::GetBucketUpperBound(int index) {
+    if (index < SUB_BUCKET_COUNT) {
+        return static_cast<uint64_t>(index);
+    }
+
+    const int magnitude = index / SUB_BUCKET_COUNT + SUB_BUCKET_BITS - 1;
+    const uint64_t sub_bucket = index % SUB_BUCKET_COUNT;
+    const uint64_t lower_bound = (uint64_t{ 1 } << magnitude) | (sub_bucket << (magnitude - SUB_BUCKET_BITS));
+
+    return lower_bound + (uint64_t{ 1 } << (magnitude - SUB_BUCKET_BITS)) - 1;
+}
+
+uint64_t LatencyHistogram::GetPercentile(double percentile) const {
+    if (count == 0) {
+        return 0;
+    }
+
+    const uint64_t rank = max<uint64_t>(1, static_cast<uint64_t>(percentile / 100.0 * count + 0.5));
+    uint64_t seen = 0;
+
+    for (int i = 0; i < BUCKET_COUNT; ++i) {
+        seen += buckets[i];
+
+        if (seen >= rank) {
+            return min(GetBucketUpperBound(i), max_ns);
+        }
+    }
+
+    return max_ns;
+}
+
+void RecordPhaseDuration(MetricsPhase phase, chrono::nanoseconds duration) {
+    const uint64_t value_ns = duration.count() > 0 ? duration.count() : 0;
+    ThreadHistogram& histogram = GetThreadMetrics().phases[static_cast<size_t>(phase)];
+
+    Increase(histogram.count, 1);
+    Increase(histogram.sum_ns, value_ns);
+    Increase(histogram.buckets[LatencyHistogram::GetBucketIndex(value_ns)], 1);
+
+    if (histogram.max_ns.load(memory_order_relaxed) < value_ns) {
+        histogram.max_ns.store(value_ns, memory_order_relaxed);
+    }
+}
+
+void AddToCounter(MetricsCounter counter, uint64_t value) {
+    Increase(GetThreadMetrics().counters[static_cast<size_t>(counter)], value);
+}
+
+MetricsSnapshot GetMetricsSnapshot() {
+    MetricsSnapshot snapshot;
+
+    GetRegistry().ForEach([&snapshot](const ThreadMetrics& thread_metrics) {
+        for (size_t phase = 0; phase < PHASE_COUNT; ++phase) {
+            const ThreadHistogram& source = thread_metrics.phases[phase];
+            LatencyHistogram& target = snapshot.phases[phase];
+
+            target.count += source.count.load(memory_order_relaxed);
+            target.sum_ns += source.sum_ns.load(memory_order_relaxed);
+            target.max_ns = max(target.max_ns, source.max_ns.load(memory_order_relaxed));
+
+            for (int i = 0; i < LatencyHistogram::BUCKET_COUNT; ++i) {
+                target.buckets[i] += source.buckets[i].load(memory_order_relaxed);
+            }
+        }
+
+        for (size_t counter = 0; counter < COUNTER_COUNT; ++counter) {
+            snapshot.counters[counter] += thread_metrics.counters[counter].load(memory_order_relaxed);
+        }
+    });
+
+    return snapshot;
+}
+
+void ResetMetrics() {
+    GetRegistry().ForEach([](ThreadMetrics& thread_metrics) {
+        for (auto& histogram : thread_metrics.phases) {
+            histogram.count.store(0, memory_order_relaxed);
+            histogram.sum_ns.store(0, memory_order_relaxed);
+            histogram.max_ns.store(0, memory_order_relaxed);
+
+            for (auto& bucket : histogram.buckets) {
+                bucket.store(0, memory_order_relaxed);
+            }
+        }
+
+        for (auto& counter : thread_metrics.counters) {
+            counter.store(0, memory_order_relaxed);
+        }
+    });
+}
+
+const char* GetMetricsPhaseName(MetricsPhase phase) {
+    switch (phase) {
+        case MetricsPhase::QUERY_PARSE:
+            return "query_parse";
+        case MetricsPhase::POSTING_SCAN:
+            return "posting_scan";
+        case MetricsPhase::MINUS_WORDS:
+            return "minus_words";
+        case MetricsPhase::TOP_K:
+            return "top_k";
+        case MetricsPhase::MATCH:
+            return "match";
+        case MetricsPhase::COUNT:
+            break;
+    }
+
+    return "unknown";
+}
+
+const char* GetMetricsCounterName(MetricsCounter counter) {
+    switch (counter) {
+        case MetricsCounter::QUERIES:
+            return "queries";
+        case MetricsCounter::POSTINGS_SCANNED:
+            return "postings_scanned";
+        case MetricsCounter::MINUS_POSTINGS_SCANNED:
+            return "minus_postings_scanned";
+        case MetricsCounter::DOCUMENTS_SCORED:
+            return "documents_scored";
+        case MetricsCounter::DOCUMENTS_MATCHED:
+            return "documents_matched";
+        case MetricsCounter::QUERIES_REJECTED:
+            return "queries_rejected";
+        case MetricsCounter::QUERIES_DEGRADED:
+            return "queries_degraded";
+        case MetricsCounter::COUNT:
+            break;
+    }
+
+    return "unknown";
+}
+
+string FormatMetrics(const MetricsSnapshot& snapshot, MetricsFormat format) {
+    constexpr double QUANTILES[] = { 50.0, 90.0, 99.0, 99.9 };
+
+    ostringstream out;
+
+    if (format == MetricsFormat::PROMETHEUS) {
+        for (size_t counter = 0; counter < COUNTER_COUNT; ++counter) {
+            const char* name = GetMetricsCounterName(static_cast<MetricsCounter>(counter));
+
+            out << "# TYPE search_server_"s << name << "_total counter\n"s;
+            out << "search_server_"s << name << "_total "s << snapshot.counters[counter] << '\n';
+        }
+
+        out << "# TYPE search_server_phase_duration_ns summary\n"s;
+
+        for (size_t phase = 0; phase < PHASE_COUNT; ++phase) {
+            const char* name = GetMetricsPhaseName(static_cast<MetricsPhase>(phase));
+            const LatencyHistogram& histogram = snapshot.phases[phase];
+
+            for (const double quantile : QUANTILES) {
+                out << "search_server_phase_duration_ns{phase=\""s << name << "\",quantile=\""s << quantile / 100.0 << "\"} "s
+                    << histogram.GetPercentile(quantile) << '\n';
+            }
+
+            out << "search_server_phase_duration_ns_sum{phase=\""s << name << "\"} "s << histogram.sum_ns << '\n';
+            out << "search_server_phase_duration_ns_count{phase=\""s << name << "\"} "s << histogram.count << '\n';
+        }
+    } else {
+        out << "{\"counters\":{"s;
+
+        for (size_t counter = 0; counter < COUNTER_COUNT; ++counter) {
+            out << (counter > 0 ? ","s : ""s) << '"' << GetMetricsCounterName(static_cast<MetricsCounter>(counter)) << "\":"s
+                << snapshot.counters[counter];
+        }
+
+        out << "},\"phases\":{"s;
+
+        for (size_t phase = 0; phase < PHASE_COUNT; ++phase) {
+            const LatencyHistogram& histogram = snapshot.phases[phase];
+
+            out << (phase > 0 ? ","s : ""s) << '"' << GetMetricsPhaseName(static_cast<MetricsPhase>(phase)) << "\":{"s
+                << "\"count\":"s << histogram.count << ",\"sum_ns\":"s << histogram.sum_ns << ",\"max_ns\":"s << histogram.max_ns
+                << ",\"p50_ns\":"s << histogram.GetPercentile(50.0) << ",\"p90_ns\":"s << histogram.GetPercentile(90.0)
+                << ",\"p99_ns\":"s << histogram.GetPercentile(99.0) << ",\"p999_ns\":"s << histogram.GetPercentile(99.9) << '}';
+        }
+
+        out << "}}\n"s;
+    }
+
+    return out.str();
+}
+
+void DumpMetrics(const string& path, MetricsFormat format) {
+    // write to a temporary file first, so a scraper never reads a half-written dump
+    const string temporary_path = path + ".tmp"s;
+
+    {
+        ofstream out(temporary_path, ios::trunc);
+
+        if (!out) {
+            throw runtime_error("Can't open metrics file "s + temporary_path);
+        }
+
+        out << FormatMetrics(GetMetricsSnapshot(), format);
+    }
+
+    if (rename(temporary_path.c_str(), path.c_str()) != 0) {
+        throw runtime_error("Can't write metrics file "s + path);
+    }
+}
@@ -0,0 +1,100 @@
+#pragma once
+
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <string>
+
+// Low overhead counters and latency histograms of the search hot paths.
+// Every thread writes only its own slots, a snapshot merges all threads.
+// METRICS_* macros compile to nothing unless SEARCH_SERVER_METRICS is defined,
+// so their arguments must not have side effects.
+
+enum class MetricsPhase {
+    QUERY_PARSE,
+    POSTING_SCAN, // posting lists walk with predicate check and scoring
+    MINUS_WORDS,
+    TOP_K,
+    MATCH,
+    COUNT,
+};
+
+enum class MetricsCounter {
+    QUERIES,
+    POSTINGS_SCANNED,
+    MINUS_POSTINGS_SCANNED,
+    DOCUMENTS_SCORED,
+    DOCUMENTS_MATCHED,
+    QUERIES_REJECTED, // by admission control of QueryScheduler
+    QUERIES_DEGRADED, // pruned to the cost limit of the admission control
+    COUNT,
+};
+
+enum class MetricsFormat {
+    PROMETHEUS,
+    JSON,
+};
+
+// HDR-like log-linear histogram: 8 sub-buckets per power of two, about 12% precision
+struct LatencyHistogram {
+    static constexpr int SUB_BUCKET_BITS = 3;
+    static constexpr int SUB_BUCKET_COUNT = 1 << SUB_BUCKET_BITS;
+    static constexpr int BUCKET_COUNT = (64 - SUB_BUCKET_BITS + 1) * SUB_BUCKET_COUNT;
+
+    static int GetBucketIndex(uint64_t value_ns);
+    static uint64_t GetBucketUpperBound(int index);
+
+    uint64_t GetPercentile(double percentile) const;
+
+    uint64_t count = 0;
+    uint64_t sum_ns = 0;
+    uint64_t max_ns = 0;
+    std::array<uint64_t, BUCKET_COUNT> buckets{};
+};
+
+struct MetricsSnapshot {
+    std::array<LatencyHistogram, static_cast<size_t>(MetricsPhase::COUNT)> phases;
+    std::array<uint64_t, static_cast<size_t>(MetricsCounter::COUNT)> counters{};
+};
+
+void RecordPhaseDuration(MetricsPhase phase, std::chrono::nanoseconds duration);
+void AddToCounter(MetricsCounter counter, uint64_t value);
+
+MetricsSnapshot GetMetricsSnapshot();
+void ResetMetrics();
+
+const char* GetMetricsPhaseName(MetricsPhase phase);
+const char* GetMetricsCounterName(MetricsCounter counter);
+
+std::string FormatMetrics(const MetricsSnapshot& snapshot, MetricsFormat format);
+
+// Writes the current snapshot to a file, throws std::runtime_error if it can't be opened
+void DumpMetrics(const std::string& path, MetricsFormat format);
+
+class PhaseTimer {
+public:
+    using Clock = std::chrono::steady_clock;
+
+    explicit PhaseTimer(MetricsPhase phase)
+        : phase_(phase) {
+    }
+
+    ~PhaseTimer() {
+        RecordPhaseDuration(phase_, Clock::now() - start_time_);
+    }
+
+private:
+    const MetricsPhase phase_;
+    const Clock::time_point start_time_ = Clock::now();
+};
+
+#ifdef SEARCH_SERVER_METRICS
+#define METRICS_CONCAT_INTERNAL(X, Y) X##Y
+#define METRICS_CONCAT(X, Y) METRICS_CONCAT_INTERNAL(X, Y)
+#define METRICS_PHASE(phase) PhaseTimer METRICS_CONCAT(metricsPhaseTimer, __LINE__)(MetricsPhase::phase)
+#define METRICS_COUNT(counter, value) AddToCounter(MetricsCounter::counter, (value))
+#else
+#define METRICS_PHASE(phase)
+#define METRICS_COUNT(counter, value)
+#endif
@@ -2,6 +2,7 @@
 
 #include <algorithm>
 #include <iostream>
+#include <type_traits>
 #include <vector>
 
 template <typename Iterator>
@@ -74,3 +75,71 @@ template <typename Container>
 auto Paginate(const Container& c, size_t page_size) {
     return Paginator(begin(c), end(c), page_size);
 }
+
+// Requests pages one by one from page_source(page_number) while iterating,
+// the iteration stops on the first empty page
+template <typename PageSource>
+class LazyPaginator {
+public:
+    using Page = std::invoke_result_t<const PageSource&, size_t>;
+
+    class Iterator {
+    public:
+        Iterator() = default;
+
+        explicit Iterator(const PageSource* page_source)
+            : page_source_(page_source) {
+            Fetch();
+        }
+
+        const Page& operator*() const {
+            return page_;
+        }
+
+        const Page* operator->() const {
+            return &page_;
+        }
+
+        Iterator& operator++() {
+            ++page_number_;
+            Fetch();
+            return *this;
+        }
+
+        bool operator==(const Iterator& other) const {
+            return page_source_ == other.page_source_ && (page_source_ == nullptr || page_number_ == other.page_number_);
+        }
+
+        bool operator!=(const Iterator& other) const {
+            return !(*this == other);
+        }
+
+    private:
+        void Fetch() {
+            page_ = (*page_source_)(page_number_);
+
+            if (page_.empty()) {
+                page_source_ = nullptr;
+            }
+        }
+
+        const PageSource* page_source_ = nullptr;
+        size_t page_number_ = 0;
+        Page page_;
+    };
+
+    explicit LazyPaginator(PageSource page_source)
+        : page_source_(std::move(page_source)) {
+    }
+
+    Iterator begin() const {
+        return Iterator(&page_source_);
+    }
+
+    Iterator end() const {
+        return {};
+    }
+
+private:
+    PageSource page_source_;
+};
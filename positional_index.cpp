@@ -0,0 +1,136 @@
+#include "positional_index.h"
+
+#include <algorithm>
+
+using namespace std;
+
+namespace {
+
+void AppendVarint(pmr::vector<uint8_t>& bytes, uint32_t value) {
+    while (value >= 0x80) {
+        bytes.push_back(static_cast<uint8_t>(value | 0x80));
+        value >>= 7;
+    }
+
+    bytes.push_back(static_cast<uint8_t>(value));
+}
+
+} // namespace
+
+PositionalIndex::PositionalIndex(pmr::memory_resource* resource)
+    : resource_(resource)
+    , terms_(resource)
+    , empty_ordinals_(resource) {
+}
+
+void PositionalIndex::Add(uint32_t term_id, uint32_t ordinal, const vector<uint32_t>& positions) {
+    while (terms_.size() <= term_id) {
+        terms_.emplace_back(resource_);
+    }
+
+    Term& term = terms_[term_id];
+
+    pmr::vector<uint8_t> encoded(resource_);
+    uint32_t previous = 0;
+
+    for (const uint32_t position : positions) {
+        AppendVarint(encoded, position - previous);
+        previous = position;
+    }
+
+    // new documents get the largest ordinal, so this is an append in practice
+    const auto it = lower_bound(term.ordinals.begin(), term.ordinals.end(), ordinal);
+    const size_t index = it - term.ordinals.begin();
+    const uint32_t begin = index < term.position_begins.size() ? term.position_begins[index] : static_cast<uint32_t>(term.positions.size());
+
+    term.ordinals.insert(it, ordinal);
+    term.position_begins.insert(term.position_begins.begin() + index, begin);
+    term.positions.insert(term.positions.begin() + begin, encoded.begin(), encoded.end());
+
+    for (size_t i = index + 1; i < term.position_begins.size(); ++i) {
+        term.position_begins[i] += static_cast<uint32_t>(encoded.size());
+    }
+}
+
+void PositionalIndex::Remove(uint32_t term_id, uint32_t ordinal) {
+    if (term_id >= terms_.size()) {
+        return;
+    }
+
+    Term& term = terms_[term_id];
+
+    const auto it = lower_bound(term.ordinals.begin(), term.ordinals.end(), ordinal);
+
+    if (it == term.ordinals.end() || *it != ordinal) {
+        return;
+    }
+
+    const size_t index = it - term.ordinals.begin();
+    const uint32_t begin = term.position_begins[index];
+    const uint32_t end = index + 1 < term.position_begins.size() ? term.position_begins[index + 1] : static_cast<uint32_t>(term.positions.size());
+
+    term.positions.erase(term.positions.begin() + begin, term.positions.begin() + end);
+    term.position_begins.erase(term.position_begins.begin() + index);
+    term.ordinals.erase(it);
+
+    for (size_t i = index; i < term.position_begins.size(); ++i) {
+        term.position_begins[i] -= end - begin;
+    }
+}
+
+void PositionalIndex::Clear() {
+    terms_.clear();
+    terms_.shrink_to_fit();
+}
+
+const pmr::vector<uint32_t>& PositionalIndex::GetOrdinals(uint32_t term_id) const {
+    return term_id < terms_.size() ? terms_[term_id].ordinals : empty_ordinals_;
+}
+
+void PositionalIndex::GetPositions(uint32_t term_id, uint32_t ordinal, vector<uint32_t>& positions) const {
+    positions.clear();
+
+    if (term_id >= terms_.size()) {
+        return;
+    }
+
+    const Term& term = terms_[term_id];
+
+    const auto it = lower_bound(term.ordinals.begin(), term.ordinals.end(), ordinal);
+
+    if (it == term.ordinals.end() || *it != ordinal) {
+        return;
+    }
+
+    const size_t index = it - term.ordinals.begin();
+    const uint32_t begin = term.position_begins[index];
+    const uint32_t end = index + 1 < term.position_begins.size() ? term.position_begins[index + 1] : static_cast<uint32_t>(term.positions.size());
+
+    uint32_t position = 0;
+    uint32_t delta = 0;
+    int shift = 0;
+
+    for (uint32_t i = begin; i < end; ++i) {
+        delta |= static_cast<uint32_t>(term.positions[i] & 0x7f) << shift;
+        shift += 7;
+
+        if ((term.positions[i] & 0x80) == 0) {
+            position += delta;
+            positions.push_back(position);
+            delta = 0;
+            shift = 0;
+        }
+    }
+}
+
+size_t PositionalIndex::GetMemoryUsage() const {
+    size_t memory_usage = terms_.capacity() * sizeof(Term);
+
+    for (const Term& term : terms_) {
+        memory_usage += term.ordinals.capacity() * sizeof(uint32_t)
+                        + term.position_begins.capacity() * sizeof(uint32_t)
+                        + term.positions.capacity();
+    }
+
+    return memory_usage;
+}
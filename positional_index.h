@@ -0,0 +1,44 @@
+#pragma once
+
+#include <cstdint>
+#include <memory_resource>
+#include <vector>
+
+// Word positions of every document, grouped by term id. Ordinals of a term are kept in
+// a separate array from the positions, so document level intersections never touch
+// positions. Positions of a document are delta encoded varints and decoded on demand.
+class PositionalIndex {
+public:
+    explicit PositionalIndex(std::pmr::memory_resource* resource);
+
+    // positions must be ascending
+    void Add(uint32_t term_id, uint32_t ordinal, const std::vector<uint32_t>& positions);
+    void Remove(uint32_t term_id, uint32_t ordinal);
+
+    void Clear();
+
+    // Ascending ordinals of documents containing the term
+    const std::pmr::vector<uint32_t>& GetOrdinals(uint32_t term_id) const;
+
+    // Replaces positions with positions of the term in the document, empty if it has none
+    void GetPositions(uint32_t term_id, uint32_t ordinal, std::vector<uint32_t>& positions) const;
+
+    size_t GetMemoryUsage() const;
+
+private:
+    struct Term {
+        explicit Term(std::pmr::memory_resource* resource)
+            : ordinals(resource)
+            , position_begins(resource)
+            , positions(resource) {
+        }
+
+        std::pmr::vector<uint32_t> ordinals;
+        std::pmr::vector<uint32_t> position_begins; // offset of every document in positions
+        std::pmr::vector<uint8_t> positions;
+    };
+
+    std::pmr::memory_resource* resource_;
+    std::pmr::vector<Term> terms_;
+    std::pmr::vector<uint32_t> empty_ordinals_;
+};
@@ -0,0 +1,29 @@
+#include "query_profile.h"
+
+using namespace std;
+
+ostream& operator<<(ostream& out, const QueryProfile& profile) {
+    out << "{ "s
+        << "path = "s << (profile.is_parallel ? "par"s : "seq"s) << ", "s
+        << "terms = ["s;
+
+    bool is_first = true;
+    for (const TermProfile& term : profile.terms) {
+        out << (is_first ? " "s : ", "s) << (term.is_minus ? "-"s : ""s) << term.word
+            << " (postings = "s << term.postings_count << ", idf = "s << term.inverse_document_freq << ")"s;
+        is_first = false;
+    }
+
+    out << " ], "s
+        << "postings scanned = "s << profile.postings_scanned << ", "s
+        << "filtered = "s << profile.documents_filtered << ", "s
+        << "scored = "s << profile.documents_scored << ", "s
+        << "excluded = "s << profile.documents_excluded << ", "s
+        << "returned = "s << profile.documents_returned << ", "s
+        << "parse = "s << profile.parse_time.count() << " ns, "s
+        << "scan = "s << profile.scan_time.count() << " ns, "s
+        << "minus words = "s << profile.minus_words_time.count() << " ns, "s
+        << "top k = "s << profile.top_k_time.count() << " ns }"s;
+
+    return out;
+}
@@ -0,0 +1,34 @@
+#pragma once
+
+#include <chrono>
+#include <iostream>
+#include <string_view>
+#include <vector>
+
+struct TermProfile {
+    std::string_view word;
+    bool is_minus = false;
+    size_t postings_count = 0; // 0 if the word is not in the index
+    double inverse_document_freq = 0.0;
+};
+
+// Execution details of a single FindTopDocumentsExplained call
+struct QueryProfile {
+    std::vector<TermProfile> terms;
+
+    bool is_parallel = false;
+
+    size_t postings_scanned = 0;
+    // counted in documents whatever the scoring mode, each document once
+    size_t documents_filtered = 0;  // matched documents rejected by the predicate (status, rating, ...)
+    size_t documents_scored = 0;    // matched documents accepted by the predicate, excluded ones included
+    size_t documents_excluded = 0;  // scored documents removed by minus words
+    size_t documents_returned = 0;
+
+    std::chrono::nanoseconds parse_time{ 0 };
+    std::chrono::nanoseconds scan_time{ 0 };
+    std::chrono::nanoseconds minus_words_time{ 0 };
+    std::chrono::nanoseconds top_k_time{ 0 };
+};
+
+std::ostream& operator<<(std::ostream& out, const QueryProfile& profile);
@@ -0,0 +1,252 @@
+#include "query_protocol.h"
+
+#include <charconv>
+#include <optional>
+
+using namespace std;
+
+namespace {
+
+// Cuts the text up to the first space off the line
+string_view TakeToken(string_view& line) {
+    const size_t space = line.find(' ');
+    const string_view token = line.substr(0, space);
+
+    line.remove_prefix(space == line.npos ? line.size() : space + 1);
+
+    return token;
+}
+
+int ParseInt(string_view text) {
+    int value = 0;
+    const auto result = from_chars(text.data(), text.data() + text.size(), value);
+
+    if (text.empty() || result.ec != errc() || result.ptr != text.data() + text.size()) {
+        throw invalid_argument("Invalid number "s + string(text));
+    }
+
+    return value;
+}
+
+constexpr string_view STATUS_NAMES[] = { "ACTUAL"sv, "IRRELEVANT"sv, "BANNED"sv, "REMOVED"sv };
+
+DocumentStatus ParseStatus(string_view text) {
+    for (size_t i = 0; i < size(STATUS_NAMES); ++i) {
+        if (STATUS_NAMES[i] == text) {
+            return static_cast<DocumentStatus>(i);
+        }
+    }
+
+    throw invalid_argument("Invalid status "s + string(text));
+}
+
+void AppendNumber(string& out, double value) {
+    char buffer[32];
+    const auto result = to_chars(begin(buffer), end(buffer), value);
+
+    out.append(buffer, result.ptr);
+}
+
+} // namespace
+
+QueryProtocol::QueryProtocol(SearchServer& search_server, WriteAheadLog* log)
+    : search_server_(search_server)
+    , log_(log) {
+}
+
+string QueryProtocol::Execute(string_view request) {
+    try {
+        string_view arguments = request;
+        const string_view command = TakeToken(arguments);
+
+        if (command == "FIND"sv) {
+            return ExecuteFind(arguments, DocumentStatus::ACTUAL);
+        }
+
+        if (command == "FIND_STATUS"sv) {
+            const DocumentStatus status = ParseStatus(TakeToken(arguments));
+            return ExecuteFind(arguments, status);
+        }
+
+        if (command == "MATCH"sv) {
+            return ExecuteMatch(arguments);
+        }
+
+        if (command == "ADD"sv) {
+            return ExecuteAdd(arguments);
+        }
+
+        if (command == "REMOVE"sv) {
+            return ExecuteRemove(arguments);
+        }
+
+        if (command == "COUNT"sv) {
+            shared_lock lock(mutex_);
+            return "OK "s + to_string(search_server_.GetDocumentCount());
+        }
+
+        if (command == "CHECKPOINT"sv) {
+            return ExecuteCheckpoint();
+        }
+
+        return "ERROR Unknown command "s + string(command);
+    } catch (const exception& e) {
+        return "ERROR "s + e.what();
+    }
+}
+
+string QueryProtocol::ExecuteFind(string_view query, DocumentStatus status) const {
+    vector<Document> documents;
+    {
+        shared_lock lock(mutex_);
+        documents = search_server_.FindTopDocuments(query, status);
+    }
+
+    string response = "OK"s;
+
+    for (const Document& document : documents) {
+        response += ' ';
+        response += to_string(document.id);
+        response += ':';
+        AppendNumber(response, document.relevance);
+        response += ':';
+        response += to_string(document.rating);
+    }
+
+    return response;
+}
+
+string QueryProtocol::ExecuteMatch(string_view arguments) const {
+    const int document_id = ParseInt(TakeToken(arguments));
+
+    shared_lock lock(mutex_);
+
+    // the words point into the server, so the response is built under the lock
+    const auto [words, status] = search_server_.MatchDocument(arguments, document_id);
+
+    string response = "OK "s;
+    response += STATUS_NAMES[static_cast<size_t>(status)];
+
+    for (string_view word : words) {
+        response += ' ';
+        response += word;
+    }
+
+    return response;
+}
+
+string QueryProtocol::ExecuteAdd(string_view arguments) {
+    const int document_id = ParseInt(TakeToken(arguments));
+    const DocumentStatus status = ParseStatus(TakeToken(arguments));
+
+    vector<int> ratings;
+    string_view ratings_text = TakeToken(arguments);
+
+    if (ratings_text != "-"sv) {
+        while (!ratings_text.empty()) {
+            const size_t comma = ratings_text.find(',');
+            ratings.push_back(ParseInt(ratings_text.substr(0, comma)));
+            ratings_text.remove_prefix(comma == ratings_text.npos ? ratings_text.size() : comma + 1);
+        }
+    }
+
+    uint64_t sequence = 0;
+    uint64_t checkpoint_count = 0;
+    // the document REPLACE removes, to put back if the log fails
+    optional<pair<int, DocumentData>> replaced_document;
+    {
+        unique_lock lock(mutex_);
+        ThrowIfLogFailed();
+
+        if (log_ && search_server_.GetDuplicatePolicy() == DuplicatePolicy::REPLACE) {
+            const int original_id = search_server_.FindOriginalDocument(arguments);
+
+            if (original_id >= 0) {
+                replaced_document.emplace(original_id, search_server_.GetDocumentById(original_id));
+            }
+        }
+
+        search_server_.AddDocument(document_id, arguments, status, ratings);
+
+        if (log_) {
+            sequence = log_->AppendAddDocument(document_id, arguments, status, ratings);
+            checkpoint_count = checkpoint_count_;
+        }
+    }
+
+    CommitToLog(sequence, checkpoint_count, [&] {
+        search_server_.RemoveDocument(document_id);
+
+        if (replaced_document) {
+            const auto& [original_id, original] = *replaced_document;
+            search_server_.AddDocument(original_id, original.text, original.status, { original.rating });
+        }
+    });
+
+    return "OK"s;
+}
+
+string QueryProtocol::ExecuteRemove(string_view arguments) {
+    const int document_id = ParseInt(arguments);
+
+    uint64_t sequence = 0;
+    uint64_t checkpoint_count = 0;
+    // the document to put back if the log fails
+    optional<DocumentData> document;
+    {
+        unique_lock lock(mutex_);
+        ThrowIfLogFailed();
+
+        if (log_) {
+            try {
+                document = search_server_.GetDocumentById(document_id);
+            } catch (const out_of_range&) {
+            }
+        }
+
+        search_server_.RemoveDocument(document_id);
+
+        if (log_) {
+            sequence = log_->AppendRemoveDocument(document_id);
+            checkpoint_count = checkpoint_count_;
+        }
+    }
+
+    CommitToLog(sequence, checkpoint_count, [&] {
+        if (document) {
+            search_server_.AddDocument(document_id, document->text, document->status, { document->rating });
+        }
+    });
+
+    return "OK"s;
+}
+
+string QueryProtocol::ExecuteCheckpoint() {
+    if (!log_) {
+        throw logic_error("No write-ahead log"s);
+    }
+
+    unique_lock lock(mutex_);
+    log_->Checkpoint(search_server_);
+    ++checkpoint_count_;
+
+    return "OK"s;
+}
+
+void QueryProtocol::ThrowIfLogFailed() const {
+    if (log_ && log_->IsFailed()) {
+        throw runtime_error("Write-ahead log has failed, CHECKPOINT restores it"s);
+    }
+}
+
+void QueryProtocol::CheckpointIfDue() {
+    if (log_->IsCheckpointDue()) {
+        unique_lock lock(mutex_);
+
+        // another writer may have done it meanwhile
+        if (log_->IsCheckpointDue()) {
+            log_->Checkpoint(search_server_);
+            ++checkpoint_count_;
+        }
+    }
+}
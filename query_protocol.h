@@ -0,0 +1,72 @@
+#pragma once
+
+#include "search_server.h"
+#include "write_ahead_log.h"
+
+#include <shared_mutex>
+#include <string>
+#include <string_view>
+
+// Line protocol of the search daemon. Every request is a line, every response is a line
+// starting with OK or ERROR:
+//
+//   FIND <query>                               OK <id>:<relevance>:<rating> ...
+//   FIND_STATUS <status> <query>               the same for documents with the status
+//   MATCH <id> <query>                         OK <status> <word> ...
+//   ADD <id> <status> <rating,...|-> <text>    OK
+//   REMOVE <id>                                OK
+//   COUNT                                      OK <document count>
+//   CHECKPOINT                                 OK
+//
+// Status is ACTUAL, IRRELEVANT, BANNED or REMOVED. Searches run concurrently, ADD and
+// REMOVE wait for them and run alone. With a write-ahead log ADD and REMOVE answer OK once
+// they are committed to it, and the log is checkpointed when it grows too big. A mutation
+// which fails to get committed is rolled back, a document replaced by ADD is put back
+class QueryProtocol {
+public:
+    explicit QueryProtocol(SearchServer& search_server, WriteAheadLog* log = nullptr);
+
+    // The request is a line without the line break, so is the response
+    std::string Execute(std::string_view request);
+
+private:
+    std::string ExecuteFind(std::string_view query, DocumentStatus status) const;
+    std::string ExecuteMatch(std::string_view arguments) const;
+    std::string ExecuteAdd(std::string_view arguments);
+    std::string ExecuteRemove(std::string_view arguments);
+    std::string ExecuteCheckpoint();
+
+    // ADD and REMOVE fail while the log is failed, so nothing is applied which can't be logged
+    void ThrowIfLogFailed() const;
+
+    // Waits for the record out of the lock, so concurrent writers share the sync. If the log
+    // fails, calls rollback under the lock and rethrows, unless a checkpoint took the lock
+    // after the mutation was applied: the snapshot has the mutation, so it is durable.
+    // checkpoint_count is checkpoint_count_ read when the mutation was applied
+    template <typename Rollback>
+    void CommitToLog(uint64_t sequence, uint64_t checkpoint_count, Rollback rollback) {
+        if (!log_) {
+            return;
+        }
+
+        try {
+            log_->Commit(sequence);
+        } catch (...) {
+            std::unique_lock lock(mutex_);
+
+            if (checkpoint_count_ == checkpoint_count) {
+                rollback();
+                throw;
+            }
+        }
+
+        CheckpointIfDue();
+    }
+
+    void CheckpointIfDue();
+
+    SearchServer& search_server_;
+    WriteAheadLog* log_;
+    mutable std::shared_mutex mutex_;
+    uint64_t checkpoint_count_ = 0; // of the successful ones, guarded by mutex_
+};
@@ -0,0 +1,120 @@
+#include "query_scheduler.h"
+
+using namespace std;
+
+QueryScheduler::QueryScheduler(const SearchServer& search_server, size_t thread_count, AdmissionOptions options)
+    : search_server_(search_server)
+    , options_(options) {
+    if (thread_count == 0) {
+        throw invalid_argument("Thread count must be positive"s);
+    }
+
+    if (options_.expensive_query_policy == AdmissionPolicy::LOW_PRIORITY && options_.low_priority_thread_count == 0) {
+        throw invalid_argument("Low priority thread count must be positive"s);
+    }
+
+    if (options_.max_pending_queries == 0) {
+        throw invalid_argument("Pending query limit must be positive"s);
+    }
+
+    Start(pool_, thread_count);
+
+    if (options_.expensive_query_policy == AdmissionPolicy::LOW_PRIORITY) {
+        Start(low_priority_pool_, options_.low_priority_thread_count);
+    }
+}
+
+QueryScheduler::~QueryScheduler() {
+    Stop(pool_);
+    Stop(low_priority_pool_);
+}
+
+future<vector<Document>> QueryScheduler::FindTopDocuments(string raw_query, DocumentStatus status, CancellationToken cancellation) {
+    return FindTopDocuments(move(raw_query), DocumentStatusPredicate{ status }, move(cancellation));
+}
+
+future<vector<Document>> QueryScheduler::FindTopDocuments(string raw_query, CancellationToken cancellation) {
+    return FindTopDocuments(move(raw_query), DocumentStatus::ACTUAL, move(cancellation));
+}
+
+size_t QueryScheduler::GetThreadCount() const {
+    return pool_.threads.size();
+}
+
+size_t QueryScheduler::GetPendingQueryCount() const {
+    return pending_query_count_.load(memory_order_relaxed);
+}
+
+const AdmissionOptions& QueryScheduler::GetAdmissionOptions() const {
+    return options_;
+}
+
+future<vector<Document>> QueryScheduler::MakeFailedFuture(exception_ptr error) {
+    promise<vector<Document>> result;
+    result.set_exception(move(error));
+
+    return result.get_future();
+}
+
+bool QueryScheduler::TryAdmitQuery() {
+    size_t pending_query_count = pending_query_count_.load(memory_order_relaxed);
+
+    do {
+        if (pending_query_count >= options_.max_pending_queries) {
+            return false;
+        }
+    } while (!pending_query_count_.compare_exchange_weak(pending_query_count, pending_query_count + 1, memory_order_relaxed));
+
+    return true;
+}
+
+void QueryScheduler::Start(Pool& pool, size_t thread_count) {
+    pool.threads.reserve(thread_count);
+
+    for (size_t i = 0; i < thread_count; ++i) {
+        pool.threads.emplace_back([&pool] { RunWorker(pool); });
+    }
+}
+
+void QueryScheduler::Stop(Pool& pool) {
+    {
+        lock_guard lock(pool.mutex);
+        pool.is_stopping = true;
+    }
+
+    pool.has_tasks.notify_all();
+
+    for (auto& thread : pool.threads) {
+        thread.join();
+    }
+}
+
+void QueryScheduler::Schedule(Pool& pool, function<void()> task) {
+    {
+        lock_guard lock(pool.mutex);
+        pool.tasks.push_back(move(task));
+    }
+
+    pool.has_tasks.notify_one();
+}
+
+void QueryScheduler::RunWorker(Pool& pool) {
+    while (true) {
+        function<void()> task;
+
+        {
+            unique_lock lock(pool.mutex);
+            pool.has_tasks.wait(lock, [&pool] { return pool.is_stopping || !pool.tasks.empty(); });
+
+            if (pool.tasks.empty()) {
+                return;
+            }
+
+            task = move(pool.tasks.front());
+            pool.tasks.pop_front();
+        }
+
+        // exceptions of the search are stored in its future
+        task();
+    }
+}
@@ -0,0 +1,142 @@
+#pragma once
+
+#include "cancellation_token.h"
+#include "search_server.h"
+
+#include <atomic>
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <future>
+#include <limits>
+#include <memory>
+#include <mutex>
+#include <stdexcept>
+#include <string>
+#include <thread>
+#include <vector>
+
+// Fails a query refused by the admission control of QueryScheduler
+class QueryRejectedError : public std::runtime_error {
+public:
+    using std::runtime_error::runtime_error;
+};
+
+// What QueryScheduler does with a query costing more than AdmissionOptions::max_query_cost
+enum class AdmissionPolicy {
+    REJECT,       // fail it with QueryRejectedError
+    DEGRADE,      // run it pruned to the cost limit, see SearchServer::FindTopDocumentsPruned
+    LOW_PRIORITY, // run it in full on the low priority threads
+};
+
+struct AdmissionOptions {
+    // in postings, as estimated by SearchServer::EstimateQueryCost
+    size_t max_query_cost = std::numeric_limits<size_t>::max();
+    AdmissionPolicy expensive_query_policy = AdmissionPolicy::REJECT;
+    size_t low_priority_thread_count = 1; // started with LOW_PRIORITY only
+    // queued and running queries, the ones above the limit are rejected
+    size_t max_pending_queries = std::numeric_limits<size_t>::max();
+};
+
+// Runs searches on its own threads and hands back futures. A search waiting in the queue or
+// running past its deadline fails with QueryCancelledError, the rest of the queue goes on.
+// Admission control estimates the cost of a query before queueing it, so a few expensive
+// queries don't hold up the cheap ones. The destructor finishes the queued searches;
+// cancel their tokens to drop them faster
+class QueryScheduler {
+public:
+    QueryScheduler(const SearchServer& search_server, size_t thread_count, AdmissionOptions options = {});
+    ~QueryScheduler();
+
+    QueryScheduler(const QueryScheduler&) = delete;
+    QueryScheduler& operator=(const QueryScheduler&) = delete;
+
+    // Errors of the query, including its rejection, are reported through the future
+    template <typename DocumentPredicate>
+    std::future<std::vector<Document>> FindTopDocuments(std::string raw_query, DocumentPredicate document_predicate,
+                                                        CancellationToken cancellation = {}) {
+        // parsed once on the caller's thread, the task owns the parsed query with its text
+        SearchServer::ParsedQuery query;
+        size_t query_cost = 0;
+
+        try {
+            query = search_server_.PrepareQuery(std::move(raw_query));
+            query_cost = search_server_.EstimateQueryCost(query);
+        } catch (...) {
+            return MakeFailedFuture(std::current_exception());
+        }
+
+        const bool is_expensive = query_cost > options_.max_query_cost;
+
+        if (is_expensive && options_.expensive_query_policy == AdmissionPolicy::REJECT) {
+            METRICS_COUNT(QUERIES_REJECTED, 1);
+            return MakeFailedFuture(std::make_exception_ptr(QueryRejectedError("Query is too expensive"s)));
+        }
+
+        if (!TryAdmitQuery()) {
+            METRICS_COUNT(QUERIES_REJECTED, 1);
+            return MakeFailedFuture(std::make_exception_ptr(QueryRejectedError("Too many pending queries"s)));
+        }
+
+        const bool is_degraded = is_expensive && options_.expensive_query_policy == AdmissionPolicy::DEGRADE;
+
+        METRICS_COUNT(QUERIES_DEGRADED, is_degraded ? 1 : 0);
+
+        const size_t max_query_cost = is_degraded ? options_.max_query_cost : std::numeric_limits<size_t>::max();
+
+        auto task = std::make_shared<std::packaged_task<std::vector<Document>()>>(
+            [this, query = std::move(query), document_predicate, cancellation, max_query_cost] {
+                const PendingQueryGuard guard{ pending_query_count_ };
+                return search_server_.FindTopDocumentsPruned(cancellation, query, max_query_cost, document_predicate);
+            });
+
+        auto future = task->get_future();
+        Schedule(is_expensive && options_.expensive_query_policy == AdmissionPolicy::LOW_PRIORITY ? low_priority_pool_ : pool_,
+                 [task] { (*task)(); });
+
+        return future;
+    }
+
+    std::future<std::vector<Document>> FindTopDocuments(std::string raw_query, DocumentStatus status,
+                                                        CancellationToken cancellation = {});
+    std::future<std::vector<Document>> FindTopDocuments(std::string raw_query, CancellationToken cancellation = {});
+
+    size_t GetThreadCount() const;
+    size_t GetPendingQueryCount() const;
+    const AdmissionOptions& GetAdmissionOptions() const;
+
+private:
+    struct Pool {
+        std::mutex mutex;
+        std::condition_variable has_tasks;
+        std::deque<std::function<void()>> tasks;
+        bool is_stopping = false;
+        std::vector<std::thread> threads;
+    };
+
+    // Releases the place of a query once its search returns, before its future is ready
+    struct PendingQueryGuard {
+        std::atomic<size_t>& pending_query_count;
+
+        ~PendingQueryGuard() {
+            pending_query_count.fetch_sub(1, std::memory_order_relaxed);
+        }
+    };
+
+    static std::future<std::vector<Document>> MakeFailedFuture(std::exception_ptr error);
+
+    bool TryAdmitQuery();
+
+    static void Start(Pool& pool, size_t thread_count);
+    static void Stop(Pool& pool);
+    static void Schedule(Pool& pool, std::function<void()> task);
+    static void RunWorker(Pool& pool);
+
+    const SearchServer& search_server_;
+    const AdmissionOptions options_;
+
+    std::atomic<size_t> pending_query_count_ = 0;
+
+    Pool pool_;
+    Pool low_priority_pool_;
+};
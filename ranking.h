@@ -0,0 +1,56 @@
+#pragma once
+
+#include <cmath>
+#include <cstddef>
+
+// Statistics of the whole server a ranking function may need for term weights
+struct CollectionStatistics {
+    size_t document_count = 0;
+    double average_document_length = 0.0;
+};
+
+// Ranking functions are policy classes passed to FindTopDocuments as a template parameter,
+// so every function gets its own inlined scoring loop. A policy provides
+//
+//   double ComputeTermWeight(const CollectionStatistics& statistics, size_t term_document_count) const;
+//
+//   template <typename Value>
+//   Value ComputeScore(Value term_weight, Value term_freq, Value document_length, Value average_document_length) const;
+//
+// ComputeTermWeight is called once per query word, ComputeScore once per posting with
+// Value being double or float depending on the scoring mode. term_freq is the share of
+// the word among the document words, document_length is the number of non-stop words
+
+// The classic score: term_freq * log(N / n)
+struct TfIdfRanking {
+    double ComputeTermWeight(const CollectionStatistics& statistics, size_t term_document_count) const {
+        return std::log(double(statistics.document_count) / term_document_count);
+    }
+
+    template <typename Value>
+    Value ComputeScore(Value term_weight, Value term_freq, Value, Value) const {
+        return term_freq * term_weight;
+    }
+};
+
+// Okapi BM25 with document length normalization
+struct Bm25Ranking {
+    double k1 = 1.2;
+    double b = 0.75;
+
+    double ComputeTermWeight(const CollectionStatistics& statistics, size_t term_document_count) const {
+        const double n = double(term_document_count);
+        return std::log(1.0 + (double(statistics.document_count) - n + 0.5) / (n + 0.5));
+    }
+
+    template <typename Value>
+    Value ComputeScore(Value term_weight, Value term_freq, Value document_length, Value average_document_length) const {
+        const Value k1_value = static_cast<Value>(k1);
+        const Value b_value = static_cast<Value>(b);
+
+        const Value term_count = term_freq * document_length;
+        const Value length_norm = k1_value * (Value(1) - b_value + b_value * document_length / average_document_length);
+
+        return term_weight * term_count * (k1_value + Value(1)) / (term_count + length_norm);
+    }
+};
@@ -1,28 +1,163 @@
 #include "remove_duplicates.h"
 
+#include <array>
+#include <cstdint>
+#include <limits>
+#include <unordered_map>
+
 using namespace std;
 
-void RemoveDuplicates(SearchServer& search_server) {
-    vector<int> dublicated_ids;
-    set<vector<string_view>> set_document_words;
+namespace {
+
+constexpr size_t MINHASH_BAND_COUNT = 16;
+constexpr size_t MINHASH_BAND_ROWS = 4;
+constexpr size_t MINHASH_SIZE = MINHASH_BAND_COUNT * MINHASH_BAND_ROWS;
 
-    vector<string_view> document_words;
-    for (const auto& document_id : search_server) {
-        document_words.clear();
+using MinHashSignature = array<uint64_t, MINHASH_SIZE>;
 
-        for (const auto& [word, _] : search_server.GetWordFrequencies(document_id)) {
-            document_words.push_back(word);
+MinHashSignature ComputeMinHashSignature(const SearchServer::WordFrequencies& word_freqs) {
+    MinHashSignature signature;
+    signature.fill(numeric_limits<uint64_t>::max());
+
+    for (const auto& [word, _] : word_freqs) {
+        const uint64_t word_hash = HashWord(word);
+
+        for (size_t i = 0; i < MINHASH_SIZE; ++i) {
+            signature[i] = min(signature[i], MixHash(word_hash + i));
         }
+    }
 
-        if (set_document_words.find(document_words) == set_document_words.end()) {
-            set_document_words.emplace(document_words);
+    return signature;
+}
+
+uint64_t ComputeBandKey(const MinHashSignature& signature, size_t band) {
+    uint64_t key = MixHash(band);
+
+    for (size_t row = 0; row < MINHASH_BAND_ROWS; ++row) {
+        key = MixHash(key ^ signature[band * MINHASH_BAND_ROWS + row]);
+    }
+
+    return key;
+}
+
+bool HasSameWords(const SearchServer::WordFrequencies& lhs, const SearchServer::WordFrequencies& rhs) {
+    return equal(lhs.begin(), lhs.end(), rhs.begin(), rhs.end(),
+                 [](const auto& l, const auto& r) { return l.first == r.first; });
+}
+
+double ComputeJaccardIndex(const SearchServer::WordFrequencies& lhs, const SearchServer::WordFrequencies& rhs) {
+    if (lhs.empty() && rhs.empty()) {
+        return 1.0;
+    }
+
+    size_t common_count = 0;
+
+    for (auto lhs_it = lhs.begin(), rhs_it = rhs.begin(); lhs_it != lhs.end() && rhs_it != rhs.end();) {
+        if (lhs_it->first < rhs_it->first) {
+            ++lhs_it;
+        } else if (rhs_it->first < lhs_it->first) {
+            ++rhs_it;
         } else {
-            dublicated_ids.push_back(document_id);
+            ++common_count;
+            ++lhs_it;
+            ++rhs_it;
         }
     }
 
+    return static_cast<double>(common_count) / (lhs.size() + rhs.size() - common_count);
+}
+
+void RemoveDocumentsFound(SearchServer& search_server, const vector<int>& dublicated_ids) {
     for (const auto& document_id : dublicated_ids) {
         cout << "Found duplicate document id " << document_id << endl;
-        search_server.RemoveDocument(document_id);
     }
+
+    search_server.RemoveDocuments(dublicated_ids);
+}
+
+} // namespace
+
+void RemoveDuplicates(SearchServer& search_server) {
+    const vector<int> document_ids(search_server.begin(), search_server.end());
+
+    vector<uint64_t> fingerprints(document_ids.size());
+
+    transform(execution::par, document_ids.begin(), document_ids.end(), fingerprints.begin(),
+              [&search_server](int document_id) {
+                  return ComputeWordSetFingerprint(search_server.GetWordFrequencies(document_id));
+              });
+
+    vector<int> dublicated_ids;
+    unordered_map<uint64_t, vector<int>> fingerprint_to_ids;
+
+    for (size_t i = 0; i < document_ids.size(); ++i) {
+        auto& same_fingerprint_ids = fingerprint_to_ids[fingerprints[i]];
+        const auto& word_freqs = search_server.GetWordFrequencies(document_ids[i]);
+
+        // equal fingerprints are compared word by word to survive hash collisions
+        const bool is_duplicate = any_of(same_fingerprint_ids.begin(), same_fingerprint_ids.end(),
+                                         [&search_server, &word_freqs](int kept_id) {
+                                             return HasSameWords(search_server.GetWordFrequencies(kept_id), word_freqs);
+                                         });
+
+        if (is_duplicate) {
+            dublicated_ids.push_back(document_ids[i]);
+        } else {
+            same_fingerprint_ids.push_back(document_ids[i]);
+        }
+    }
+
+    RemoveDocumentsFound(search_server, dublicated_ids);
+}
+
+void RemoveNearDuplicates(SearchServer& search_server, double similarity_threshold) {
+    if (similarity_threshold <= 0.0 || similarity_threshold > 1.0) {
+        throw invalid_argument("Similarity threshold must be in (0, 1]"s);
+    }
+
+    const vector<int> document_ids(search_server.begin(), search_server.end());
+
+    vector<MinHashSignature> signatures(document_ids.size());
+
+    transform(execution::par, document_ids.begin(), document_ids.end(), signatures.begin(),
+              [&search_server](int document_id) {
+                  return ComputeMinHashSignature(search_server.GetWordFrequencies(document_id));
+              });
+
+    vector<int> dublicated_ids;
+    array<unordered_map<uint64_t, vector<int>>, MINHASH_BAND_COUNT> band_buckets;
+    array<uint64_t, MINHASH_BAND_COUNT> band_keys;
+
+    for (size_t i = 0; i < document_ids.size(); ++i) {
+        const auto& word_freqs = search_server.GetWordFrequencies(document_ids[i]);
+
+        bool is_duplicate = false;
+
+        for (size_t band = 0; band < MINHASH_BAND_COUNT && !is_duplicate; ++band) {
+            band_keys[band] = ComputeBandKey(signatures[i], band);
+
+            const auto it_bucket = band_buckets[band].find(band_keys[band]);
+
+            if (it_bucket == band_buckets[band].end()) {
+                continue;
+            }
+
+            // LSH only proposes candidates, the similarity is checked on the real word sets
+            is_duplicate = any_of(it_bucket->second.begin(), it_bucket->second.end(),
+                                  [&](int kept_id) {
+                                      return ComputeJaccardIndex(search_server.GetWordFrequencies(kept_id), word_freqs) >= similarity_threshold;
+                                  });
+        }
+
+        if (is_duplicate) {
+            dublicated_ids.push_back(document_ids[i]);
+            continue;
+        }
+
+        for (size_t band = 0; band < MINHASH_BAND_COUNT; ++band) {
+            band_buckets[band][band_keys[band]].push_back(document_ids[i]);
+        }
+    }
+
+    RemoveDocumentsFound(search_server, dublicated_ids);
 }
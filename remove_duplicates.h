@@ -2,4 +2,10 @@
 
 #include "search_server.h"
 
+// Removes documents with exactly the same set of words as one of the previous documents
 void RemoveDuplicates(SearchServer& search_server);
+
+// Removes documents whose word sets are similar (Jaccard index >= similarity_threshold)
+// to one of the previous documents. Candidates are found with MinHash signatures split
+// into LSH bands, so only documents sharing a band are compared with each other
+void RemoveNearDuplicates(SearchServer& search_server, double similarity_threshold);
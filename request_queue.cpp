@@ -17,5 +17,9 @@ vector<Document> RequestQueue::AddFindRequest(string_view raw_query) {
 }
 
 int RequestQueue::GetNoResultRequests() const {
-    return empty_results_requests_;
+    return empty_results_requests_.load(memory_order_relaxed);
+}
+
+RequestStatisticsSnapshot RequestQueue::GetStatistics() const {
+    return statistics_.GetSnapshot();
 }
@@ -1,37 +1,31 @@
 #pragma once
 
+#include "request_statistics.h"
 #include "search_server.h"
 
-#include <deque>
+#include <array>
+#include <atomic>
 #include <string>
 #include <vector>
 
+// Counts empty results among the last sec_in_day_ requests. Every request only
+// flips one slot of a fixed ring, so the queue may be shared between threads
 class RequestQueue {
 public:
     explicit RequestQueue(const SearchServer& search_server);
 
     template <typename DocumentPredicate>
     std::vector<Document> AddFindRequest(std::string_view raw_query, DocumentPredicate document_predicate) {
-        auto results = search_server_.FindTopDocuments(raw_query, document_predicate);
-
-        ++current_time_;
+        const auto start = RequestStatistics::Clock::now();
 
-        if (current_time_ > sec_in_day_) {
-            // To avoid current_time_ var overflow if numeric_limits<int>::max() reaches
-            current_time_ = sec_in_day_;
-
-            if (requests_.front().documents.empty()) {
-                --empty_results_requests_;
-            }
+        auto results = search_server_.FindTopDocuments(raw_query, document_predicate);
 
-            requests_.pop_front();
-        }
+        statistics_.Record(start, RequestStatistics::Clock::now(), results.size());
 
-        requests_.push_back({ raw_query, results });
+        const uint64_t request_number = request_count_.fetch_add(1, std::memory_order_relaxed);
+        const bool was_empty = empty_results_[request_number % sec_in_day_].exchange(results.empty(), std::memory_order_relaxed);
 
-        if (results.empty()) {
-            ++empty_results_requests_;
-        }
+        empty_results_requests_.fetch_add(static_cast<int>(results.empty()) - static_cast<int>(was_empty), std::memory_order_relaxed);
 
         return results;
     }
@@ -42,16 +36,17 @@ public:
 
     int GetNoResultRequests() const;
 
+    // Wall-clock statistics of the requests made during the last minute
+    RequestStatisticsSnapshot GetStatistics() const;
+
 private:
     const SearchServer& search_server_;
 
-    struct QueryResult {
-        std::string_view request_string;
-        std::vector<Document> documents;
-    };
-
-    std::deque<QueryResult> requests_;
     constexpr static int sec_in_day_ = 1440;
-    int current_time_ = 0;
-    int empty_results_requests_ = 0;
+
+    std::array<std::atomic<bool>, sec_in_day_> empty_results_{};
+    std::atomic<uint64_t> request_count_ = 0;
+    std::atomic<int> empty_results_requests_ = 0;
+
+    RequestStatistics statistics_;
 };
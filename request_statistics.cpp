@@ -0,0 +1,96 @@
+#include "request_statistics.h"
+
+#include <stdexcept>
+#include <string>
+#include <thread>
+
+using namespace std;
+
+double RequestStatisticsSnapshot::GetEmptyResultRate() const {
+    return request_count == 0 ? 0.0 : static_cast<double>(empty_result_count) / request_count;
+}
+
+chrono::nanoseconds RequestStatisticsSnapshot::GetAverageLatency() const {
+    return request_count == 0 ? chrono::nanoseconds(0) : total_latency / static_cast<int64_t>(request_count);
+}
+
+RequestStatistics::RequestStatistics(chrono::seconds window)
+    : buckets_(window.count() > 0 ? window.count() : 0) {
+    if (buckets_.empty()) {
+        throw invalid_argument("Statistics window must be at least one second"s);
+    }
+}
+
+int64_t RequestStatistics::ToSeconds(Clock::time_point time_point) {
+    return chrono::duration_cast<chrono::seconds>(time_point.time_since_epoch()).count();
+}
+
+void RequestStatistics::Record(Clock::time_point start, Clock::time_point finish, size_t document_count) {
+    const int64_t second = ToSeconds(finish);
+    const uint64_t latency_ns = chrono::duration_cast<chrono::nanoseconds>(finish - start).count();
+
+    Bucket& bucket = buckets_[second % buckets_.size()];
+
+    int64_t bucket_second = bucket.second.load(memory_order_acquire);
+
+    // the release store of the second publishes the reset, so it happens before every add of the second
+    while (bucket_second != second) {
+        if (bucket_second > second) {
+            // the bucket is a window ahead, the request is out of the window anyway
+            return;
+        }
+
+        if (bucket_second == RESETTING_SECOND) {
+            this_thread::yield();
+            bucket_second = bucket.second.load(memory_order_acquire);
+            continue;
+        }
+
+        if (bucket.second.compare_exchange_weak(bucket_second, RESETTING_SECOND, memory_order_acquire)) {
+            bucket.request_count.store(0, memory_order_relaxed);
+            bucket.empty_result_count.store(0, memory_order_relaxed);
+            bucket.document_count.store(0, memory_order_relaxed);
+            bucket.total_latency_ns.store(0, memory_order_relaxed);
+            bucket.max_latency_ns.store(0, memory_order_relaxed);
+
+            bucket.second.store(second, memory_order_release);
+            break;
+        }
+    }
+
+    bucket.request_count.fetch_add(1, memory_order_relaxed);
+    bucket.document_count.fetch_add(document_count, memory_order_relaxed);
+    bucket.total_latency_ns.fetch_add(latency_ns, memory_order_relaxed);
+
+    if (document_count == 0) {
+        bucket.empty_result_count.fetch_add(1, memory_order_relaxed);
+    }
+
+    uint64_t max_latency_ns = bucket.max_latency_ns.load(memory_order_relaxed);
+    while (max_latency_ns < latency_ns
+           && !bucket.max_latency_ns.compare_exchange_weak(max_latency_ns, latency_ns, memory_order_relaxed)) {
+    }
+}
+
+RequestStatisticsSnapshot RequestStatistics::GetSnapshot() const {
+    const int64_t now = ToSeconds(Clock::now());
+    const int64_t window = static_cast<int64_t>(buckets_.size());
+
+    RequestStatisticsSnapshot snapshot;
+
+    for (const Bucket& bucket : buckets_) {
+        const int64_t bucket_second = bucket.second.load(memory_order_acquire);
+
+        if (bucket_second < 0 || now - bucket_second >= window) {
+            continue;
+        }
+
+        snapshot.request_count += bucket.request_count.load(memory_order_relaxed);
+        snapshot.empty_result_count += bucket.empty_result_count.load(memory_order_relaxed);
+        snapshot.document_count += bucket.document_count.load(memory_order_relaxed);
+        snapshot.total_latency += chrono::nanoseconds(bucket.total_latency_ns.load(memory_order_relaxed));
+        snapshot.max_latency = max(snapshot.max_latency, chrono::nanoseconds(bucket.max_latency_ns.load(memory_order_relaxed)));
+    }
+
+    return snapshot;
+}
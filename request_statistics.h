@@ -0,0 +1,52 @@
+#pragma once
+
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <vector>
+
+struct RequestStatisticsSnapshot {
+    uint64_t request_count = 0;
+    uint64_t empty_result_count = 0;
+    uint64_t document_count = 0;
+    std::chrono::nanoseconds total_latency{ 0 };
+    std::chrono::nanoseconds max_latency{ 0 };
+
+    double GetEmptyResultRate() const;
+    std::chrono::nanoseconds GetAverageLatency() const;
+};
+
+// Request counters over a sliding wall-clock window split into one-second buckets.
+// Recording touches only relaxed atomics of the current bucket, so it is safe to call
+// from many threads at once. A bucket is reset by the first request of a new second,
+// the other requests of that second yield in a loop until the reset is done, so none
+// of them are lost. It is not lock-free: a resetter preempted in the middle holds up
+// the requests of its second.
+class RequestStatistics {
+public:
+    using Clock = std::chrono::steady_clock;
+
+    explicit RequestStatistics(std::chrono::seconds window = std::chrono::seconds(60));
+
+    void Record(Clock::time_point start, Clock::time_point finish, size_t document_count);
+
+    RequestStatisticsSnapshot GetSnapshot() const;
+
+private:
+    // second of a bucket being reset, -1 is of a bucket never used
+    static constexpr int64_t RESETTING_SECOND = -2;
+
+    // one cache line per bucket so neighbouring seconds do not share it
+    struct alignas(64) Bucket {
+        std::atomic<int64_t> second{ -1 };
+        std::atomic<uint64_t> request_count{ 0 };
+        std::atomic<uint64_t> empty_result_count{ 0 };
+        std::atomic<uint64_t> document_count{ 0 };
+        std::atomic<uint64_t> total_latency_ns{ 0 };
+        std::atomic<uint64_t> max_latency_ns{ 0 };
+    };
+
+    static int64_t ToSeconds(Clock::time_point time_point);
+
+    std::vector<Bucket> buckets_;
+};
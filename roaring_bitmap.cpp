@@ -0,0 +1,229 @@
+#include "roaring_bitmap.h"
+
+#include <algorithm>
+#include <iterator>
+
+using namespace std;
+
+void RoaringBitmap::Container::ConvertToBitmap() {
+    bits.assign(BITMAP_WORDS, 0);
+
+    for (const uint16_t value : values) {
+        bits[value >> 6] |= uint64_t{ 1 } << (value & 63);
+    }
+
+    values.clear();
+    values.shrink_to_fit();
+}
+
+void RoaringBitmap::Container::ConvertToArray() {
+    values.clear();
+    values.reserve(cardinality);
+
+    for (size_t word = 0; word < bits.size(); ++word) {
+        for (uint64_t w = bits[word]; w != 0; w &= w - 1) {
+            values.push_back(static_cast<uint16_t>(word * 64 + __builtin_ctzll(w)));
+        }
+    }
+
+    bits.clear();
+    bits.shrink_to_fit();
+}
+
+void RoaringBitmap::Add(uint32_t value) {
+    const uint16_t key = static_cast<uint16_t>(value >> 16);
+    const uint16_t low = static_cast<uint16_t>(value);
+
+    auto it = lower_bound(containers_.begin(), containers_.end(), key, [](const Container& container, uint16_t key) {
+        return container.key < key;
+    });
+
+    if (it == containers_.end() || it->key != key) {
+        it = containers_.insert(it, Container{});
+        it->key = key;
+    }
+
+    Container& container = *it;
+
+    if (container.IsBitmap()) {
+        uint64_t& word = container.bits[low >> 6];
+        const uint64_t bit = uint64_t{ 1 } << (low & 63);
+
+        container.cardinality += (word & bit) == 0;
+        word |= bit;
+        return;
+    }
+
+    // values usually come in ascending order, so this is an append
+    const auto it_value = container.values.empty() || container.values.back() < low
+                              ? container.values.end()
+                              : lower_bound(container.values.begin(), container.values.end(), low);
+
+    if (it_value != container.values.end() && *it_value == low) {
+        return;
+    }
+
+    container.values.insert(it_value, low);
+    ++container.cardinality;
+
+    if (container.cardinality > MAX_ARRAY_SIZE) {
+        container.ConvertToBitmap();
+    }
+}
+
+void RoaringBitmap::Remove(uint32_t value) {
+    const uint16_t key = static_cast<uint16_t>(value >> 16);
+    const uint16_t low = static_cast<uint16_t>(value);
+
+    const auto it = lower_bound(containers_.begin(), containers_.end(), key, [](const Container& container, uint16_t key) {
+        return container.key < key;
+    });
+
+    if (it == containers_.end() || it->key != key) {
+        return;
+    }
+
+    Container& container = *it;
+
+    if (container.IsBitmap()) {
+        uint64_t& word = container.bits[low >> 6];
+        const uint64_t bit = uint64_t{ 1 } << (low & 63);
+
+        if ((word & bit) == 0) {
+            return;
+        }
+
+        word &= ~bit;
+        --container.cardinality;
+
+        if (container.cardinality <= MIN_BITMAP_SIZE) {
+            container.ConvertToArray();
+        }
+    } else {
+        const auto it_value = lower_bound(container.values.begin(), container.values.end(), low);
+
+        if (it_value == container.values.end() || *it_value != low) {
+            return;
+        }
+
+        container.values.erase(it_value);
+        --container.cardinality;
+    }
+
+    if (container.cardinality == 0) {
+        containers_.erase(it);
+    }
+}
+
+bool RoaringBitmap::Contains(uint32_t value) const {
+    const Container* container = FindContainer(static_cast<uint16_t>(value >> 16));
+
+    if (container == nullptr) {
+        return false;
+    }
+
+    const uint16_t low = static_cast<uint16_t>(value);
+
+    if (container->IsBitmap()) {
+        return (container->bits[low >> 6] >> (low & 63)) & 1;
+    }
+
+    return binary_search(container->values.begin(), container->values.end(), low);
+}
+
+size_t RoaringBitmap::size() const {
+    size_t cardinality = 0;
+
+    for (const Container& container : containers_) {
+        cardinality += container.cardinality;
+    }
+
+    return cardinality;
+}
+
+bool RoaringBitmap::empty() const {
+    return containers_.empty();
+}
+
+RoaringBitmap& RoaringBitmap::operator|=(const RoaringBitmap& other) {
+    vector<Container> merged;
+    merged.reserve(containers_.size() + other.containers_.size());
+
+    auto it = containers_.begin();
+    auto it_other = other.containers_.begin();
+
+    while (it != containers_.end() || it_other != other.containers_.end()) {
+        if (it_other == other.containers_.end() || (it != containers_.end() && it->key < it_other->key)) {
+            merged.push_back(move(*it++));
+            continue;
+        }
+
+        if (it == containers_.end() || it_other->key < it->key) {
+            merged.push_back(*it_other++);
+            continue;
+        }
+
+        Container& container = *it;
+        const Container& other_container = *it_other;
+
+        if (!container.IsBitmap() && !other_container.IsBitmap()) {
+            vector<uint16_t> values;
+            values.reserve(container.values.size() + other_container.values.size());
+            set_union(container.values.begin(), container.values.end(), other_container.values.begin(), other_container.values.end(),
+                      back_inserter(values));
+
+            container.values = move(values);
+            container.cardinality = static_cast<uint32_t>(container.values.size());
+
+            if (container.cardinality > MAX_ARRAY_SIZE) {
+                container.ConvertToBitmap();
+            }
+        } else {
+            if (!container.IsBitmap()) {
+                container.ConvertToBitmap();
+            }
+
+            if (other_container.IsBitmap()) {
+                for (size_t word = 0; word < BITMAP_WORDS; ++word) {
+                    container.bits[word] |= other_container.bits[word];
+                }
+            } else {
+                for (const uint16_t value : other_container.values) {
+                    container.bits[value >> 6] |= uint64_t{ 1 } << (value & 63);
+                }
+            }
+
+            container.cardinality = 0;
+
+            for (const uint64_t word : container.bits) {
+                container.cardinality += __builtin_popcountll(word);
+            }
+        }
+
+        merged.push_back(move(container));
+        ++it;
+        ++it_other;
+    }
+
+    containers_ = move(merged);
+
+    return *this;
+}
+
+size_t RoaringBitmap::GetMemoryUsage() const {
+    size_t memory_usage = containers_.capacity() * sizeof(Container);
+
+    for (const Container& container : containers_) {
+        memory_usage += container.values.capacity() * sizeof(uint16_t) + container.bits.capacity() * sizeof(uint64_t);
+    }
+
+    return memory_usage;
+}
+
+const RoaringBitmap::Container* RoaringBitmap::FindContainer(uint16_t key) const {
+    const auto it = lower_bound(containers_.begin(), containers_.end(), key, [](const Container& container, uint16_t key) {
+        return container.key < key;
+    });
+
+    return it == containers_.end() || it->key != key ? nullptr : &*it;
+}
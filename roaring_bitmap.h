@@ -0,0 +1,50 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+// Compressed set of 32-bit values in the Roaring layout. Values are grouped by their
+// upper 16 bits, every group keeps the lower 16 bits as a sorted array while it has
+// at most 4096 of them and as a 65536-bit bitmap when it grows larger, so a group never
+// takes more than 8 KiB. Contains is a binary search over the groups plus an array
+// search or a single bit test.
+class RoaringBitmap {
+public:
+    void Add(uint32_t value);
+    void Remove(uint32_t value);
+
+    bool Contains(uint32_t value) const;
+
+    size_t size() const;
+    bool empty() const;
+
+    RoaringBitmap& operator|=(const RoaringBitmap& other);
+
+    size_t GetMemoryUsage() const;
+
+private:
+    // A container turns into a bitmap above MAX_ARRAY_SIZE values and back into an array
+    // at MIN_BITMAP_SIZE, so adding and removing a value at the bound doesn't convert it
+    static constexpr size_t MAX_ARRAY_SIZE = 4096;
+    static constexpr size_t MIN_BITMAP_SIZE = MAX_ARRAY_SIZE / 2;
+    static constexpr size_t BITMAP_WORDS = 65536 / 64;
+
+    struct Container {
+        uint16_t key = 0;
+        uint32_t cardinality = 0;
+        std::vector<uint16_t> values; // used by an array container
+        std::vector<uint64_t> bits;   // used by a bitmap container
+
+        bool IsBitmap() const {
+            return !bits.empty();
+        }
+
+        void ConvertToBitmap();
+        void ConvertToArray();
+    };
+
+    const Container* FindContainer(uint16_t key) const;
+
+    std::vector<Container> containers_; // sorted by key
+};
@@ -7,115 +7,1388 @@ bool SearchServer::IsValidWord(string_view word) {
     return none_of(word.begin(), word.end(), [](char c) { return c >= '\0' && c < ' '; });
 }
 
+bool SearchServer::IsRankedHigher(const Document& lhs, const Document& rhs) {
+    constexpr double EPSILON = 1e-6;
+
+    if (std::abs(lhs.relevance - rhs.relevance) >= EPSILON) {
+        return lhs.relevance > rhs.relevance;
+    }
+
+    if (lhs.rating != rhs.rating) {
+        return lhs.rating > rhs.rating;
+    }
+
+    return lhs.id < rhs.id;
+}
+
 void SearchServer::AddDocument(int document_id, string_view document, DocumentStatus status,
                                const vector<int>& ratings) {
-    if ((document_id < 0) || (documents_.count(document_id) > 0)) {
+    if ((document_id < 0) || document_ids_.Contains(document_id)) {
         throw invalid_argument("Invalid document_id"s);
     }
 
-    documents_.emplace(document_id, DocumentData{ ComputeAverageRating(ratings), status, string(document) });
+    const auto words = SplitIntoWordsNoStop(document);
+
+    if (duplicate_policy_ != DuplicatePolicy::ALLOW) {
+        const set<string_view> unique_words(words.begin(), words.end());
+        const int original_id = FindDocumentWithSameWords(ComputeWordSetFingerprint(unique_words), unique_words);
+
+        if (original_id >= 0) {
+            switch (duplicate_policy_) {
+                case DuplicatePolicy::REJECT:
+                    throw invalid_argument("Document "s + to_string(document_id) + " is a duplicate of document "s + to_string(original_id));
+                case DuplicatePolicy::FLAG:
+                    duplicate_to_original_ids_[document_id] = original_id;
+                    break;
+                case DuplicatePolicy::REPLACE:
+                    RemoveDocument(original_id);
+                    break;
+                case DuplicatePolicy::ALLOW:
+                    break;
+            }
+        }
+    }
+
+    documents_.emplace(document_id, DocumentData{ ComputeAverageRating(ratings), status, string(document), words.size() });
+    total_word_count_ += words.size();
+
+    AddToExclusionSets(document_id, status, words);
+
+    const size_t ordinal = document_ids_.Add(document_id);
+
+    const double inv_word_count = 1.0 / words.size();
+
+    vector<ForwardIndexEntry> entries;
+    entries.reserve(words.size());
+
+    for (string_view word : words) {
+        const uint32_t term_id = GetTermId(word);
+
+        const auto [it, is_new] = word_to_document_freqs_[term_words_[term_id]].try_emplace(document_id, 0.0);
+
+        if (is_new) {
+            ++term_document_counts_[term_id];
+        }
+
+        it->second += inv_word_count;
+        entries.push_back({ term_id, inv_word_count });
+    }
+
+    if (term_dictionary_) {
+        // the values of new_terms_ words are ignored, they are read from term_document_counts_
+        for (const auto& [term_id, _] : entries) {
+            term_dictionary_->RaiseValue(term_id, term_document_counts_[term_id]);
+        }
+    }
+
+    if (is_forward_index_enabled_ || scoring_mode_ == ScoringMode::FLOAT || is_impact_ordered_postings_enabled_) {
+        sort(entries.begin(), entries.end(), [this](const ForwardIndexEntry& lhs, const ForwardIndexEntry& rhs) {
+            return term_words_[lhs.term_id] < term_words_[rhs.term_id];
+        });
+
+        // merge repeated words into one entry
+        size_t unique_count = 0;
+        for (size_t i = 0; i < entries.size(); ++i) {
+            if (unique_count > 0 && entries[unique_count - 1].term_id == entries[i].term_id) {
+                entries[unique_count - 1].term_freq += entries[i].term_freq;
+            } else {
+                entries[unique_count++] = entries[i];
+            }
+        }
+        entries.resize(unique_count);
+    }
+
+    if (is_forward_index_enabled_) {
+        forward_index_.Add(ordinal, entries);
+    }
+
+    if (is_positional_index_enabled_) {
+        AddDocumentPositions(ordinal, document);
+    }
+
+    if (is_impact_ordered_postings_enabled_) {
+        for (const auto& [term_id, term_freq] : entries) {
+            impact_postings_.Add(term_id, document_id, term_freq);
+        }
+    }
+
+    if (scoring_mode_ == ScoringMode::FLOAT) {
+        compact_postings_.SetDocumentLength(static_cast<uint32_t>(ordinal), static_cast<uint32_t>(words.size()));
+
+        for (const auto& [term_id, term_freq] : entries) {
+            compact_postings_.Add(term_id, static_cast<uint32_t>(ordinal), static_cast<float>(term_freq));
+        }
+    }
+
+    if (duplicate_policy_ != DuplicatePolicy::ALLOW) {
+        AddFingerprint(document_id);
+    }
+}
+
+uint32_t SearchServer::GetTermId(string_view word) {
+    const auto it = term_ids_.find(word);
+
+    if (it != term_ids_.end()) {
+        return it->second;
+    }
+
+    const string_view stored_word = all_words.emplace_back(word); // make a word hard copy
+    const uint32_t term_id = static_cast<uint32_t>(term_words_.size());
+
+    term_words_.push_back(stored_word);
+    term_document_counts_.push_back(0);
+    term_ids_.emplace(stored_word, term_id);
+
+    // writes don't run with searches, so the dictionary is not read meanwhile
+    if (term_dictionary_) {
+        new_terms_.emplace(stored_word, term_id);
+
+        if (new_terms_.size() >= max(MIN_NEW_TERMS_TO_REBUILD, term_dictionary_->size() / MAX_NEW_TERM_SHARE)) {
+            RebuildTermDictionary();
+        }
+    }
+
+    return term_id;
+}
+
+namespace {
+
+shared_ptr<TermDictionary> BuildTermDictionary(const pmr::vector<string_view>& term_words, const pmr::vector<uint32_t>& term_document_counts) {
+    vector<pair<string_view, uint32_t>> terms;
+    terms.reserve(term_words.size());
+
+    for (uint32_t term_id = 0; term_id < term_words.size(); ++term_id) {
+        terms.emplace_back(term_words[term_id], term_id);
+    }
+
+    sort(terms.begin(), terms.end());
+
+    return make_shared<TermDictionary>(terms, vector<uint32_t>(term_document_counts.begin(), term_document_counts.end()));
+}
+
+} // namespace
+
+shared_ptr<const TermDictionary> SearchServer::GetTermDictionary() const {
+    {
+        lock_guard guard(term_dictionary_mutex_);
+
+        if (term_dictionary_) {
+            return term_dictionary_;
+        }
+    }
+
+    // the first searches may build it at once, the other searches don't wait for them
+    auto dictionary = BuildTermDictionary(term_words_, term_document_counts_);
+
+    lock_guard guard(term_dictionary_mutex_);
+
+    if (!term_dictionary_) {
+        term_dictionary_ = move(dictionary);
+    }
+
+    return term_dictionary_;
+}
+
+void SearchServer::RebuildTermDictionary() {
+    auto dictionary = BuildTermDictionary(term_words_, term_document_counts_);
+
+    lock_guard guard(term_dictionary_mutex_);
+    term_dictionary_ = move(dictionary);
+    new_terms_.clear();
+}
+
+vector<uint32_t> SearchServer::FindTopTermsWithPrefix(string_view prefix, size_t count) const {
+    const auto dictionary = GetTermDictionary();
+    const auto [first, last] = dictionary->FindPrefixRange(prefix);
+
+    // (document count, term id), the alphabetically first term wins a tie
+    const auto is_more_frequent = [this](const pair<uint32_t, uint32_t>& lhs, const pair<uint32_t, uint32_t>& rhs) {
+        if (lhs.first != rhs.first) {
+            return lhs.first > rhs.first;
+        }
+
+        return term_words_[lhs.second] < term_words_[rhs.second];
+    };
+
+    // the least frequent of the best terms found so far is on the top of the heap
+    vector<pair<uint32_t, uint32_t>> top_terms;
+
+    const auto add_term = [&](uint32_t term_id) {
+        const pair<uint32_t, uint32_t> term(term_document_counts_[term_id], term_id);
+
+        if (term.first == 0) {
+            return; // all documents with the term are removed
+        }
+
+        if (top_terms.size() < count) {
+            top_terms.push_back(term);
+            push_heap(top_terms.begin(), top_terms.end(), is_more_frequent);
+        } else if (is_more_frequent(term, top_terms.front())) {
+            pop_heap(top_terms.begin(), top_terms.end(), is_more_frequent);
+            top_terms.back() = term;
+            push_heap(top_terms.begin(), top_terms.end(), is_more_frequent);
+        }
+    };
+
+    // the blocks are skipped before the new terms are seen, so the skip compares with
+    // dictionary terms only
+    for (size_t rank = first; rank < last;) {
+        const size_t block_end = min(dictionary->GetBlockEnd(rank), last);
+
+        // terms of a later block lose ties to the ones found, so a block whose bound is not
+        // above the least frequent of them is skipped whole
+        if (top_terms.size() == count && dictionary->GetBlockMaxValue(rank) <= top_terms.front().first) {
+            rank = block_end;
+            continue;
+        }
+
+        for (; rank < block_end; ++rank) {
+            add_term(dictionary->GetTermId(rank));
+        }
+    }
+
+    for (auto it = new_terms_.lower_bound(prefix); it != new_terms_.end() && it->first.substr(0, prefix.size()) == prefix; ++it) {
+        add_term(it->second);
+    }
+
+    sort_heap(top_terms.begin(), top_terms.end(), is_more_frequent);
+
+    vector<uint32_t> term_ids;
+    term_ids.reserve(top_terms.size());
+
+    for (const auto& [_, term_id] : top_terms) {
+        term_ids.push_back(term_id);
+    }
+
+    return term_ids;
+}
+
+vector<pair<string_view, size_t>> SearchServer::CompleteWord(string_view prefix, size_t count) const {
+    vector<pair<string_view, size_t>> result;
+
+    for (const uint32_t term_id : FindTopTermsWithPrefix(prefix, count)) {
+        result.emplace_back(term_words_[term_id], term_document_counts_[term_id]);
+    }
+
+    return result;
+}
+
+void SearchServer::SetForwardIndexEnabled(bool enabled) {
+    if (enabled == is_forward_index_enabled_) {
+        return;
+    }
+
+    if (!enabled) {
+        if (duplicate_policy_ != DuplicatePolicy::ALLOW) {
+            throw logic_error("Duplicate detection needs the forward index"s);
+        }
+
+        forward_index_.Clear();
+        is_forward_index_enabled_ = false;
+        return;
+    }
+
+    BuildForwardIndex();
+    is_forward_index_enabled_ = true;
+}
+
+void SearchServer::BuildForwardIndex() {
+    // postings are sorted by word, so the entries of every document come out sorted too
+    vector<vector<ForwardIndexEntry>> ordinal_to_entries(document_ids_.GetOrdinalCount());
+
+    for (const auto& [word, document_freqs] : word_to_document_freqs_) {
+        const uint32_t term_id = term_ids_.at(word);
+
+        for (const auto& [document_id, term_freq] : document_freqs) {
+            ordinal_to_entries[document_ids_.Find(document_id)].push_back({ term_id, term_freq });
+        }
+    }
+
+    for (size_t ordinal = 0; ordinal < ordinal_to_entries.size(); ++ordinal) {
+        if (document_ids_.IsLive(ordinal)) {
+            forward_index_.Add(ordinal, ordinal_to_entries[ordinal]);
+        }
+    }
+}
+
+bool SearchServer::IsForwardIndexEnabled() const {
+    return is_forward_index_enabled_;
+}
+
+size_t SearchServer::GetForwardIndexMemoryUsage() const {
+    return forward_index_.GetMemoryUsage();
+}
+
+void SearchServer::SetPositionalIndexEnabled(bool enabled) {
+    if (enabled == is_positional_index_enabled_) {
+        return;
+    }
+
+    positional_index_.Clear();
+
+    if (enabled) {
+        // ordinals ascend along the iteration, so every position list is appended
+        for (const int document_id : document_ids_) {
+            AddDocumentPositions(document_ids_.Find(document_id), documents_.at(document_id).text);
+        }
+    }
+
+    is_positional_index_enabled_ = enabled;
+}
+
+bool SearchServer::IsPositionalIndexEnabled() const {
+    return is_positional_index_enabled_;
+}
+
+size_t SearchServer::GetPositionalIndexMemoryUsage() const {
+    return positional_index_.GetMemoryUsage();
+}
+
+void SearchServer::AddDocumentPositions(size_t ordinal, string_view text) {
+    map<uint32_t, vector<uint32_t>> term_positions;
+    uint32_t position = 0;
+
+    // stop words are not stored but still take a position
+    for (string_view word : SplitIntoWords(text)) {
+        if (!IsStopWord(word)) {
+            term_positions[term_ids_.at(word)].push_back(position);
+        }
+
+        ++position;
+    }
+
+    for (const auto& [term_id, positions] : term_positions) {
+        positional_index_.Add(term_id, static_cast<uint32_t>(ordinal), positions);
+    }
+}
+
+void SearchServer::RemoveDocumentPositions(size_t ordinal, string_view text) {
+    for (string_view word : SplitIntoWordsNoStop(text)) {
+        positional_index_.Remove(term_ids_.at(word), static_cast<uint32_t>(ordinal));
+    }
+}
+
+bool SearchServer::ContainsPhrase(const Phrase& phrase, uint32_t ordinal) const {
+    // possible positions of the opening quote, narrowed word by word
+    vector<uint32_t> starts;
+    vector<uint32_t> positions;
+    vector<uint32_t> next_starts;
+
+    for (size_t i = 0; i < phrase.words.size(); ++i) {
+        const auto it_term = term_ids_.find(phrase.words[i]);
+
+        if (it_term == term_ids_.end()) {
+            return false;
+        }
+
+        positional_index_.GetPositions(it_term->second, ordinal, positions);
+
+        const uint32_t offset = phrase.offsets[i];
+
+        if (i == 0) {
+            for (const uint32_t position : positions) {
+                if (position >= offset) {
+                    starts.push_back(position - offset);
+                }
+            }
+        } else if (phrase.slop == 0) {
+            // a word standing before its offset can't be a part of the phrase
+            positions.erase(positions.begin(), lower_bound(positions.begin(), positions.end(), offset));
+
+            for (uint32_t& position : positions) {
+                position -= offset;
+            }
+
+            next_starts.clear();
+            GallopingIntersection(starts.begin(), starts.end(), positions.begin(), positions.end(), back_inserter(next_starts));
+            starts.swap(next_starts);
+        } else {
+            // keep the starts with the word within slop positions from its place
+            starts.erase(remove_if(starts.begin(), starts.end(),
+                                   [&positions, offset, &phrase](uint32_t start) {
+                                       const uint32_t place = start + offset;
+                                       const auto it = lower_bound(positions.begin(), positions.end(), place - min(place, phrase.slop));
+                                       return it == positions.end() || *it > place + phrase.slop;
+                                   }),
+                         starts.end());
+        }
+
+        if (starts.empty()) {
+            return false;
+        }
+    }
+
+    if (phrase.slop == 0) {
+        return true;
+    }
+
+    // with slop one occurrence of a repeated word could stand in the windows of all of its
+    // copies, so the copies take distinct occurrences: every copy takes the first free one
+    // in its window, which is optimal as the windows end in the order of the copies
+    map<string_view, vector<size_t>> word_indexes;
+
+    for (size_t i = 0; i < phrase.words.size(); ++i) {
+        word_indexes[phrase.words[i]].push_back(i);
+    }
+
+    vector<uint32_t> taken_positions;
+
+    for (const auto& [word, indexes] : word_indexes) {
+        if (indexes.size() < 2) {
+            continue;
+        }
+
+        positional_index_.GetPositions(term_ids_.at(word), ordinal, positions);
+
+        starts.erase(remove_if(starts.begin(), starts.end(),
+                               [&](uint32_t start) {
+                                   taken_positions.clear();
+
+                                   for (const size_t i : indexes) {
+                                       const uint32_t place = start + phrase.offsets[i];
+                                       // the first word defines the start, it stands at its place
+                                       const uint32_t slop = i == 0 ? 0 : phrase.slop;
+
+                                       auto it = lower_bound(positions.begin(), positions.end(), place - min(place, slop));
+
+                                       while (it != positions.end() && *it <= place + slop
+                                              && find(taken_positions.begin(), taken_positions.end(), *it) != taken_positions.end()) {
+                                           ++it;
+                                       }
+
+                                       if (it == positions.end() || *it > place + slop) {
+                                           return true;
+                                       }
+
+                                       taken_positions.push_back(*it);
+                                   }
+
+                                   return false;
+                               }),
+                     starts.end());
+    }
+
+    return !starts.empty();
+}
+
+bool SearchServer::ContainsPhrases(const Query& query, uint32_t ordinal) const {
+    if (!is_positional_index_enabled_) {
+        throw logic_error("Phrase queries need the positional index"s);
+    }
+
+    return all_of(query.phrases.begin(), query.phrases.end(), [this, ordinal](const Phrase& phrase) {
+        return ContainsPhrase(phrase, ordinal);
+    });
+}
+
+vector<uint32_t> SearchServer::FindPhraseOrdinals(const Query& query) const {
+    if (!is_positional_index_enabled_) {
+        throw logic_error("Phrase queries need the positional index"s);
+    }
+
+    vector<const pmr::vector<uint32_t>*> word_ordinals;
+
+    for (const Phrase& phrase : query.phrases) {
+        for (string_view word : phrase.words) {
+            const auto it_term = term_ids_.find(word);
+
+            if (it_term == term_ids_.end()) {
+                return {};
+            }
+
+            word_ordinals.push_back(&positional_index_.GetOrdinals(it_term->second));
+        }
+    }
+
+    // documents with all the words are found first, rarest words first, positions
+    // are decoded only for these candidates
+    sort(word_ordinals.begin(), word_ordinals.end(), [](const auto* lhs, const auto* rhs) {
+        return lhs->size() < rhs->size();
+    });
+
+    vector<uint32_t> candidates(word_ordinals.front()->begin(), word_ordinals.front()->end());
+    vector<uint32_t> next_candidates;
+
+    for (size_t i = 1; i < word_ordinals.size() && !candidates.empty(); ++i) {
+        next_candidates.clear();
+        GallopingIntersection(candidates.begin(), candidates.end(), word_ordinals[i]->begin(), word_ordinals[i]->end(),
+                              back_inserter(next_candidates));
+        candidates.swap(next_candidates);
+    }
+
+    candidates.erase(remove_if(candidates.begin(), candidates.end(),
+                               [this, &query](uint32_t ordinal) {
+                                   return !ContainsPhrases(query, ordinal);
+                               }),
+                     candidates.end());
+
+    return candidates;
+}
+
+void SearchServer::FilterByPhrases(const Query& query, vector<Document>& documents) const {
+    if (query.phrases.empty()) {
+        return;
+    }
+
+    const auto ordinals = FindPhraseOrdinals(query);
+
+    documents.erase(remove_if(documents.begin(), documents.end(),
+                              [this, &ordinals](const Document& document) {
+                                  return !binary_search(ordinals.begin(), ordinals.end(), document_ids_.Find(document.id));
+                              }),
+                    documents.end());
+}
+
+RoaringBitmap SearchServer::FindMinusWordDocuments(const Query& query) const {
+    RoaringBitmap minus_documents;
+
+    for (string_view word : query.minus_words) {
+        const auto it_word = word_to_document_freqs_.find(word);
+
+        if (it_word == word_to_document_freqs_.end()) {
+            continue;
+        }
+
+        // the view from the index outlives the query
+        const string_view stored_word = it_word->first;
+
+        {
+            lock_guard guard(minus_word_cache_mutex_);
+
+            const auto it_cached = minus_word_bitmaps_.find(stored_word);
+
+            if (it_cached != minus_word_bitmaps_.end()) {
+                minus_documents |= it_cached->second;
+                continue;
+            }
+        }
+
+        METRICS_COUNT(MINUS_POSTINGS_SCANNED, it_word->second.size());
+
+        RoaringBitmap word_documents;
+
+        for (const auto& [document_id, _] : it_word->second) {
+            word_documents.Add(static_cast<uint32_t>(document_id));
+        }
+
+        if (it_word->second.size() >= MIN_CACHED_MINUS_POSTINGS) {
+            lock_guard guard(minus_word_cache_mutex_);
+
+            if (++minus_word_uses_[stored_word] >= MINUS_WORD_USES_TO_CACHE && minus_word_bitmaps_.size() < MAX_CACHED_MINUS_WORDS) {
+                minus_word_bitmaps_.emplace(stored_word, word_documents);
+            }
+        }
+
+        minus_documents |= word_documents;
+    }
+
+    return minus_documents;
+}
+
+void SearchServer::AddToExclusionSets(int document_id, DocumentStatus status, const vector<string_view>& words) {
+    status_to_document_ids_[static_cast<size_t>(status)].Add(static_cast<uint32_t>(document_id));
+
+    lock_guard guard(minus_word_cache_mutex_);
+
+    if (minus_word_bitmaps_.empty()) {
+        return;
+    }
+
+    for (string_view word : words) {
+        const auto it_cached = minus_word_bitmaps_.find(word);
+
+        if (it_cached != minus_word_bitmaps_.end()) {
+            it_cached->second.Add(static_cast<uint32_t>(document_id));
+        }
+    }
+}
+
+void SearchServer::EraseFromExclusionSets(int document_id, DocumentStatus status) {
+    status_to_document_ids_[static_cast<size_t>(status)].Remove(static_cast<uint32_t>(document_id));
+
+    lock_guard guard(minus_word_cache_mutex_);
+
+    for (auto& [_, word_documents] : minus_word_bitmaps_) {
+        word_documents.Remove(static_cast<uint32_t>(document_id));
+    }
+}
+
+vector<int> SearchServer::FindDocumentsWithRequiredWords(const Query& query) const {
+    for (string_view word : query.required_words) {
+        if (word_to_document_freqs_.count(word) == 0) {
+            return {};
+        }
+    }
+
+    vector<int> document_ids;
+
+    if (scoring_mode_ == ScoringMode::FLOAT) {
+        // compact postings are sorted arrays, so the intersection gallops, shortest first
+        vector<CompactPostings::TermPostings> word_postings;
+
+        for (string_view word : query.required_words) {
+            word_postings.push_back(compact_postings_.Get(term_ids_.at(word)));
+        }
+
+        sort(word_postings.begin(), word_postings.end(), [](const auto& lhs, const auto& rhs) {
+            return lhs.size < rhs.size;
+        });
+
+        vector<uint32_t> ordinals(word_postings.front().ordinals, word_postings.front().ordinals + word_postings.front().size);
+        vector<uint32_t> next_ordinals;
+
+        for (size_t i = 1; i < word_postings.size() && !ordinals.empty(); ++i) {
+            next_ordinals.clear();
+            GallopingIntersection(ordinals.begin(), ordinals.end(), word_postings[i].ordinals, word_postings[i].ordinals + word_postings[i].size,
+                                  back_inserter(next_ordinals));
+            ordinals.swap(next_ordinals);
+        }
+
+        for (const uint32_t ordinal : ordinals) {
+            document_ids.push_back(document_ids_.GetDocumentId(ordinal));
+        }
+
+        sort(document_ids.begin(), document_ids.end());
+
+        return document_ids;
+    }
+
+    vector<const pmr::map<int, double>*> word_postings;
+
+    for (string_view word : query.required_words) {
+        word_postings.push_back(&word_to_document_freqs_.find(word)->second);
+    }
+
+    sort(word_postings.begin(), word_postings.end(), [](const auto* lhs, const auto* rhs) {
+        return lhs->size() < rhs->size();
+    });
+
+    // the shortest postings drive the intersection, the longer ones are only probed
+    // through their trees, so they are never scanned
+    for (const auto& [document_id, _] : *word_postings.front()) {
+        if (all_of(word_postings.begin() + 1, word_postings.end(), [document_id = document_id](const auto* document_freqs) {
+                return document_freqs->count(document_id) != 0;
+            })) {
+            document_ids.push_back(document_id);
+        }
+    }
+
+    return document_ids;
+}
+
+void SearchServer::SetImpactOrderedPostingsEnabled(bool enabled) {
+    if (enabled == is_impact_ordered_postings_enabled_) {
+        return;
+    }
+
+    impact_postings_.Clear();
+
+    if (enabled) {
+        for (const auto& [word, document_freqs] : word_to_document_freqs_) {
+            impact_postings_.Assign(term_ids_.at(word), { document_freqs.begin(), document_freqs.end() });
+        }
+    }
+
+    is_impact_ordered_postings_enabled_ = enabled;
+}
+
+bool SearchServer::IsImpactOrderedPostingsEnabled() const {
+    return is_impact_ordered_postings_enabled_;
+}
+
+size_t SearchServer::GetImpactOrderedPostingsMemoryUsage() const {
+    return impact_postings_.GetMemoryUsage();
+}
+
+bool SearchServer::CanUseImpactOrderedPostings(const Query& query) const {
+    // required words and phrases narrow the candidates much better by themselves
+    return is_impact_ordered_postings_enabled_ && query.required_words.empty() && query.phrases.empty();
+}
+
+void SearchServer::SetScoringMode(ScoringMode mode) {
+    if (mode == scoring_mode_) {
+        return;
+    }
+
+    compact_postings_.Clear();
+
+    if (mode == ScoringMode::FLOAT) {
+        BuildCompactPostings();
+    }
+
+    scoring_mode_ = mode;
+}
+
+ScoringMode SearchServer::GetScoringMode() const {
+    return scoring_mode_;
+}
+
+size_t SearchServer::GetCompactPostingsMemoryUsage() const {
+    return compact_postings_.GetMemoryUsage();
+}
+
+void SearchServer::BuildCompactPostings() {
+    for (const int document_id : document_ids_) {
+        compact_postings_.SetDocumentLength(static_cast<uint32_t>(document_ids_.Find(document_id)),
+                                            static_cast<uint32_t>(documents_.at(document_id).word_count));
+    }
+
+    vector<pair<uint32_t, float>> postings;
+
+    for (const auto& [word, document_freqs] : word_to_document_freqs_) {
+        const uint32_t term_id = term_ids_.at(word);
+
+        postings.clear();
+
+        for (const auto& [document_id, term_freq] : document_freqs) {
+            postings.emplace_back(static_cast<uint32_t>(document_ids_.Find(document_id)), static_cast<float>(term_freq));
+        }
+
+        // postings are ordered by id, ordinals follow the order of addition
+        sort(postings.begin(), postings.end());
+
+        for (const auto& [ordinal, term_freq] : postings) {
+            compact_postings_.Add(term_id, ordinal, term_freq);
+        }
+    }
+}
+
+void SearchServer::CompactOrdinalsIfMostlyDead() {
+    const size_t dead_count = document_ids_.GetDeadCount();
+
+    if (dead_count < MIN_DEAD_ORDINALS_TO_COMPACT || dead_count <= document_ids_.size()) {
+        return;
+    }
+
+    document_ids_.Compact();
+
+    if (is_forward_index_enabled_) {
+        forward_index_.Clear();
+        BuildForwardIndex();
+    }
+
+    if (is_positional_index_enabled_) {
+        positional_index_.Clear();
+
+        for (const int document_id : document_ids_) {
+            AddDocumentPositions(document_ids_.Find(document_id), documents_.at(document_id).text);
+        }
+    }
+
+    if (scoring_mode_ == ScoringMode::FLOAT) {
+        compact_postings_.Clear();
+        BuildCompactPostings();
+    }
+}
+
+void SearchServer::SetDuplicatePolicy(DuplicatePolicy policy) {
+    if (policy != DuplicatePolicy::ALLOW && !is_forward_index_enabled_) {
+        throw logic_error("Duplicate detection needs the forward index"s);
+    }
+
+    if (policy == DuplicatePolicy::ALLOW) {
+        fingerprint_to_document_ids_.clear();
+        duplicate_to_original_ids_.clear();
+    } else if (duplicate_policy_ == DuplicatePolicy::ALLOW) {
+        for (const int document_id : document_ids_) {
+            AddFingerprint(document_id);
+        }
+    }
+
+    duplicate_policy_ = policy;
+}
+
+DuplicatePolicy SearchServer::GetDuplicatePolicy() const {
+    return duplicate_policy_;
+}
+
+const map<int, int>& SearchServer::GetFlaggedDuplicates() const {
+    return duplicate_to_original_ids_;
+}
+
+int SearchServer::FindOriginalDocument(string_view document) const {
+    if (duplicate_policy_ == DuplicatePolicy::ALLOW) {
+        return -1;
+    }
+
+    const auto words = SplitIntoWordsNoStop(document);
+    const set<string_view> unique_words(words.begin(), words.end());
+
+    return FindDocumentWithSameWords(ComputeWordSetFingerprint(unique_words), unique_words);
+}
+
+void SearchServer::AddFingerprint(int document_id) {
+    const uint64_t fingerprint = ComputeWordSetFingerprint(GetWordFrequencies(document_id));
+
+    fingerprint_to_document_ids_[fingerprint].push_back(document_id);
+}
+
+void SearchServer::EraseFingerprint(int document_id) {
+    duplicate_to_original_ids_.erase(document_id);
+
+    for (auto it = duplicate_to_original_ids_.begin(); it != duplicate_to_original_ids_.end();) {
+        it = it->second == document_id ? duplicate_to_original_ids_.erase(it) : next(it);
+    }
+
+    const auto it_bucket = fingerprint_to_document_ids_.find(ComputeWordSetFingerprint(GetWordFrequencies(document_id)));
+
+    if (it_bucket == fingerprint_to_document_ids_.end()) {
+        return;
+    }
+
+    auto& ids = it_bucket->second;
+    ids.erase(remove(ids.begin(), ids.end(), document_id), ids.end());
+
+    if (ids.empty()) {
+        fingerprint_to_document_ids_.erase(it_bucket);
+    }
+}
+
+DocumentData SearchServer::GetDocumentById(int id) const {
+    return documents_.at(id);
+
+}
+
+int SearchServer::ComputeAverageRating(const vector<int>& ratings) {
+    if (ratings.empty()) {
+        return 0;
+    }
+
+    int rating_sum = 0;
+
+    for (const int rating : ratings) {
+        rating_sum += rating;
+    }
+
+    return rating_sum / static_cast<int>(ratings.size());
+}
+
+vector<string_view> SearchServer::SplitIntoWordsNoStop(string_view text) const {
+    vector<string_view> words;
+
+    for (string_view word : SplitIntoWords(text)) {
+        if (!IsValidWord(word)) {
+            throw invalid_argument("Word "s + string(word) + " is invalid"s);
+        }
+
+        if (!IsStopWord(word)) {
+            words.push_back(word);
+        }
+    }
+
+    return words;
+}
+
+bool SearchServer::IsStopWord(string_view word) const {
+    return stop_words_.count(word) > 0;
+}
+
+int SearchServer::GetDocumentCount() const {
+    return document_ids_.size();
+}
+
+double SearchServer::ComputeWordInverseDocumentFreq(string_view word) const {
+    return log(double(GetCollectionStatistics().document_count) / GetTermDocumentCount(word, word_to_document_freqs_.at(word).size()));
+}
+
+CollectionStatistics SearchServer::GetCollectionStatistics() const {
+    size_t document_count = document_ids_.size();
+    size_t total_word_count = total_word_count_;
+
+    if (!statistics_shards_.empty()) {
+        document_count = 0;
+        total_word_count = 0;
+
+        for (const SearchServer* shard : statistics_shards_) {
+            document_count += shard->document_ids_.size();
+            total_word_count += shard->total_word_count_;
+        }
+    }
+
+    return { document_count, document_count == 0 ? 0.0 : double(total_word_count) / document_count };
+}
+
+size_t SearchServer::GetTermDocumentCount(string_view word, size_t local_count) const {
+    if (statistics_shards_.empty()) {
+        return local_count;
+    }
+
+    size_t document_count = 0;
+
+    for (const SearchServer* shard : statistics_shards_) {
+        const auto it = shard->term_ids_.find(word);
+
+        if (it != shard->term_ids_.end()) {
+            document_count += shard->term_document_counts_[it->second];
+        }
+    }
+
+    return document_count;
+}
+
+void SearchServer::SetStatisticsShards(vector<const SearchServer*> shards) {
+    statistics_shards_ = move(shards);
+}
+
+SearchServer::QueryWord SearchServer::ParseQueryWord(string_view text) const {
+    if (text.empty()) {
+        throw invalid_argument("Query word is empty"s);
+    }
+
+    bool is_minus = false;
+    bool is_required = false;
+
+    if (text[0] == '-') {
+        is_minus = true;
+
+        // remove '-' char from minus word
+        text.remove_prefix(1);
+    } else if (text[0] == '+') {
+        is_required = true;
+
+        // remove '+' char from required word
+        text.remove_prefix(1);
+
+        if (!text.empty() && text[0] == '+') {
+            throw invalid_argument("Query word "s + string(text) + " is invalid");
+        }
+    }
+
+    if (text.empty() || text[0] == '-' || !IsValidWord(text)) {
+        throw invalid_argument("Query word "s + string(text) + " is invalid");
+    }
+
+    // a lone '*' stays an ordinary word
+    const bool is_prefix = text.size() > 1 && text.back() == '*';
+
+    if (is_prefix) {
+        if (is_required) {
+            throw invalid_argument("Query word +"s + string(text) + " can't be both required and prefix"s);
+        }
+
+        // remove '*' char from prefix word
+        text.remove_suffix(1);
+    }
+
+    return { text, is_minus, is_required, is_prefix, !is_prefix && IsStopWord(text) };
+}
+
+SearchServer::Query SearchServer::ParseQuery(string_view text) const {
+    METRICS_PHASE(QUERY_PARSE);
+
+    SearchServer::Query result;
+
+    const auto words = SplitIntoWords(text);
+    vector<string_view> fuzzy_words;
+
+    for (size_t i = 0; i < words.size(); ++i) {
+        if (!words[i].empty() && words[i][0] == '"') {
+            i = ParsePhrase(words, i, result);
+            continue;
+        }
+
+        const auto query_word = ParseQueryWord(words[i]);
+
+        if (query_word.is_prefix) {
+            // minus prefixes expand to all of their words, otherwise documents with
+            // a rare word would slip through
+            const size_t max_expansion_count = query_word.is_minus ? term_words_.size() : MAX_PREFIX_EXPANSION_COUNT;
+            auto& expanded_words = query_word.is_minus ? result.minus_words : result.plus_words;
+
+            for (const uint32_t term_id : FindTopTermsWithPrefix(query_word.data, max_expansion_count)) {
+                expanded_words.insert(term_words_[term_id]);
+            }
+
+            continue;
+        }
+
+        if (!query_word.is_stop) {
+            if (query_word.is_minus) {
+                result.minus_words.insert(query_word.data);
+            } else {
+                result.plus_words.insert(query_word.data);
+            }
+
+            if (query_word.is_required) {
+                result.required_words.insert(query_word.data);
+            } else if (!query_word.is_minus && max_edit_distance_ > 0) {
+                fuzzy_words.push_back(query_word.data);
+            }
+        }
+    }
+
+    // expansions go last, so the words typed exactly keep their full weight
+    for (string_view word : fuzzy_words) {
+        AddFuzzyWords(word, result);
+    }
 
-    const auto words = SplitIntoWordsNoStop(document);
+    return result;
+}
 
-    const double inv_word_count = 1.0 / words.size();
+void SearchServer::AddFuzzyWords(string_view word, Query& query) const {
+    const int max_edit_distance = min(max_edit_distance_, word.size() < 3 ? 0 : word.size() < 6 ? 1 : 2);
 
-    auto& word_freqs = documentId_to_word_freqs_[document_id];
+    if (max_edit_distance == 0) {
+        return;
+    }
 
-    for (string_view word : words) {
-        auto it = all_words.insert(string(word)); // make a word hard copy
-        string_view sw = *it.first;
+    auto terms = FindFuzzyTerms(word, max_edit_distance);
+
+    // the closest words first, then the most frequent ones
+    sort(terms.begin(), terms.end(), [this](const pair<uint32_t, int>& lhs, const pair<uint32_t, int>& rhs) {
+        if (lhs.second != rhs.second) {
+            return lhs.second < rhs.second;
+        }
+
+        if (term_document_counts_[lhs.first] != term_document_counts_[rhs.first]) {
+            return term_document_counts_[lhs.first] > term_document_counts_[rhs.first];
+        }
+
+        return term_words_[lhs.first] < term_words_[rhs.first];
+    });
+
+    size_t expansion_count = 0;
+
+    for (const auto& [term_id, distance] : terms) {
+        if (expansion_count == MAX_FUZZY_EXPANSION_COUNT) {
+            break;
+        }
+
+        if (distance == 0 || term_document_counts_[term_id] == 0) {
+            continue;
+        }
+
+        const string_view expanded_word = term_words_[term_id];
+        const double weight = FUZZY_WORD_WEIGHTS[distance];
 
-        word_to_document_freqs_[sw][document_id] += inv_word_count;
-        word_freqs[sw] += inv_word_count;
+        if (query.plus_words.count(expanded_word) == 0) {
+            query.plus_words.insert(expanded_word);
+            query.word_weights[expanded_word] = weight;
+        } else if (const auto it = query.word_weights.find(expanded_word); it != query.word_weights.end()) {
+            it->second = max(it->second, weight);
+        }
+
+        ++expansion_count;
     }
+}
+
+double SearchServer::GetWordWeight(const Query& query, string_view word) {
+    const auto it = query.word_weights.find(word);
 
-    document_ids_.push_back(document_id);
+    return it == query.word_weights.end() ? 1.0 : it->second;
 }
 
-DocumentData SearchServer::GetDocumentById(int id) const {
-    return documents_.at(id);
+int SearchServer::FindNextFuzzyChar(string_view word, const int* row, int max_edit_distance, unsigned char last_char) {
+    const int min_distance = *min_element(row, row + word.size() + 1);
+
+    // any char keeps the prefix within an edit of the row minimum
+    if (min_distance < max_edit_distance) {
+        return last_char == UCHAR_MAX ? -1 : last_char + 1;
+    }
+
+    // at the limit only a char matching the word right after a best position does
+    int next_char = -1;
+
+    for (size_t j = 0; j < word.size(); ++j) {
+        const auto c = static_cast<unsigned char>(word[j]);
+
+        if (row[j] <= max_edit_distance && c > last_char && (next_char < 0 || c < next_char)) {
+            next_char = c;
+        }
+    }
 
+    return next_char;
 }
 
-int SearchServer::ComputeAverageRating(const vector<int>& ratings) {
-    if (ratings.empty()) {
-        return 0;
+namespace {
+
+// A TermDictionary::Cursor over the words added after the dictionary was built
+class NewTermCursor {
+public:
+    explicit NewTermCursor(const map<string_view, uint32_t>& terms)
+        : terms_(&terms)
+        , it_(terms.begin()) {
     }
 
-    int rating_sum = 0;
+    bool IsValid() const {
+        return it_ != terms_->end();
+    }
 
-    for (const int rating : ratings) {
-        rating_sum += rating;
+    uint32_t GetTermId() const {
+        return it_->second;
     }
 
-    return rating_sum / static_cast<int>(ratings.size());
+    string_view GetTerm() const {
+        return it_->first;
+    }
+
+    void Next() {
+        ++it_;
+    }
+
+    void Seek(string_view key) {
+        if (IsValid() && it_->first < key) {
+            it_ = terms_->lower_bound(key);
+        }
+    }
+
+private:
+    const map<string_view, uint32_t>* terms_;
+    map<string_view, uint32_t>::const_iterator it_;
+};
+
+} // namespace
+
+vector<pair<uint32_t, int>> SearchServer::FindFuzzyTerms(string_view word, int max_edit_distance) const {
+    const auto dictionary = GetTermDictionary();
+
+    vector<pair<uint32_t, int>> result;
+    FindFuzzyTermsWithCursor(TermDictionary::Cursor(*dictionary), word, max_edit_distance, result);
+    FindFuzzyTermsWithCursor(NewTermCursor(new_terms_), word, max_edit_distance, result);
+
+    return result;
 }
 
-vector<string_view> SearchServer::SplitIntoWordsNoStop(string_view text) const {
-    vector<string_view> words;
+template <typename TermCursor>
+void SearchServer::FindFuzzyTermsWithCursor(TermCursor cursor, string_view word, int max_edit_distance, vector<pair<uint32_t, int>>& result) {
+    const size_t width = word.size() + 1;
 
-    for (string_view word : SplitIntoWords(text)) {
-        if (!IsValidWord(word)) {
-            throw invalid_argument("Word "s + string(word) + " is invalid"s);
+    // row i holds the distances between the first i chars of term_prefix and every prefix of word
+    string term_prefix;
+    vector<int> rows(width);
+    iota(rows.begin(), rows.end(), 0);
+
+    string next_prefix;
+
+    while (cursor.IsValid()) {
+        const string_view term = cursor.GetTerm();
+
+        // the rows of the prefix shared with the previous term are still valid
+        size_t shared = 0;
+
+        while (shared < term_prefix.size() && shared < term.size() && term_prefix[shared] == term[shared]) {
+            ++shared;
         }
 
-        if (!IsStopWord(word)) {
-            words.push_back(word);
+        term_prefix.resize(shared);
+        rows.resize((shared + 1) * width);
+
+        bool is_too_far = false;
+
+        while (!is_too_far && term_prefix.size() < term.size()) {
+            const char c = term[term_prefix.size()];
+            const size_t previous = term_prefix.size() * width;
+
+            term_prefix.push_back(c);
+            rows.resize(rows.size() + width);
+
+            const size_t current = previous + width;
+            int min_distance = rows[current] = rows[previous] + 1;
+
+            for (size_t j = 1; j < width; ++j) {
+                rows[current + j] = min({ rows[previous + j] + 1, rows[current + j - 1] + 1,
+                                          rows[previous + j - 1] + (word[j - 1] == c ? 0 : 1) });
+                min_distance = min(min_distance, rows[current + j]);
+            }
+
+            is_too_far = min_distance > max_edit_distance;
+        }
+
+        if (!is_too_far) {
+            const int distance = rows[term_prefix.size() * width + word.size()];
+
+            if (distance <= max_edit_distance) {
+                result.emplace_back(cursor.GetTermId(), distance);
+            }
+
+            cursor.Next();
+            continue;
+        }
+
+        // no term starting with this prefix can get close enough, the scan goes on from
+        // the next prefix which still can, one char longer than the parent or an ancestor
+        next_prefix.clear();
+
+        while (!term_prefix.empty()) {
+            const auto last_char = static_cast<unsigned char>(term_prefix.back());
+
+            term_prefix.pop_back();
+            rows.resize((term_prefix.size() + 1) * width);
+
+            const int next_char = FindNextFuzzyChar(word, &rows[term_prefix.size() * width], max_edit_distance, last_char);
+
+            if (next_char >= 0) {
+                next_prefix = term_prefix;
+                next_prefix.push_back(static_cast<char>(next_char));
+                break;
+            }
         }
+
+        if (next_prefix.empty()) {
+            break;
+        }
+
+        cursor.Seek(next_prefix);
+    }
+}
+
+void SearchServer::SetMaxEditDistance(int max_edit_distance) {
+    if (max_edit_distance < 0 || max_edit_distance >= static_cast<int>(FUZZY_WORD_WEIGHTS.size())) {
+        throw invalid_argument("Max edit distance "s + to_string(max_edit_distance) + " is out of range"s);
     }
 
-    return words;
+    max_edit_distance_ = max_edit_distance;
 }
 
-bool SearchServer::IsStopWord(string_view word) const {
-    return stop_words_.count(word) > 0;
+int SearchServer::GetMaxEditDistance() const {
+    return max_edit_distance_;
 }
 
-int SearchServer::GetDocumentCount() const {
-    return document_ids_.size();
+size_t SearchServer::ParsePhrase(const vector<string_view>& words, size_t first, Query& query) const {
+    Phrase phrase;
+
+    for (size_t i = first; i < words.size(); ++i) {
+        string_view word = words[i];
+
+        if (i == first) {
+            // remove opening '"' char
+            word.remove_prefix(1);
+        }
+
+        const size_t quote = word.find('"');
+        const bool is_closing = quote != word.npos;
+
+        if (is_closing) {
+            const string_view suffix = word.substr(quote + 1);
+            word = word.substr(0, quote);
+
+            if (!suffix.empty()) {
+                if (suffix.size() < 2 || suffix[0] != '~' || suffix.size() > 6
+                    || !all_of(suffix.begin() + 1, suffix.end(), [](char c) { return c >= '0' && c <= '9'; })) {
+                    throw invalid_argument("Query phrase ending "s + string(suffix) + " is invalid"s);
+                }
+
+                phrase.slop = static_cast<uint32_t>(stoul(string(suffix.substr(1))));
+            }
+        }
+
+        const auto query_word = ParseQueryWord(word);
+
+        if (query_word.is_minus) {
+            throw invalid_argument("Query phrase contains minus word "s + string(word));
+        }
+
+        if (query_word.is_prefix) {
+            throw invalid_argument("Query phrase contains prefix word "s + string(word));
+        }
+
+        if (!query_word.is_stop) {
+            phrase.words.push_back(query_word.data);
+            phrase.offsets.push_back(static_cast<uint32_t>(i - first));
+            query.plus_words.insert(query_word.data);
+
+            // a phrase needs all of its words, so they narrow the candidates like +word does
+            query.required_words.insert(query_word.data);
+        }
+
+        if (is_closing) {
+            if (!phrase.words.empty()) {
+                query.phrases.push_back(move(phrase));
+            }
+
+            return i;
+        }
+    }
+
+    throw invalid_argument("Query phrase is not closed"s);
 }
 
-double SearchServer::ComputeWordInverseDocumentFreq(string_view word) const {
-    return log(double(GetDocumentCount()) / word_to_document_freqs_.at(word).size());
+vector<Document> SearchServer::FindTopDocuments(const CancellationToken& cancellation, string_view raw_query, DocumentStatus status) const {
+    return FindTopDocuments(cancellation, raw_query, DocumentStatusPredicate{ status });
 }
 
-SearchServer::QueryWord SearchServer::ParseQueryWord(string_view text) const {
-    if (text.empty()) {
-        throw invalid_argument("Query word is empty"s);
-    }
+vector<Document> SearchServer::FindTopDocuments(const CancellationToken& cancellation, string_view raw_query) const {
+    return FindTopDocuments(cancellation, raw_query, DocumentStatus::ACTUAL);
+}
 
-    bool is_minus = false;
+size_t SearchServer::EstimateQueryCost(string_view raw_query) const {
+    return EstimateQueryCost(ParseQuery(raw_query));
+}
 
-    if (text[0] == '-') {
-        is_minus = true;
+SearchServer::ParsedQuery SearchServer::PrepareQuery(string raw_query) const {
+    ParsedQuery query;
+    query.raw_query_ = make_unique<const string>(move(raw_query));
+    query.query_ = ParseQuery(*query.raw_query_);
 
-        // remove '-' char from minus word
-        text.remove_prefix(1);
-    }
+    return query;
+}
 
-    if (text.empty() || text[0] == '-' || !IsValidWord(text)) {
-        throw invalid_argument("Query word "s + string(text) + " is invalid");
+size_t SearchServer::EstimateQueryCost(const ParsedQuery& query) const {
+    return EstimateQueryCost(query.query_);
+}
+
+size_t SearchServer::EstimateQueryCost(const Query& query) const {
+    size_t cost = 0;
+
+    for (const auto* words : { &query.plus_words, &query.minus_words }) {
+        for (string_view word : *words) {
+            const auto it_word = word_to_document_freqs_.find(word);
+
+            if (it_word != word_to_document_freqs_.end()) {
+                cost += it_word->second.size();
+            }
+        }
     }
 
-    return { text, is_minus, IsStopWord(text) };
+    return cost;
 }
 
-SearchServer::Query SearchServer::ParseQuery(string_view text) const {
-    SearchServer::Query result;
+void SearchServer::PruneQuery(Query& query, size_t max_query_cost) const {
+    size_t cost = EstimateQueryCost(query);
 
-    for (string_view word : SplitIntoWords(text)) {
-        const auto query_word = ParseQueryWord(word);
+    if (cost <= max_query_cost) {
+        return;
+    }
 
-        if (!query_word.is_stop) {
-            if (query_word.is_minus) {
-                result.minus_words.insert(query_word.data);
-            } else {
-                result.plus_words.insert(query_word.data);
-            }
+    // postings length -> word, the longest go first
+    vector<pair<size_t, string_view>> optional_words;
+
+    for (string_view word : query.plus_words) {
+        if (query.required_words.count(word) == 0) {
+            const auto it_word = word_to_document_freqs_.find(word);
+            optional_words.emplace_back(it_word == word_to_document_freqs_.end() ? 0 : it_word->second.size(), word);
         }
     }
 
-    return result;
+    sort(optional_words.begin(), optional_words.end(), greater<>());
+
+    const size_t kept_count = query.required_words.empty() ? 1 : 0;
+
+    for (size_t i = 0; i + kept_count < optional_words.size() && cost > max_query_cost; ++i) {
+        const auto& [postings_length, word] = optional_words[i];
+
+        cost -= postings_length;
+        query.plus_words.erase(word);
+        query.word_weights.erase(word);
+    }
+}
+
+SearchServer::Query SearchServer::GetPrunedQuery(const ParsedQuery& parsed_query, size_t max_query_cost, const CancellationToken& cancellation) const {
+    Query query = parsed_query.query_;
+    PruneQuery(query, max_query_cost);
+    query.cancellation = &cancellation;
+
+    return query;
+}
+
+bool SearchServer::IsCancelled(const Query& query) {
+    return query.cancellation && query.cancellation->IsCancelled();
+}
+
+void SearchServer::ThrowIfCancelled(const Query& query) {
+    if (query.cancellation) {
+        query.cancellation->ThrowIfCancelled();
+    }
 }
 
 vector<Document> SearchServer::FindTopDocuments(string_view raw_query, DocumentStatus status) const {
@@ -123,15 +1396,11 @@ vector<Document> SearchServer::FindTopDocuments(string_view raw_query, DocumentS
 }
 
 vector<Document> SearchServer::FindTopDocuments(const std::execution::sequenced_policy&, string_view raw_query, DocumentStatus status) const {
-    return FindTopDocuments(execution::seq, raw_query, [status](int document_id, DocumentStatus document_status, int rating) {
-        return document_status == status;
-    });
+    return FindTopDocuments(execution::seq, raw_query, DocumentStatusPredicate{ status });
 }
 
 vector<Document> SearchServer::FindTopDocuments(const std::execution::parallel_policy&, string_view raw_query, DocumentStatus status) const {
-    return FindTopDocuments(execution::par, raw_query, [status](int document_id, DocumentStatus document_status, int rating) {
-        return document_status == status;
-    });
+    return FindTopDocuments(execution::par, raw_query, DocumentStatusPredicate{ status });
 }
 
 vector<Document> SearchServer::FindTopDocuments(string_view raw_query) const {
@@ -146,32 +1415,187 @@ vector<Document> SearchServer::FindTopDocuments(const std::execution::parallel_p
     return FindTopDocuments(execution::par, raw_query, DocumentStatus::ACTUAL);
 }
 
+tuple<vector<Document>, QueryProfile> SearchServer::FindTopDocumentsExplained(string_view raw_query) const {
+    return FindTopDocumentsExplained(execution::seq, raw_query, DocumentStatusPredicate{ DocumentStatus::ACTUAL });
+}
+
+vector<Document> SearchServer::FindTopDocumentsPage(string_view raw_query, size_t page_number, size_t page_size) const {
+    return FindTopDocumentsPage(raw_query, DocumentStatusPredicate{ DocumentStatus::ACTUAL }, page_number, page_size);
+}
+
+vector<Document> SearchServer::FindTopDocumentsAfter(string_view raw_query, const Document& last_document, size_t count) const {
+    return FindTopDocumentsAfter(raw_query, DocumentStatusPredicate{ DocumentStatus::ACTUAL }, last_document, count);
+}
+
 tuple<vector<string_view>, DocumentStatus> SearchServer::MatchDocument(string_view raw_query, int document_id) const {
     return MatchDocument(execution::seq, raw_query, document_id);
 }
 
-const list<int>::const_iterator SearchServer::begin() const {
+vector<tuple<vector<string_view>, DocumentStatus>> SearchServer::MatchDocuments(string_view raw_query, const vector<int>& document_ids) const {
+    return MatchDocuments(execution::seq, raw_query, document_ids);
+}
+
+map<int, tuple<vector<string_view>, DocumentStatus>> SearchServer::MatchAllDocuments(string_view raw_query) const {
+    const auto query = ParseQuery(raw_query);
+
+    map<int, tuple<vector<string_view>, DocumentStatus>> matched_documents;
+
+    // plus words are sorted, so the words of every document are appended in order
+    for (string_view word : query.plus_words) {
+        const auto it_word = word_to_document_freqs_.find(word);
+
+        if (it_word == word_to_document_freqs_.end()) {
+            continue;
+        }
+
+        for (const auto& [document_id, _] : it_word->second) {
+            get<0>(matched_documents[document_id]).push_back(it_word->first);
+        }
+    }
+
+    for (string_view word : query.minus_words) {
+        const auto it_word = word_to_document_freqs_.find(word);
+
+        if (it_word == word_to_document_freqs_.end()) {
+            continue;
+        }
+
+        for (const auto& [document_id, _] : it_word->second) {
+            matched_documents.erase(document_id);
+        }
+    }
+
+    if (!query.required_words.empty()) {
+        const auto document_ids = FindDocumentsWithRequiredWords(query);
+
+        for (auto it = matched_documents.begin(); it != matched_documents.end();) {
+            it = binary_search(document_ids.begin(), document_ids.end(), it->first) ? next(it) : matched_documents.erase(it);
+        }
+    }
+
+    if (!query.phrases.empty()) {
+        const auto ordinals = FindPhraseOrdinals(query);
+
+        for (auto it = matched_documents.begin(); it != matched_documents.end();) {
+            it = binary_search(ordinals.begin(), ordinals.end(), document_ids_.Find(it->first)) ? next(it) : matched_documents.erase(it);
+        }
+    }
+
+    for (auto& [document_id, words_status] : matched_documents) {
+        get<1>(words_status) = documents_.at(document_id).status;
+    }
+
+    return matched_documents;
+}
+
+tuple<vector<string_view>, DocumentStatus> SearchServer::MatchQuery(const Query& query, int document_id) const {
+    METRICS_PHASE(MATCH);
+
+    const auto status = documents_.at(document_id).status;
+
+    if (!query.phrases.empty() && !ContainsPhrases(query, static_cast<uint32_t>(document_ids_.Find(document_id)))) {
+        return { vector<string_view>{}, status };
+    }
+
+    if (!is_forward_index_enabled_) {
+        const auto contains_document = [this, document_id](string_view word) {
+            const auto it_word = word_to_document_freqs_.find(word);
+            return it_word != word_to_document_freqs_.end() && it_word->second.count(document_id) != 0;
+        };
+
+        if (any_of(query.minus_words.begin(), query.minus_words.end(), contains_document)
+            || !all_of(query.required_words.begin(), query.required_words.end(), contains_document)) {
+            return { vector<string_view>{}, status };
+        }
+
+        vector<string_view> matched_words;
+
+        for (string_view word : query.plus_words) {
+            if (contains_document(word)) {
+                matched_words.push_back(word_to_document_freqs_.find(word)->first);
+            }
+        }
+
+        return { matched_words, status };
+    }
+
+    const auto word_freqs = forward_index_.Get(document_ids_.Find(document_id), term_words_.data());
+
+    for (string_view word : query.minus_words) {
+        if (word_freqs.Contains(word)) {
+            return { vector<string_view>{}, status };
+        }
+    }
+
+    for (string_view word : query.required_words) {
+        if (!word_freqs.Contains(word)) {
+            return { vector<string_view>{}, status };
+        }
+    }
+
+    vector<string_view> matched_words;
+
+    // both query words and document words are sorted, so a single merge pass is enough
+    auto query_it = query.plus_words.begin();
+    auto document_it = word_freqs.begin();
+
+    while (query_it != query.plus_words.end() && document_it != word_freqs.end()) {
+        if (*query_it < document_it->first) {
+            ++query_it;
+        } else if (document_it->first < *query_it) {
+            ++document_it;
+        } else {
+            // take the view from the index, it outlives raw_query
+            matched_words.push_back(document_it->first);
+            ++query_it;
+            ++document_it;
+        }
+    }
+
+    METRICS_COUNT(DOCUMENTS_MATCHED, matched_words.empty() ? 0 : 1);
+
+    return { matched_words, status };
+}
+
+DocumentOrdinals::ConstIterator SearchServer::begin() const {
     return document_ids_.begin();
 }
 
-const list<int>::const_iterator SearchServer::end() const {
+DocumentOrdinals::ConstIterator SearchServer::end() const {
     return document_ids_.end();
 }
 
-const map<string_view, double, less<>>& SearchServer::GetWordFrequencies(int document_id) const {
-    const static map<string_view, double, std::less<>> empty_map;
+SearchServer::WordFrequencies SearchServer::GetWordFrequencies(int document_id) const {
+    if (!is_forward_index_enabled_) {
+        throw logic_error("Forward index is disabled"s);
+    }
+
+    const size_t ordinal = document_ids_.Find(document_id);
 
-    if (documentId_to_word_freqs_.count(document_id) == 0) {
-        return empty_map;
+    if (ordinal == DocumentOrdinals::NO_ORDINAL) {
+        return {};
     }
 
-    return documentId_to_word_freqs_.at(document_id);
+    return forward_index_.Get(ordinal, term_words_.data());
 }
 
 void SearchServer::RemoveDocument(int document_id) {
     RemoveDocument(execution::seq, document_id);
 }
 
+void SearchServer::RemoveDocuments(const vector<int>& document_ids) {
+    for (const int document_id : document_ids) {
+        const size_t ordinal = document_ids_.Find(document_id);
+
+        if (ordinal != DocumentOrdinals::NO_ORDINAL) {
+            EraseDocumentFromIndex(execution::seq, document_id, ordinal);
+            document_ids_.Remove(document_id);
+        }
+    }
+
+    CompactOrdinalsIfMostlyDead();
+}
+
 void PrintMatchDocumentResult(int document_id, const vector<string_view>& words, DocumentStatus status) {
     cout << "{ "s
          << "document_id = "s << document_id << ", "s
@@ -221,9 +1645,8 @@ void MatchDocuments(const SearchServer& search_server, string_view query) {
     try {
         cout << "Matched documents for the query: "s << string(query) << endl;
 
-        for (const auto& document_id : search_server) {
-
-            const auto [words, status] = search_server.MatchDocument(query, document_id);
+        for (const auto& [document_id, words_status] : search_server.MatchAllDocuments(query)) {
+            const auto& [words, status] = words_status;
 
             PrintMatchDocumentResult(document_id, words, status);
         }
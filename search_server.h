@@ -1,20 +1,42 @@
 #pragma once
 
+#include "cancellation_token.h"
+#include "compact_postings.h"
 #include "concurrent_map.h"
 #include "document.h"
+#include "document_ordinals.h"
+#include "forward_index.h"
+#include "impact_postings.h"
 #include "log_duration.h"
+#include "metrics.h"
 #include "paginator.h"
+#include "positional_index.h"
+#include "query_profile.h"
+#include "ranking.h"
+#include "roaring_bitmap.h"
+#include "sorted_intersection.h"
 #include "string_processing.h"
+#include "term_dictionary.h"
 
 #include <algorithm>
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <climits>
 #include <cmath>
+#include <deque>
 #include <execution>
 #include <functional>
 #include <future>
-#include <list>
+#include <numeric>
 #include <map>
+#include <memory>
+#include <memory_resource>
+#include <mutex>
 #include <set>
 #include <stdexcept>
+#include <tuple>
+#include <unordered_map>
 #include <unordered_set>
 #include <vector>
 
@@ -22,8 +44,34 @@ using namespace std::string_literals;
 
 constexpr int MAX_RESULT_DOCUMENT_COUNT = 5;
 
+// What AddDocument does with a document whose set of words is already in the server
+enum class DuplicatePolicy {
+    ALLOW,   // no checks, fingerprints are not stored
+    REJECT,  // throw invalid_argument
+    FLAG,    // add the document and remember the id of the original
+    REPLACE, // remove the original and add the new document
+};
+
+// Precision of the term frequencies and accumulators used for ranking
+enum class ScoringMode {
+    DOUBLE, // postings maps with double values
+    FLOAT,  // compact float postings and dense float accumulators
+};
+
+// Predicate of the status overloads of FindTopDocuments. The search recognizes it and
+// skips documents of other statuses by the status bitmap, without looking them up
+struct DocumentStatusPredicate {
+    DocumentStatus status = DocumentStatus::ACTUAL;
+
+    bool operator()(int, DocumentStatus document_status, int) const {
+        return document_status == status;
+    }
+};
+
 class SearchServer {
 public:
+    using WordFrequencies = WordFrequenciesView;
+
     explicit SearchServer(std::string stop_words_text)
         : SearchServer(std::string_view(stop_words_text)) {
     }
@@ -45,57 +93,210 @@ public:
 
     int GetDocumentCount() const;
 
-    template <typename DocumentPredicate>
-    std::vector<Document> FindTopDocuments(std::string_view raw_query, DocumentPredicate document_predicate) const {
-        return FindTopDocuments(std::execution::seq, raw_query, document_predicate);
+    // Switching from ALLOW builds the fingerprint index for already added documents
+    void SetDuplicatePolicy(DuplicatePolicy policy);
+    DuplicatePolicy GetDuplicatePolicy() const;
+
+    // Duplicate document id -> original document id, filled with DuplicatePolicy::FLAG
+    const std::map<int, int>& GetFlaggedDuplicates() const;
+
+    // Id of the document with the same words as the text, the one AddDocument would reject,
+    // flag or replace, -1 if there is none or the policy is ALLOW
+    int FindOriginalDocument(std::string_view document) const;
+
+    // Ranking is a policy class from ranking.h, TfIdfRanking by default
+    template <typename DocumentPredicate, typename Ranking = TfIdfRanking>
+    std::vector<Document> FindTopDocuments(std::string_view raw_query, DocumentPredicate document_predicate,
+                                           const Ranking& ranking = {}) const {
+        return FindTopDocuments(std::execution::seq, raw_query, document_predicate, ranking);
     }
 
-    template <typename DocumentPredicate>
-    std::vector<Document> FindTopDocuments(const std::execution::sequenced_policy&, std::string_view raw_query, DocumentPredicate document_predicate) const {
-        const auto query = ParseQuery(raw_query);
+    template <typename DocumentPredicate, typename Ranking = TfIdfRanking>
+    std::vector<Document> FindTopDocuments(const std::execution::sequenced_policy&, std::string_view raw_query, DocumentPredicate document_predicate,
+                                           const Ranking& ranking = {}) const {
+        METRICS_COUNT(QUERIES, 1);
+
+        return FindTopDocumentsForQuery(ParseQuery(raw_query), document_predicate, ranking);
+    }
+
+    // Sequential search stopped by the token: once it is cancelled or its deadline passes,
+    // the postings scan stops at its next check and QueryCancelledError is thrown
+    template <typename DocumentPredicate, typename Ranking = TfIdfRanking>
+    std::vector<Document> FindTopDocuments(const CancellationToken& cancellation, std::string_view raw_query, DocumentPredicate document_predicate,
+                                           const Ranking& ranking = {}) const {
+        METRICS_COUNT(QUERIES, 1);
+
+        cancellation.ThrowIfCancelled();
+
+        auto query = ParseQuery(raw_query);
+        query.cancellation = &cancellation;
+
+        return FindTopDocumentsForQuery(query, document_predicate, ranking);
+    }
+
+    std::vector<Document> FindTopDocuments(const CancellationToken& cancellation, std::string_view raw_query, DocumentStatus status) const;
+    std::vector<Document> FindTopDocuments(const CancellationToken& cancellation, std::string_view raw_query) const;
+
+    // Upper bound of the postings a search of the query reads: the summed postings lengths
+    // of its words after prefix and fuzzy expansion. Costs only the query parsing
+    size_t EstimateQueryCost(std::string_view raw_query) const;
+
+    // Query parsed once for EstimateQueryCost and a search, which may run on another thread.
+    // It owns a copy of the query text and must not outlive the server
+    class ParsedQuery;
+
+    ParsedQuery PrepareQuery(std::string raw_query) const;
+    size_t EstimateQueryCost(const ParsedQuery& query) const;
 
-        auto matched_documents = FindAllDocuments(std::execution::seq, query, document_predicate);
+    // Approximate search of an expensive query: the optional plus words with the longest
+    // postings are dropped until the query costs at most max_query_cost. They are the most
+    // common words, so they weigh least in the relevance. Required, phrase and minus words
+    // are kept, as is the rarest plus word of a query without required words
+    template <typename DocumentPredicate, typename Ranking = TfIdfRanking>
+    std::vector<Document> FindTopDocumentsPruned(const CancellationToken& cancellation, std::string_view raw_query, size_t max_query_cost,
+                                                 DocumentPredicate document_predicate, const Ranking& ranking = {}) const {
+        METRICS_COUNT(QUERIES, 1);
 
-        std::sort(matched_documents.begin(), matched_documents.end(), [](const Document& lhs, const Document& rhs) {
-            constexpr double EPSILON = 1e-6;
+        cancellation.ThrowIfCancelled();
 
-            if (std::abs(lhs.relevance - rhs.relevance) < EPSILON) {
-                return lhs.rating > rhs.rating;
-            } else {
-                return lhs.relevance > rhs.relevance;
+        auto query = ParseQuery(raw_query);
+        PruneQuery(query, max_query_cost);
+        query.cancellation = &cancellation;
+
+        return FindTopDocumentsForQuery(query, document_predicate, ranking);
+    }
+
+    template <typename DocumentPredicate, typename Ranking = TfIdfRanking>
+    std::vector<Document> FindTopDocumentsPruned(const CancellationToken& cancellation, const ParsedQuery& query, size_t max_query_cost,
+                                                 DocumentPredicate document_predicate, const Ranking& ranking = {}) const {
+        METRICS_COUNT(QUERIES, 1);
+
+        cancellation.ThrowIfCancelled();
+
+        return FindTopDocumentsForQuery(GetPrunedQuery(query, max_query_cost, cancellation), document_predicate, ranking);
+    }
+
+    template <typename DocumentPredicate, typename Ranking = TfIdfRanking>
+    std::vector<Document> FindTopDocuments(const std::execution::parallel_policy&, std::string_view raw_query, DocumentPredicate document_predicate,
+                                           const Ranking& ranking = {}) const {
+        METRICS_COUNT(QUERIES, 1);
+
+        const auto query = ParseQuery(raw_query);
+
+        if constexpr (std::is_same_v<Ranking, TfIdfRanking>) {
+            if (CanUseImpactOrderedPostings(query)) {
+                return FindTopDocumentsByImpact(query, document_predicate);
             }
-        });
+        }
 
-        if (matched_documents.size() > MAX_RESULT_DOCUMENT_COUNT) {
-            matched_documents.resize(MAX_RESULT_DOCUMENT_COUNT);
+        auto matched_documents = FindAllDocuments(std::execution::par, query, document_predicate, ranking);
+
+        {
+            METRICS_PHASE(TOP_K);
+
+            std::sort(std::execution::par, matched_documents.begin(), matched_documents.end(), IsRankedHigher);
+
+            if (matched_documents.size() > MAX_RESULT_DOCUMENT_COUNT) {
+                matched_documents.resize(MAX_RESULT_DOCUMENT_COUNT);
+            }
         }
 
         return matched_documents;
     }
 
+    // Returns page page_number (counting from 0) of the ranked results without the
+    // MAX_RESULT_DOCUMENT_COUNT cap. Only the first (page_number + 1) * page_size
+    // documents are ordered, the rest are left unsorted
+    template <typename DocumentPredicate>
+    std::vector<Document> FindTopDocumentsPage(std::string_view raw_query, DocumentPredicate document_predicate,
+                                               size_t page_number, size_t page_size) const {
+        const auto query = ParseQuery(raw_query);
+
+        auto matched_documents = FindAllDocuments(std::execution::seq, query, document_predicate, TfIdfRanking{});
+
+        const size_t page_begin = std::min(page_number * page_size, matched_documents.size());
+        const size_t page_end = std::min(page_begin + page_size, matched_documents.size());
+
+        std::partial_sort(matched_documents.begin(), matched_documents.begin() + page_end, matched_documents.end(), IsRankedHigher);
+
+        return { matched_documents.begin() + page_begin, matched_documents.begin() + page_end };
+    }
+
+    std::vector<Document> FindTopDocumentsPage(std::string_view raw_query, size_t page_number, size_t page_size) const;
+
+    // Search-after paging: returns up to count documents ranked right after last_document,
+    // which is usually the last document of the previous page
     template <typename DocumentPredicate>
-    std::vector<Document> FindTopDocuments(const std::execution::parallel_policy&, std::string_view raw_query, DocumentPredicate document_predicate) const {
+    std::vector<Document> FindTopDocumentsAfter(std::string_view raw_query, DocumentPredicate document_predicate,
+                                                const Document& last_document, size_t count) const {
+        const auto query = ParseQuery(raw_query);
+
+        auto matched_documents = FindAllDocuments(std::execution::seq, query, document_predicate, TfIdfRanking{});
+
+        matched_documents.erase(std::remove_if(matched_documents.begin(), matched_documents.end(),
+                                               [&last_document](const Document& document) {
+                                                   return !IsRankedHigher(last_document, document);
+                                               }),
+                                matched_documents.end());
+
+        const size_t page_end = std::min(count, matched_documents.size());
+
+        std::partial_sort(matched_documents.begin(), matched_documents.begin() + page_end, matched_documents.end(), IsRankedHigher);
+        matched_documents.resize(page_end);
+
+        return matched_documents;
+    }
+
+    std::vector<Document> FindTopDocumentsAfter(std::string_view raw_query, const Document& last_document, size_t count) const;
+
+    // FindTopDocuments which also reports how the query was executed. The extra cost is
+    // a few clock reads and a lookup per query word, so it may be used for sampled traffic
+    template <typename ExecutionPolicy, typename DocumentPredicate>
+    std::tuple<std::vector<Document>, QueryProfile> FindTopDocumentsExplained(ExecutionPolicy&& policy, std::string_view raw_query,
+                                                                              DocumentPredicate document_predicate) const {
+        using Clock = std::chrono::steady_clock;
+
+        QueryProfile profile;
+        profile.is_parallel = std::is_same_v<std::decay_t<ExecutionPolicy>, std::execution::parallel_policy>;
+
+        const auto parse_start = Clock::now();
         const auto query = ParseQuery(raw_query);
+        profile.parse_time = Clock::now() - parse_start;
 
-        auto matched_documents = FindAllDocuments(std::execution::par, query, document_predicate);
+        for (const auto& [words, is_minus] : { std::pair{ &query.plus_words, false }, std::pair{ &query.minus_words, true } }) {
+            for (std::string_view word : *words) {
+                TermProfile& term = profile.terms.emplace_back(TermProfile{ word, is_minus });
+                const auto it_word = word_to_document_freqs_.find(word);
 
-        std::sort(std::execution::par, matched_documents.begin(), matched_documents.end(), [](const Document& lhs, const Document& rhs) {
-            constexpr double EPSILON = 1e-6;
+                if (it_word != word_to_document_freqs_.end()) {
+                    term.postings_count = it_word->second.size();
+                    term.inverse_document_freq = ComputeWordInverseDocumentFreq(word);
 
-            if (std::abs(lhs.relevance - rhs.relevance) < EPSILON) {
-                return lhs.rating > rhs.rating;
-            } else {
-                return lhs.relevance > rhs.relevance;
+                    if (!is_minus) {
+                        profile.postings_scanned += term.postings_count;
+                    }
+                }
             }
-        });
+        }
+
+        auto matched_documents = FindAllDocuments(policy, query, document_predicate, TfIdfRanking{}, &profile);
+
+        const auto top_k_start = Clock::now();
+
+        std::sort(policy, matched_documents.begin(), matched_documents.end(), IsRankedHigher);
 
         if (matched_documents.size() > MAX_RESULT_DOCUMENT_COUNT) {
             matched_documents.resize(MAX_RESULT_DOCUMENT_COUNT);
         }
 
-        return matched_documents;
+        profile.top_k_time = Clock::now() - top_k_start;
+        profile.documents_returned = matched_documents.size();
+
+        return { matched_documents, profile };
     }
 
+    std::tuple<std::vector<Document>, QueryProfile> FindTopDocumentsExplained(std::string_view raw_query) const;
+
     std::vector<Document> FindTopDocuments(std::string_view raw_query, DocumentStatus status) const;
     std::vector<Document> FindTopDocuments(const std::execution::sequenced_policy&, std::string_view raw_query, DocumentStatus status) const;
     std::vector<Document> FindTopDocuments(const std::execution::parallel_policy&, std::string_view raw_query, DocumentStatus status) const;
@@ -107,77 +308,113 @@ public:
     std::tuple<std::vector<std::string_view>, DocumentStatus> MatchDocument(std::string_view raw_query,
                                                                             int document_id) const;
     template <typename ExecutionPolicy>
-    std::tuple<std::vector<std::string_view>, DocumentStatus> MatchDocument(ExecutionPolicy&& policy, std::string_view raw_query,
+    std::tuple<std::vector<std::string_view>, DocumentStatus> MatchDocument(ExecutionPolicy&&, std::string_view raw_query,
                                                                             int document_id) const {
-        const auto query = ParseQuery(raw_query);
-
-        const auto checker = [this, document_id](std::string_view word) {
-            return word_to_document_freqs_.count(word) != 0 && word_to_document_freqs_.at(word).count(document_id);
-        };
+        // Matching a single document is a linear merge over two sorted ranges,
+        // there is nothing to split between threads here
+        return MatchQuery(ParseQuery(raw_query), document_id);
+    }
 
-        std::vector<std::string_view> matched_words;
-        matched_words.reserve(query.plus_words.size());
+    std::vector<std::tuple<std::vector<std::string_view>, DocumentStatus>> MatchDocuments(std::string_view raw_query,
+                                                                                          const std::vector<int>& document_ids) const;
 
-        for_each(policy, query.plus_words.begin(), query.plus_words.end(),
-                 [&checker, &matched_words](std::string_view word) {
-                     if (checker(word)) {
-                         matched_words.push_back(std::move(word));
-                     }
-                 });
+    template <typename ExecutionPolicy>
+    std::vector<std::tuple<std::vector<std::string_view>, DocumentStatus>> MatchDocuments(ExecutionPolicy&& policy, std::string_view raw_query,
+                                                                                          const std::vector<int>& document_ids) const {
+        const auto query = ParseQuery(raw_query);
 
-        const auto status = documents_.at(document_id).status;
+        std::vector<std::tuple<std::vector<std::string_view>, DocumentStatus>> results(document_ids.size());
 
-        if (any_of(policy, query.minus_words.begin(), query.minus_words.end(), [&checker](std::string_view word) { return checker(word); })) {
-            return { {}, status };
-        }
+        // every document writes only its own slot, so par needs no synchronization
+        std::transform(policy, document_ids.begin(), document_ids.end(), results.begin(),
+                       [this, &query](int document_id) {
+                           return MatchQuery(query, document_id);
+                       });
 
-        return { matched_words, status };
+        return results;
     }
 
-    const std::list<int>::const_iterator begin() const;
-    const std::list<int>::const_iterator end() const;
-
-    const std::map<std::string_view, double, std::less<>>& GetWordFrequencies(int document_id) const;
+    // Matches the query against the whole server in one pass over the postings
+    // of the query words. Only documents with at least one plus word, all required
+    // (+word) words and without minus words get into the result
+    std::map<int, std::tuple<std::vector<std::string_view>, DocumentStatus>> MatchAllDocuments(std::string_view raw_query) const;
+
+    // Fuzzy matching expands every plain plus word of a query to the words of the server within
+    // max_edit_distance edits, 0 (the default) turns it off, 2 is the most. Words shorter than
+    // 3 chars are matched exactly, shorter than 6 chars with one edit. A word found with
+    // d edits weighs FUZZY_WORD_WEIGHTS[d] of an exact one in the relevance
+    void SetMaxEditDistance(int max_edit_distance);
+    int GetMaxEditDistance() const;
+
+    // Words starting with prefix paired with the number of documents having them, the most
+    // frequent first. Serves type-ahead autocomplete
+    std::vector<std::pair<std::string_view, size_t>> CompleteWord(std::string_view prefix, size_t count) const;
+
+    DocumentOrdinals::ConstIterator begin() const;
+    DocumentOrdinals::ConstIterator end() const;
+
+    // The view is valid until the next AddDocument or RemoveDocument call.
+    // Throws std::logic_error if the forward index is disabled
+    WordFrequencies GetWordFrequencies(int document_id) const;
+
+    // The forward index (words of every document) serves GetWordFrequencies, fast removal,
+    // matching and duplicate detection. Without it these fall back to postings scans.
+    // Enabling it again rebuilds it from the postings
+    void SetForwardIndexEnabled(bool enabled);
+    bool IsForwardIndexEnabled() const;
+    size_t GetForwardIndexMemoryUsage() const;
+
+    // FLOAT keeps a compact float copy of the postings and scores queries over it.
+    // Relevance differs from DOUBLE by float rounding only, well within the ranking epsilon
+    void SetScoringMode(ScoringMode mode);
+    ScoringMode GetScoringMode() const;
+    size_t GetCompactPostingsMemoryUsage() const;
+
+    // The positional index stores where every word occurs in the documents and is needed
+    // for quoted phrases in queries: "funny pet", or "funny pet"~2 to let every phrase word
+    // stand up to 2 positions away from its place. Enabling it builds it from the texts
+    void SetPositionalIndexEnabled(bool enabled);
+    bool IsPositionalIndexEnabled() const;
+    size_t GetPositionalIndexMemoryUsage() const;
+
+    // Impact-ordered postings let FindTopDocuments with TF-IDF ranking stop reading postings
+    // once no unseen document can get into the top. They are another copy of the postings,
+    // so the option is off by default
+    void SetImpactOrderedPostingsEnabled(bool enabled);
+    bool IsImpactOrderedPostingsEnabled() const;
+    size_t GetImpactOrderedPostingsMemoryUsage() const;
 
     void RemoveDocument(int document_id);
 
     template <typename ExecutionPolicy>
     void RemoveDocument(ExecutionPolicy&& policy, int document_id) {
-        const auto it_found = find(policy, document_ids_.begin(), document_ids_.end(), document_id);
+        const size_t ordinal = document_ids_.Find(document_id);
 
-        if (it_found == document_ids_.end()) {
+        if (ordinal == DocumentOrdinals::NO_ORDINAL) {
             return;
         }
 
-        document_ids_.erase(it_found);
+        EraseDocumentFromIndex(policy, document_id, ordinal);
 
-        documents_.erase(document_id);
-
-        for_each(policy,
-                 word_to_document_freqs_.begin(), word_to_document_freqs_.end(),
-                 [&document_id](auto& item) {
-                     item.second.erase(document_id);
-                 });
-
-        // if exist clear all keys with empty map ids_freqs in word_to_document_freqs_
-        std::vector<std::string> keysWithEmptyValues;
+        document_ids_.Remove(document_id);
+        CompactOrdinalsIfMostlyDead();
+    }
 
-        for (const auto& [word, _] : word_to_document_freqs_) {
-            if (word_to_document_freqs_.at(word).empty()) {
-                keysWithEmptyValues.push_back(std::string(word));
-            }
-        }
+    // Removes a batch of documents, unknown ids are ignored
+    void RemoveDocuments(const std::vector<int>& document_ids);
 
-        for (const auto& key : keysWithEmptyValues) {
-            word_to_document_freqs_.erase(key);
-        }
+    DocumentData GetDocumentById(int id) const;
 
-        documentId_to_word_freqs_.erase(document_id);
-    }
+    // Ranking order of search results: relevance, then rating, then id to make it total
+    static bool IsRankedHigher(const Document& lhs, const Document& rhs);
 
-    DocumentData GetDocumentById(int id) const;
+    // Makes the server rank documents as a shard of the collection split into shards, itself
+    // included: document and word counts are summed over all of them, so relevance is the same
+    // as in one server with all the documents. The shards must outlive the server
+    void SetStatisticsShards(std::vector<const SearchServer*> shards);
 
 private:
+
     static bool IsValidWord(std::string_view word);
     int ComputeAverageRating(const std::vector<int>& ratings);
 
@@ -186,103 +423,816 @@ private:
 
     double ComputeWordInverseDocumentFreq(std::string_view word) const;
 
+    CollectionStatistics GetCollectionStatistics() const;
+
+    // Number of documents having the word in all statistics shards, local_count without them
+    size_t GetTermDocumentCount(std::string_view word, size_t local_count) const;
+
+    // Non-stop words of a quoted phrase with their offsets from the opening quote,
+    // stop words are skipped but keep their place
+    struct Phrase {
+        std::vector<std::string_view> words;
+        std::vector<uint32_t> offsets;
+        uint32_t slop = 0;
+    };
+
     struct Query {
         std::set<std::string_view> plus_words;
         std::set<std::string_view> minus_words;
+        std::set<std::string_view> required_words; // +word, every document must have them, they are plus words as well
+        std::vector<Phrase> phrases; // phrase words are plus and required words as well
+        std::map<std::string_view, double> word_weights; // of fuzzy matched plus words, the others weigh 1
+        const CancellationToken* cancellation = nullptr; // checked by postings scans
     };
 
+    // Scans check the cancellation token of the query every CANCELLATION_CHECK_INTERVAL postings.
+    // Parallel scans only stop at the check, the error is thrown once they are joined
+    static constexpr size_t CANCELLATION_CHECK_INTERVAL = 4096;
+
+    size_t EstimateQueryCost(const Query& query) const;
+    void PruneQuery(Query& query, size_t max_query_cost) const;
+    Query GetPrunedQuery(const ParsedQuery& query, size_t max_query_cost, const CancellationToken& cancellation) const;
+
+    static bool IsCancelled(const Query& query);
+    static void ThrowIfCancelled(const Query& query);
+
+    template <typename DocumentPredicate, typename Ranking>
+    std::vector<Document> FindTopDocumentsForQuery(const Query& query, DocumentPredicate document_predicate, const Ranking& ranking) const {
+        if constexpr (std::is_same_v<Ranking, TfIdfRanking>) {
+            if (CanUseImpactOrderedPostings(query)) {
+                return FindTopDocumentsByImpact(query, document_predicate);
+            }
+        }
+
+        auto matched_documents = FindAllDocuments(std::execution::seq, query, document_predicate, ranking);
+
+        {
+            METRICS_PHASE(TOP_K);
+
+            std::sort(matched_documents.begin(), matched_documents.end(), IsRankedHigher);
+
+            if (matched_documents.size() > MAX_RESULT_DOCUMENT_COUNT) {
+                matched_documents.resize(MAX_RESULT_DOCUMENT_COUNT);
+            }
+        }
+
+        return matched_documents;
+    }
+
     struct QueryWord {
         std::string_view data;
         bool is_minus;
+        bool is_required;
+        bool is_prefix; // comp*, data holds the prefix without '*'
         bool is_stop;
     };
 
+    template <typename WordContainer>
+    int FindDocumentWithSameWords(uint64_t fingerprint, const WordContainer& words) const {
+        const auto it_bucket = fingerprint_to_document_ids_.find(fingerprint);
+
+        if (it_bucket == fingerprint_to_document_ids_.end()) {
+            return -1;
+        }
+
+        for (const int document_id : it_bucket->second) {
+            const auto word_freqs = GetWordFrequencies(document_id);
+
+            // equal fingerprints are compared word by word to survive hash collisions
+            if (std::equal(word_freqs.begin(), word_freqs.end(), words.begin(), words.end(),
+                           [](const auto& lhs, const auto& rhs) {
+                               if constexpr (std::is_convertible_v<decltype(rhs), std::string_view>) {
+                                   return lhs.first == rhs;
+                               } else {
+                                   return lhs.first == rhs.first;
+                               }
+                           })) {
+                return document_id;
+            }
+        }
+
+        return -1;
+    }
+
+    uint32_t GetTermId(std::string_view word);
+
+    // The dictionary is built on first use. Words added after it go to new_terms_, which
+    // searches of the dictionary read as well, and the dictionary is rebuilt with them by
+    // the AddDocument after which new_terms_ hold 1/MAX_NEW_TERM_SHARE of its size
+    std::shared_ptr<const TermDictionary> GetTermDictionary() const;
+    void RebuildTermDictionary();
+
+    // Ids of at most count terms starting with prefix, the most frequent first
+    std::vector<uint32_t> FindTopTermsWithPrefix(std::string_view prefix, size_t count) const;
+
+    // Ids of the terms within max_edit_distance of word with their distances. The sorted
+    // dictionary is walked with the Levenshtein table of the current term prefix, and every
+    // prefix already too far from the word is skipped with all of its terms
+    std::vector<std::pair<uint32_t, int>> FindFuzzyTerms(std::string_view word, int max_edit_distance) const;
+
+    // The smallest char greater than last_char which keeps a prefix with the given Levenshtein
+    // row within max_edit_distance of word, -1 if there is none
+    static int FindNextFuzzyChar(std::string_view word, const int* row, int max_edit_distance, unsigned char last_char);
+
+    // The walk of FindFuzzyTerms over the sorted terms of the cursor
+    template <typename TermCursor>
+    static void FindFuzzyTermsWithCursor(TermCursor cursor, std::string_view word, int max_edit_distance, std::vector<std::pair<uint32_t, int>>& result);
+
+    void AddFuzzyWords(std::string_view word, Query& query) const;
+    static double GetWordWeight(const Query& query, std::string_view word);
+
+    void BuildForwardIndex();
+    void BuildCompactPostings();
+
+    // Dead ordinals still take slots of the arrays indexed by ordinal and of the FLOAT
+    // scans, so once they outnumber the live ones the ordinals are compacted and
+    // everything indexed by them is rebuilt
+    void CompactOrdinalsIfMostlyDead();
+
+    void AddFingerprint(int document_id);
+    void EraseFingerprint(int document_id);
+
     QueryWord ParseQueryWord(std::string_view text) const;
     Query ParseQuery(std::string_view text) const;
+    size_t ParsePhrase(const std::vector<std::string_view>& words, size_t first, Query& query) const;
+
+    void AddDocumentPositions(size_t ordinal, std::string_view text);
+    void RemoveDocumentPositions(size_t ordinal, std::string_view text);
+
+    bool ContainsPhrase(const Phrase& phrase, uint32_t ordinal) const;
+    bool ContainsPhrases(const Query& query, uint32_t ordinal) const;
+
+    // Ascending ordinals of documents containing every phrase of the query
+    std::vector<uint32_t> FindPhraseOrdinals(const Query& query) const;
+    void FilterByPhrases(const Query& query, std::vector<Document>& documents) const;
 
+    // Documents having any of the minus words. Bitmaps of frequent minus words are cached
+    RoaringBitmap FindMinusWordDocuments(const Query& query) const;
+
+    // Whether the predicate is known to reject the document without looking it up, which
+    // is so for a document of another status when the predicate only checks the status
     template <typename DocumentPredicate>
-    std::vector<Document> FindAllDocuments(const Query& query, DocumentPredicate document_predicate) const {
-        return FindAllDocuments(std::execution::seq, query, document_predicate);
+    bool IsOfAnotherStatus(int document_id, const DocumentPredicate& document_predicate) const {
+        if constexpr (std::is_same_v<DocumentPredicate, DocumentStatusPredicate>) {
+            return !status_to_document_ids_[static_cast<size_t>(document_predicate.status)].Contains(document_id);
+        } else {
+            return false;
+        }
     }
 
+    void AddToExclusionSets(int document_id, DocumentStatus status, const std::vector<std::string_view>& words);
+    void EraseFromExclusionSets(int document_id, DocumentStatus status);
+
+    bool CanUseImpactOrderedPostings(const Query& query) const;
+
+    // Threshold algorithm over impact-ordered postings: the lists of all plus words are
+    // read in rounds, every new document gets its full relevance from the postings maps.
+    // The best relevance an unseen document may have is the sum of the impact bounds of
+    // the cursors, once the top is full and ranked higher than that, the rest is skipped
     template <typename DocumentPredicate>
-    std::vector<Document> FindAllDocuments(const std::execution::sequenced_policy&, const Query& query, DocumentPredicate document_predicate) const {
-        std::map<int, double> document_to_relevance;
+    std::vector<Document> FindTopDocumentsByImpact(const Query& query, DocumentPredicate document_predicate) const {
+        constexpr double EPSILON = 1e-6;
+
+        const auto statistics = GetCollectionStatistics();
+        const TfIdfRanking ranking;
+
+        struct Cursor {
+            ImpactPostings::Cursor postings;
+            double inverse_document_freq;
+            const std::pmr::map<int, double>* document_freqs;
+        };
+
+        std::vector<Cursor> cursors;
 
         for (std::string_view word : query.plus_words) {
-            if (word_to_document_freqs_.count(word) == 0) {
-                continue;
+            const auto it_word = word_to_document_freqs_.find(word);
+
+            if (it_word != word_to_document_freqs_.end()) {
+                cursors.push_back({ impact_postings_.Get(term_ids_.at(word)),
+                                    ranking.ComputeTermWeight(statistics, GetTermDocumentCount(word, it_word->second.size())) * GetWordWeight(query, word), &it_word->second });
+            }
+        }
+
+        RoaringBitmap excluded_documents;
+
+        {
+            METRICS_PHASE(MINUS_WORDS);
+
+            excluded_documents = FindMinusWordDocuments(query);
+        }
+
+        METRICS_PHASE(POSTING_SCAN);
+
+        std::unordered_set<int> seen_document_ids;
+        std::vector<Document> top_documents;
+
+        for (size_t round = 1;; ++round) {
+            if (round % CANCELLATION_CHECK_INTERVAL == 0) {
+                ThrowIfCancelled(query);
             }
 
-            const double inverse_document_freq = ComputeWordInverseDocumentFreq(word);
+            bool is_advanced = false;
+
+            for (Cursor& cursor : cursors) {
+                if (!cursor.postings.IsValid()) {
+                    continue;
+                }
+
+                const int document_id = cursor.postings.GetDocumentId();
+                cursor.postings.Next();
+                is_advanced = true;
+
+                if (!seen_document_ids.insert(document_id).second || excluded_documents.Contains(document_id)
+                    || IsOfAnotherStatus(document_id, document_predicate)) {
+                    continue;
+                }
 
-            for (const auto& [document_id, term_freq] : word_to_document_freqs_.at(word)) {
                 const auto& document_data = documents_.at(document_id);
 
-                if (document_predicate(document_id, document_data.status, document_data.rating)) {
-                    document_to_relevance[document_id] += term_freq * inverse_document_freq;
+                if (!document_predicate(document_id, document_data.status, document_data.rating)) {
+                    continue;
+                }
+
+                double relevance = 0.0;
+
+                for (const Cursor& other : cursors) {
+                    const auto it = other.document_freqs->find(document_id);
+
+                    if (it != other.document_freqs->end()) {
+                        relevance += it->second * other.inverse_document_freq;
+                    }
+                }
+
+                const Document document{ document_id, relevance, document_data.rating };
+
+                if (top_documents.size() < MAX_RESULT_DOCUMENT_COUNT || IsRankedHigher(document, top_documents.back())) {
+                    top_documents.insert(std::upper_bound(top_documents.begin(), top_documents.end(), document, IsRankedHigher), document);
+
+                    if (top_documents.size() > MAX_RESULT_DOCUMENT_COUNT) {
+                        top_documents.pop_back();
+                    }
                 }
             }
+
+            if (!is_advanced) {
+                break;
+            }
+
+            double threshold = 0.0;
+
+            for (const Cursor& cursor : cursors) {
+                if (cursor.postings.IsValid()) {
+                    threshold += cursor.postings.GetMaxTermFreq() * cursor.inverse_document_freq;
+                }
+            }
+
+            // documents within EPSILON are ordered by rating, so the margin must be larger
+            if (top_documents.size() == MAX_RESULT_DOCUMENT_COUNT && top_documents.back().relevance - threshold >= 2 * EPSILON) {
+                break;
+            }
         }
 
-        for (std::string_view word : query.minus_words) {
-            if (word_to_document_freqs_.count(word) == 0) {
-                continue;
+        METRICS_COUNT(POSTINGS_SCANNED, seen_document_ids.size());
+        METRICS_COUNT(DOCUMENTS_SCORED, seen_document_ids.size());
+
+        return top_documents;
+    }
+
+    // Ascending ids of documents having every required word of the query
+    std::vector<int> FindDocumentsWithRequiredWords(const Query& query) const;
+
+    std::tuple<std::vector<std::string_view>, DocumentStatus> MatchQuery(const Query& query, int document_id) const;
+
+    template <typename ExecutionPolicy>
+    void EraseDocumentFromIndex(ExecutionPolicy&& policy, int document_id, size_t ordinal) {
+        total_word_count_ -= documents_.at(document_id).word_count;
+
+        EraseFromExclusionSets(document_id, documents_.at(document_id).status);
+
+        if (is_positional_index_enabled_) {
+            RemoveDocumentPositions(ordinal, documents_.at(document_id).text);
+        }
+
+        documents_.erase(document_id);
+
+        if (duplicate_policy_ != DuplicatePolicy::ALLOW) {
+            EraseFingerprint(document_id);
+        }
+
+        if (!is_forward_index_enabled_) {
+            for_each(policy,
+                     word_to_document_freqs_.begin(), word_to_document_freqs_.end(),
+                     [this, &document_id](auto& item) {
+                         const auto it = item.second.find(document_id);
+
+                         if (it == item.second.end()) {
+                             return;
+                         }
+
+                         if (is_impact_ordered_postings_enabled_) {
+                             impact_postings_.Remove(term_ids_.at(item.first), document_id, it->second);
+                         }
+
+                         --term_document_counts_[term_ids_.at(item.first)];
+                         item.second.erase(it);
+                     });
+
+            if (scoring_mode_ == ScoringMode::FLOAT) {
+                compact_postings_.RemoveFromAllTerms(static_cast<uint32_t>(ordinal));
             }
 
-            for (const auto [document_id, _] : word_to_document_freqs_.at(word)) {
-                document_to_relevance.erase(document_id);
+            for (auto it_word = word_to_document_freqs_.begin(); it_word != word_to_document_freqs_.end();) {
+                it_word = it_word->second.empty() ? word_to_document_freqs_.erase(it_word) : std::next(it_word);
             }
+
+            return;
         }
 
+        const auto word_freqs = forward_index_.Get(ordinal, term_words_.data());
+
+        // only postings of the document's own words refer to it, and every word
+        // owns a separate postings map, so they can be cleaned in parallel
+        std::for_each(policy,
+                 word_freqs.begin(), word_freqs.end(),
+                 [this, document_id, ordinal](const auto& item) {
+                     word_to_document_freqs_.find(item.first)->second.erase(document_id);
+                     --term_document_counts_[term_ids_.at(item.first)];
+
+                     if (scoring_mode_ == ScoringMode::FLOAT) {
+                         compact_postings_.Remove(term_ids_.at(item.first), static_cast<uint32_t>(ordinal));
+                     }
+
+                     if (is_impact_ordered_postings_enabled_) {
+                         impact_postings_.Remove(term_ids_.at(item.first), document_id, item.second);
+                     }
+                 });
+
+        // if exist clear all keys with empty map ids_freqs in word_to_document_freqs_
+        for (const auto& [word, _] : word_freqs) {
+            const auto it_word = word_to_document_freqs_.find(word);
+
+            if (it_word->second.empty()) {
+                word_to_document_freqs_.erase(it_word);
+            }
+        }
+
+        forward_index_.Remove(ordinal);
+    }
+
+    template <typename DocumentPredicate, typename Ranking>
+    std::vector<Document> FindAllDocuments(const std::execution::sequenced_policy&, const Query& query, DocumentPredicate document_predicate,
+                                           const Ranking& ranking, QueryProfile* profile = nullptr) const {
+        if (!query.required_words.empty()) {
+            return FindAllDocumentsConjunctive(std::execution::seq, query, document_predicate, ranking, profile);
+        }
+
+        if (scoring_mode_ == ScoringMode::FLOAT) {
+            return FindAllDocumentsCompact(std::execution::seq, query, document_predicate, ranking, profile);
+        }
+
+        const auto minus_words_start = profile ? std::chrono::steady_clock::now() : std::chrono::steady_clock::time_point{};
+
+        RoaringBitmap excluded_documents;
+
+        {
+            METRICS_PHASE(MINUS_WORDS);
+
+            excluded_documents = FindMinusWordDocuments(query);
+        }
+
+        const auto scan_start = profile ? std::chrono::steady_clock::now() : std::chrono::steady_clock::time_point{};
+
+        const auto statistics = GetCollectionStatistics();
+
+        std::map<int, double> document_to_relevance;
+
+        // filled for the profile only, a document is counted once whatever number of its words matched
+        std::set<int> minus_word_document_ids;
+        std::set<int> filtered_document_ids;
+
+        {
+            METRICS_PHASE(POSTING_SCAN);
+
+            size_t posting_count = 0;
+
+            for (std::string_view word : query.plus_words) {
+                if (word_to_document_freqs_.count(word) == 0) {
+                    continue;
+                }
+
+                const auto& document_freqs = word_to_document_freqs_.at(word);
+                const double term_weight = ranking.ComputeTermWeight(statistics, GetTermDocumentCount(word, document_freqs.size())) * GetWordWeight(query, word);
+
+                METRICS_COUNT(POSTINGS_SCANNED, document_freqs.size());
+
+                for (const auto& [document_id, term_freq] : document_freqs) {
+                    if (++posting_count % CANCELLATION_CHECK_INTERVAL == 0) {
+                        ThrowIfCancelled(query);
+                    }
+
+                    if (excluded_documents.Contains(document_id)) {
+                        if (profile) {
+                            const auto& document_data = documents_.at(document_id);
+
+                            if (document_predicate(document_id, document_data.status, document_data.rating)) {
+                                minus_word_document_ids.insert(document_id);
+                            } else {
+                                filtered_document_ids.insert(document_id);
+                            }
+                        }
+
+                        continue;
+                    }
+
+                    if (IsOfAnotherStatus(document_id, document_predicate)) {
+                        if (profile) {
+                            filtered_document_ids.insert(document_id);
+                        }
+
+                        continue;
+                    }
+
+                    const auto& document_data = documents_.at(document_id);
+
+                    if (document_predicate(document_id, document_data.status, document_data.rating)) {
+                        document_to_relevance[document_id] += ranking.ComputeScore(term_weight, term_freq, double(document_data.word_count),
+                                                                                   statistics.average_document_length);
+                    } else if (profile) {
+                        filtered_document_ids.insert(document_id);
+                    }
+                }
+            }
+        }
+
+        METRICS_COUNT(DOCUMENTS_SCORED, document_to_relevance.size());
+
         std::vector<Document> matched_documents;
 
         for (const auto [document_id, relevance] : document_to_relevance) {
             matched_documents.push_back({ document_id, relevance, documents_.at(document_id).rating });
         }
 
+        FilterByPhrases(query, matched_documents);
+
+        if (profile) {
+            profile->documents_filtered = filtered_document_ids.size();
+            profile->documents_excluded = minus_word_document_ids.size();
+            profile->documents_scored = document_to_relevance.size() + profile->documents_excluded;
+            profile->minus_words_time = scan_start - minus_words_start;
+            profile->scan_time = std::chrono::steady_clock::now() - scan_start;
+        }
+
         return matched_documents;
     }
 
-    template <typename DocumentPredicate>
-    std::vector<Document> FindAllDocuments(const std::execution::parallel_policy&, const Query& query, DocumentPredicate document_predicate) const {
+    template <typename DocumentPredicate, typename Ranking>
+    std::vector<Document> FindAllDocuments(const std::execution::parallel_policy&, const Query& query, DocumentPredicate document_predicate,
+                                           const Ranking& ranking, QueryProfile* profile = nullptr) const {
+        if (!query.required_words.empty()) {
+            return FindAllDocumentsConjunctive(std::execution::par, query, document_predicate, ranking, profile);
+        }
+
+        if (scoring_mode_ == ScoringMode::FLOAT) {
+            return FindAllDocumentsCompact(std::execution::par, query, document_predicate, ranking, profile);
+        }
+
+        const auto minus_words_start = profile ? std::chrono::steady_clock::now() : std::chrono::steady_clock::time_point{};
+
+        RoaringBitmap excluded_documents;
+
+        {
+            METRICS_PHASE(MINUS_WORDS);
+
+            excluded_documents = FindMinusWordDocuments(query);
+        }
+
+        const auto scan_start = profile ? std::chrono::steady_clock::now() : std::chrono::steady_clock::time_point{};
+
+        const auto statistics = GetCollectionStatistics();
+
         constexpr size_t THREAD_COUNT = 97;
         ConcurrentMap<int, double> mt_document_to_relevance(THREAD_COUNT);
 
+        // filled for the profile only
+        ConcurrentMap<int, double> mt_minus_word_document_ids(THREAD_COUNT);
+        ConcurrentMap<int, double> mt_filtered_document_ids(THREAD_COUNT);
+
         for_each(std::execution::par, query.plus_words.begin(), query.plus_words.end(),
-                 [this, &document_predicate, &mt_document_to_relevance](std::string_view word) {
+                 [&](std::string_view word) {
+                     METRICS_PHASE(POSTING_SCAN);
+
                      if (word_to_document_freqs_.count(word) == 0) {
                          return;
                      }
 
-                     const double inverse_document_freq = ComputeWordInverseDocumentFreq(word);
+                     const auto& document_freqs = word_to_document_freqs_.at(word);
+                     const double term_weight = ranking.ComputeTermWeight(statistics, GetTermDocumentCount(word, document_freqs.size())) * GetWordWeight(query, word);
+
+                     METRICS_COUNT(POSTINGS_SCANNED, document_freqs.size());
+
+                     size_t posting_count = 0;
+
+                     for (const auto& [document_id, term_freq] : document_freqs) {
+                         if (++posting_count % CANCELLATION_CHECK_INTERVAL == 0 && IsCancelled(query)) {
+                             break;
+                         }
+
+                         if (excluded_documents.Contains(document_id)) {
+                             if (profile) {
+                                 const auto& document_data = documents_.at(document_id);
+
+                                 if (document_predicate(document_id, document_data.status, document_data.rating)) {
+                                     mt_minus_word_document_ids[document_id];
+                                 } else {
+                                     mt_filtered_document_ids[document_id];
+                                 }
+                             }
 
-                     for (const auto& [document_id, term_freq] : word_to_document_freqs_.at(word)) {
+                             continue;
+                         }
+
+                         if (IsOfAnotherStatus(document_id, document_predicate)) {
+                             if (profile) {
+                                 mt_filtered_document_ids[document_id];
+                             }
+
+                             continue;
+                         }
 
                          const auto& document_data = documents_.at(document_id);
                          if (document_predicate(document_id, document_data.status, document_data.rating)) {
-                             mt_document_to_relevance[document_id].ref_to_value += term_freq * inverse_document_freq;
+                             mt_document_to_relevance[document_id].ref_to_value += ranking.ComputeScore(term_weight, term_freq, double(document_data.word_count),
+                                                                                                        statistics.average_document_length);
+                         } else if (profile) {
+                             mt_filtered_document_ids[document_id];
                          }
                      }
                  });
 
+        ThrowIfCancelled(query);
+
         std::map<int, double>
             document_to_relevance(mt_document_to_relevance.BuildOrdinaryMap());
 
+        METRICS_COUNT(DOCUMENTS_SCORED, document_to_relevance.size());
+
+        std::vector<Document> matched_documents;
+
+        for (const auto [document_id, relevance] : document_to_relevance) {
+            matched_documents.push_back({ document_id, relevance, documents_.at(document_id).rating });
+        }
+
+        FilterByPhrases(query, matched_documents);
+
+        if (profile) {
+            profile->documents_filtered = mt_filtered_document_ids.BuildOrdinaryMap().size();
+            profile->documents_excluded = mt_minus_word_document_ids.BuildOrdinaryMap().size();
+            profile->documents_scored = document_to_relevance.size() + profile->documents_excluded;
+            profile->minus_words_time = scan_start - minus_words_start;
+            profile->scan_time = std::chrono::steady_clock::now() - scan_start;
+        }
+
+        return matched_documents;
+    }
+
+    // Scores into the float score buffer of the thread, indexed by ordinal. par splits the
+    // ordinal range into chunks, each chunk is scored whole by one thread
+    template <typename ExecutionPolicy, typename DocumentPredicate, typename Ranking>
+    std::vector<Document> FindAllDocumentsCompact(ExecutionPolicy&& policy, const Query& query, DocumentPredicate document_predicate,
+                                                  const Ranking& ranking, QueryProfile* profile) const {
+        const auto scan_start = profile ? std::chrono::steady_clock::now() : std::chrono::steady_clock::time_point{};
+
+        const auto statistics = GetCollectionStatistics();
+        const float average_document_length = static_cast<float>(statistics.average_document_length);
+
+        struct ScoredTerm {
+            CompactPostings::TermPostings postings;
+            float term_weight;
+        };
+
+        std::vector<ScoredTerm> plus_terms;
+        std::vector<CompactPostings::TermPostings> minus_terms;
+
+        for (std::string_view word : query.plus_words) {
+            if (word_to_document_freqs_.count(word) == 0) {
+                continue;
+            }
+
+            const size_t term_document_count = word_to_document_freqs_.at(word).size();
+
+            METRICS_COUNT(POSTINGS_SCANNED, term_document_count);
+
+            plus_terms.push_back({ compact_postings_.Get(term_ids_.at(word)),
+                                   static_cast<float>(ranking.ComputeTermWeight(statistics, GetTermDocumentCount(word, term_document_count)) * GetWordWeight(query, word)) });
+        }
+
         for (std::string_view word : query.minus_words) {
             if (word_to_document_freqs_.count(word) == 0) {
                 continue;
             }
 
-            for (const auto [document_id, _] : word_to_document_freqs_.at(word)) {
-                document_to_relevance.erase(document_id);
+            METRICS_COUNT(MINUS_POSTINGS_SCANNED, word_to_document_freqs_.at(word).size());
+
+            minus_terms.push_back(compact_postings_.Get(term_ids_.at(word)));
+        }
+
+        const uint32_t ordinal_count = static_cast<uint32_t>(document_ids_.GetOrdinalCount());
+
+        constexpr uint32_t MIN_CHUNK_SIZE = 4096;
+        const bool is_parallel = std::is_same_v<std::decay_t<ExecutionPolicy>, std::execution::parallel_policy>;
+        const uint32_t chunk_count = is_parallel ? std::max(1u, std::min(ordinal_count / MIN_CHUNK_SIZE, 64u)) : 1u;
+
+        std::vector<std::vector<Document>> chunk_documents(chunk_count);
+        std::vector<uint32_t> chunks(chunk_count);
+        std::iota(chunks.begin(), chunks.end(), 0u);
+
+        std::atomic<size_t> documents_filtered = 0;
+        std::atomic<size_t> documents_excluded = 0;
+
+        std::for_each(policy, chunks.begin(), chunks.end(), [&](uint32_t chunk) {
+            const uint32_t begin = static_cast<uint32_t>(uint64_t(ordinal_count) * chunk / chunk_count);
+            const uint32_t end = static_cast<uint32_t>(uint64_t(ordinal_count) * (chunk + 1) / chunk_count);
+
+            // a zero idf still makes a match, so matched documents are marked separately
+            auto& buffer = CompactPostings::GetThreadScoreBuffer();
+            buffer.Reset(ordinal_count);
+
+            {
+                METRICS_PHASE(POSTING_SCAN);
+
+                for (const ScoredTerm& term : plus_terms) {
+                    if (!compact_postings_.Accumulate(term.postings, ranking, term.term_weight, average_document_length,
+                                                      buffer, begin, end,
+                                                      query.cancellation, CANCELLATION_CHECK_INTERVAL)) {
+                        return;
+                    }
+                }
+            }
+
+            {
+                METRICS_PHASE(MINUS_WORDS);
+
+                for (const auto& postings : minus_terms) {
+                    CompactPostings::Exclude(postings, buffer, begin, end);
+                }
+            }
+
+            size_t chunk_filtered = 0;
+            size_t chunk_excluded = 0;
+            auto& documents = chunk_documents[chunk];
+
+            // the predicate is checked for the excluded documents as well when they are profiled,
+            // so both counts mean the same as in the other scans
+            buffer.ForEachTouched(begin, end, [&](uint32_t ordinal) {
+                const bool is_excluded = buffer.IsExcluded(ordinal);
+
+                if (is_excluded && !profile) {
+                    return;
+                }
+
+                const int document_id = document_ids_.GetDocumentId(ordinal);
+                const auto& document_data = documents_.at(document_id);
+
+                if (!document_predicate(document_id, document_data.status, document_data.rating)) {
+                    ++chunk_filtered;
+                } else if (is_excluded) {
+                    ++chunk_excluded;
+                } else {
+                    documents.push_back({ document_id, buffer.GetScore(ordinal), document_data.rating });
+                }
+            });
+
+            documents_filtered.fetch_add(chunk_filtered, std::memory_order_relaxed);
+            documents_excluded.fetch_add(chunk_excluded, std::memory_order_relaxed);
+        });
+
+        ThrowIfCancelled(query);
+
+        std::vector<Document> matched_documents;
+
+        for (auto& documents : chunk_documents) {
+            matched_documents.insert(matched_documents.end(), documents.begin(), documents.end());
+        }
+
+        const size_t scored_count = matched_documents.size();
+
+        METRICS_COUNT(DOCUMENTS_SCORED, scored_count);
+
+        FilterByPhrases(query, matched_documents);
+
+        if (profile) {
+            // minus words are applied per chunk inside the scan, so their time is included in scan_time
+            profile->documents_filtered = documents_filtered.load();
+            profile->documents_excluded = documents_excluded.load();
+            profile->documents_scored = scored_count + profile->documents_excluded;
+            profile->scan_time = std::chrono::steady_clock::now() - scan_start;
+        }
+
+        return matched_documents;
+    }
+
+    // Scores only the documents having every required word. They are found first by
+    // intersecting postings of the required words, the rest of the postings are probed
+    // for these documents only
+    template <typename ExecutionPolicy, typename DocumentPredicate, typename Ranking>
+    std::vector<Document> FindAllDocumentsConjunctive(ExecutionPolicy&& policy, const Query& query, DocumentPredicate document_predicate,
+                                                      const Ranking& ranking, QueryProfile* profile) const {
+        const auto scan_start = profile ? std::chrono::steady_clock::now() : std::chrono::steady_clock::time_point{};
+
+        const auto statistics = GetCollectionStatistics();
+
+        std::vector<int> candidate_ids;
+
+        {
+            METRICS_PHASE(POSTING_SCAN);
+
+            candidate_ids = FindDocumentsWithRequiredWords(query);
+        }
+
+        struct ScoredWord {
+            const std::pmr::map<int, double>* document_freqs;
+            double term_weight;
+        };
+
+        std::vector<ScoredWord> plus_words;
+
+        for (std::string_view word : query.plus_words) {
+            const auto it_word = word_to_document_freqs_.find(word);
+
+            if (it_word != word_to_document_freqs_.end()) {
+                plus_words.push_back({ &it_word->second, ranking.ComputeTermWeight(statistics, GetTermDocumentCount(word, it_word->second.size())) * GetWordWeight(query, word) });
             }
         }
 
+        const RoaringBitmap minus_documents = FindMinusWordDocuments(query);
+
+        METRICS_COUNT(POSTINGS_SCANNED, candidate_ids.size() * plus_words.size());
+
+        // 0 - matched, 1 - filtered by the predicate, 2 - excluded by a minus word
+        std::vector<Document> scored_documents(candidate_ids.size());
+        std::vector<uint8_t> outcomes(candidate_ids.size());
+
+        std::vector<size_t> indexes(candidate_ids.size());
+        std::iota(indexes.begin(), indexes.end(), size_t{ 0 });
+
+        std::atomic<bool> is_cancelled = false;
+
+        // every candidate writes only its own slots
+        std::for_each(policy, indexes.begin(), indexes.end(), [&](size_t index) {
+            if (index % CANCELLATION_CHECK_INTERVAL == 0 && IsCancelled(query)) {
+                is_cancelled.store(true, std::memory_order_relaxed);
+            }
+
+            if (is_cancelled.load(std::memory_order_relaxed)) {
+                return;
+            }
+
+            const int document_id = candidate_ids[index];
+            const auto& document_data = documents_.at(document_id);
+
+            if (!document_predicate(document_id, document_data.status, document_data.rating)) {
+                outcomes[index] = 1;
+                return;
+            }
+
+            if (minus_documents.Contains(document_id)) {
+                outcomes[index] = 2;
+                return;
+            }
+
+            double relevance = 0.0;
+
+            for (const auto& [document_freqs, term_weight] : plus_words) {
+                const auto it = document_freqs->find(document_id);
+
+                if (it != document_freqs->end()) {
+                    relevance += ranking.ComputeScore(term_weight, it->second, double(document_data.word_count),
+                                                      statistics.average_document_length);
+                }
+            }
+
+            scored_documents[index] = { document_id, relevance, document_data.rating };
+        });
+
+        ThrowIfCancelled(query);
+
         std::vector<Document> matched_documents;
 
-        for (const auto [document_id, relevance] : document_to_relevance) {
-            matched_documents.push_back({ document_id, relevance, documents_.at(document_id).rating });
+        for (size_t i = 0; i < scored_documents.size(); ++i) {
+            if (outcomes[i] == 0) {
+                matched_documents.push_back(scored_documents[i]);
+            }
+        }
+
+        FilterByPhrases(query, matched_documents);
+
+        METRICS_COUNT(DOCUMENTS_SCORED, candidate_ids.size());
+
+        if (profile) {
+            profile->documents_filtered = std::count(outcomes.begin(), outcomes.end(), 1);
+            profile->documents_excluded = std::count(outcomes.begin(), outcomes.end(), 2);
+            profile->documents_scored = candidate_ids.size() - profile->documents_filtered;
+            profile->scan_time = std::chrono::steady_clock::now() - scan_start;
         }
 
         return matched_documents;
@@ -291,15 +1241,95 @@ private:
 private:
     const std::set<std::string, std::less<>> stop_words_;
 
-    std::unordered_set<std::string> all_words;
+    // All index nodes and words are allocated from size-class pools owned by the server,
+    // so they are packed together and freed in bulk. The resource is synchronized because
+    // parallel RemoveDocument erases from different postings maps at once.
+    // Must be declared before the containers using it
+    std::pmr::synchronized_pool_resource index_resource_;
+
+    // word storage, the deque never moves its strings, so views into them stay valid
+    std::pmr::deque<std::pmr::string> all_words{ &index_resource_ };
+
+    std::pmr::vector<std::string_view> term_words_{ &index_resource_ };
+
+    std::pmr::unordered_map<std::string_view, uint32_t> term_ids_{ &index_resource_ };
+
+    std::pmr::map<std::string_view, std::pmr::map<int, double>> word_to_document_freqs_{ &index_resource_ };
+
+    // number of documents having the term, by term id
+    std::pmr::vector<uint32_t> term_document_counts_{ &index_resource_ };
 
-    std::map<std::string_view, std::map<int, double>> word_to_document_freqs_;
+    // A query word comp* expands to at most MAX_PREFIX_EXPANSION_COUNT most frequent words
+    static constexpr size_t MAX_PREFIX_EXPANSION_COUNT = 64;
 
-    std::map<int, std::map<std::string_view, double, std::less<>>> documentId_to_word_freqs_;
+    // A fuzzy matched word expands to at most MAX_FUZZY_EXPANSION_COUNT closest words
+    static constexpr size_t MAX_FUZZY_EXPANSION_COUNT = 16;
+    static constexpr std::array<double, 3> FUZZY_WORD_WEIGHTS = { 1.0, 0.5, 0.25 };
 
-    std::map<int, DocumentData> documents_;
+    int max_edit_distance_ = 0;
+
+    mutable std::mutex term_dictionary_mutex_;
+    mutable std::shared_ptr<TermDictionary> term_dictionary_; // its values are the term document counts
+
+    // words added after the dictionary was built, by word
+    std::map<std::string_view, uint32_t> new_terms_;
+
+    static constexpr size_t MIN_NEW_TERMS_TO_REBUILD = 4096;
+    static constexpr size_t MAX_NEW_TERM_SHARE = 8;
+
+    ForwardIndex forward_index_{ &index_resource_ };
+
+    bool is_forward_index_enabled_ = true;
+
+    PositionalIndex positional_index_{ &index_resource_ };
+
+    bool is_positional_index_enabled_ = false;
+
+    CompactPostings compact_postings_{ &index_resource_ };
+
+    ImpactPostings impact_postings_{ &index_resource_ };
+
+    bool is_impact_ordered_postings_enabled_ = false;
+
+    ScoringMode scoring_mode_ = ScoringMode::DOUBLE;
+
+    std::pmr::map<int, DocumentData> documents_{ &index_resource_ };
+
+    DocumentOrdinals document_ids_{ &index_resource_ };
+
+    // Fewer dead ordinals are not worth rebuilding the indexes
+    static constexpr size_t MIN_DEAD_ORDINALS_TO_COMPACT = 1024;
+
+    size_t total_word_count_ = 0;
+
+    std::vector<const SearchServer*> statistics_shards_;
+
+    std::array<RoaringBitmap, 4> status_to_document_ids_;
+
+    // A minus word gets its bitmap cached when it has at least MIN_CACHED_MINUS_POSTINGS
+    // documents and is used MINUS_WORD_USES_TO_CACHE times. Cached bitmaps are kept up to
+    // date by AddDocument and RemoveDocument
+    static constexpr size_t MIN_CACHED_MINUS_POSTINGS = 64;
+    static constexpr uint32_t MINUS_WORD_USES_TO_CACHE = 2;
+    static constexpr size_t MAX_CACHED_MINUS_WORDS = 1024;
+
+    mutable std::mutex minus_word_cache_mutex_;
+    mutable std::unordered_map<std::string_view, RoaringBitmap> minus_word_bitmaps_;
+    mutable std::unordered_map<std::string_view, uint32_t> minus_word_uses_;
+
+    DuplicatePolicy duplicate_policy_ = DuplicatePolicy::ALLOW;
+
+    std::unordered_map<uint64_t, std::vector<int>> fingerprint_to_document_ids_;
+
+    std::map<int, int> duplicate_to_original_ids_;
+};
+
+class SearchServer::ParsedQuery {
+private:
+    friend class SearchServer;
 
-    std::list<int> document_ids_;
+    std::unique_ptr<const std::string> raw_query_; // words of the query point into it
+    Query query_;
 };
 
 void PrintMatchDocumentResult(int document_id, const std::vector<std::string_view>& words, DocumentStatus status);
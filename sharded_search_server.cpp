@@ -0,0 +1,63 @@
+#include "sharded_search_server.h"
+
+using namespace std;
+
+void ShardedSearchServer::AddDocument(int document_id, string_view document, DocumentStatus status, const vector<int>& ratings) {
+    // an id always goes to the same shard, which rejects it if it is already there
+    shards_[GetShardIndex(document_id)]->AddDocument(document_id, document, status, ratings);
+}
+
+void ShardedSearchServer::RemoveDocument(int document_id) {
+    shards_[GetShardIndex(document_id)]->RemoveDocument(document_id);
+}
+
+int ShardedSearchServer::GetDocumentCount() const {
+    int document_count = 0;
+
+    for (const auto& shard : shards_) {
+        document_count += shard->GetDocumentCount();
+    }
+
+    return document_count;
+}
+
+size_t ShardedSearchServer::GetShardCount() const {
+    return shards_.size();
+}
+
+size_t ShardedSearchServer::GetShardIndex(int document_id) const {
+    // consecutive ids are spread evenly by the Fibonacci hash
+    const uint64_t hash = static_cast<uint64_t>(static_cast<uint32_t>(document_id)) * 0x9E3779B97F4A7C15ull;
+
+    return static_cast<size_t>((hash >> 32) % shards_.size());
+}
+
+SearchServer& ShardedSearchServer::GetShard(size_t index) {
+    return *shards_.at(index);
+}
+
+const SearchServer& ShardedSearchServer::GetShard(size_t index) const {
+    return *shards_.at(index);
+}
+
+vector<Document> ShardedSearchServer::FindTopDocuments(string_view raw_query, DocumentStatus status) const {
+    return FindTopDocuments(raw_query, DocumentStatusPredicate{ status });
+}
+
+vector<Document> ShardedSearchServer::FindTopDocuments(string_view raw_query) const {
+    return FindTopDocuments(raw_query, DocumentStatus::ACTUAL);
+}
+
+tuple<vector<string_view>, DocumentStatus> ShardedSearchServer::MatchDocument(string_view raw_query, int document_id) const {
+    return shards_[GetShardIndex(document_id)]->MatchDocument(raw_query, document_id);
+}
+
+vector<Document> ShardedSearchServer::MergeTopDocuments(vector<Document> documents) {
+    // every shard has sent its own top, the best of them are the top of all documents
+    const size_t top_count = min(documents.size(), static_cast<size_t>(MAX_RESULT_DOCUMENT_COUNT));
+
+    partial_sort(documents.begin(), documents.begin() + top_count, documents.end(), SearchServer::IsRankedHigher);
+    documents.resize(top_count);
+
+    return documents;
+}
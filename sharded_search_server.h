@@ -0,0 +1,89 @@
+#pragma once
+
+#include "search_server.h"
+
+#include <future>
+#include <memory>
+#include <stdexcept>
+#include <string_view>
+#include <vector>
+
+// Splits documents between SearchServer shards by a hash of the document id. Queries go
+// to all shards at once and their top documents are merged. The shards share document and
+// word counts, so relevance is the same as in one SearchServer with all the documents.
+// Prefix and fuzzy words are expanded by every shard over its own words
+class ShardedSearchServer {
+public:
+    template <typename StopWords>
+    ShardedSearchServer(size_t shard_count, const StopWords& stop_words) {
+        if (shard_count == 0) {
+            throw std::invalid_argument("Shard count must be positive"s);
+        }
+
+        std::vector<const SearchServer*> shards;
+
+        for (size_t i = 0; i < shard_count; ++i) {
+            shards.push_back(shards_.emplace_back(std::make_unique<SearchServer>(stop_words)).get());
+        }
+
+        for (const auto& shard : shards_) {
+            shard->SetStatisticsShards(shards);
+        }
+    }
+
+    void AddDocument(int document_id, std::string_view document, DocumentStatus status, const std::vector<int>& ratings);
+    void RemoveDocument(int document_id);
+
+    int GetDocumentCount() const;
+
+    size_t GetShardCount() const;
+    size_t GetShardIndex(int document_id) const;
+
+    // Options like SetScoringMode are set on every shard
+    SearchServer& GetShard(size_t index);
+    const SearchServer& GetShard(size_t index) const;
+
+    template <typename DocumentPredicate, typename Ranking = TfIdfRanking>
+    std::vector<Document> FindTopDocuments(std::string_view raw_query, DocumentPredicate document_predicate,
+                                           const Ranking& ranking = {}) const {
+        // the calling thread searches the first shard, so a single shard costs no thread
+        std::vector<std::future<std::vector<Document>>> futures;
+        futures.reserve(shards_.size() - 1);
+
+        for (size_t i = 1; i < shards_.size(); ++i) {
+            futures.push_back(std::async(std::launch::async, [&, i] {
+                return shards_[i]->FindTopDocuments(std::execution::seq, raw_query, document_predicate, ranking);
+            }));
+        }
+
+        std::vector<Document> documents = shards_[0]->FindTopDocuments(std::execution::seq, raw_query, document_predicate, ranking);
+
+        // every future is waited for before the query arguments go out of scope
+        std::exception_ptr error;
+
+        for (auto& future : futures) {
+            try {
+                const auto shard_documents = future.get();
+                documents.insert(documents.end(), shard_documents.begin(), shard_documents.end());
+            } catch (...) {
+                error = std::current_exception();
+            }
+        }
+
+        if (error) {
+            std::rethrow_exception(error);
+        }
+
+        return MergeTopDocuments(std::move(documents));
+    }
+
+    std::vector<Document> FindTopDocuments(std::string_view raw_query, DocumentStatus status) const;
+    std::vector<Document> FindTopDocuments(std::string_view raw_query) const;
+
+    std::tuple<std::vector<std::string_view>, DocumentStatus> MatchDocument(std::string_view raw_query, int document_id) const;
+
+private:
+    static std::vector<Document> MergeTopDocuments(std::vector<Document> documents);
+
+    std::vector<std::unique_ptr<SearchServer>> shards_;
+};
@@ -0,0 +1,34 @@
+#pragma once
+
+#include <algorithm>
+#include <iterator>
+
+// lower_bound which probes 1, 2, 4... elements ahead of first before the binary search,
+// so it costs O(log d) where d is the distance to the result, not to the end of the range
+template <typename RandomIt, typename T>
+RandomIt GallopingLowerBound(RandomIt first, RandomIt last, const T& value) {
+    const auto distance = last - first;
+    decltype(last - first) bound = 1;
+
+    while (bound < distance && first[bound] < value) {
+        bound *= 2;
+    }
+
+    return std::lower_bound(first + bound / 2, first + std::min(bound + 1, distance), value);
+}
+
+// Writes the intersection of two ascending ranges to out. Every element of the first
+// range gallops in the second one, so the first range should be the shorter
+template <typename RandomIt1, typename RandomIt2, typename OutputIt>
+OutputIt GallopingIntersection(RandomIt1 first1, RandomIt1 last1, RandomIt2 first2, RandomIt2 last2, OutputIt out) {
+    for (; first1 != last1 && first2 != last2; ++first1) {
+        first2 = GallopingLowerBound(first2, last2, *first1);
+
+        if (first2 != last2 && !(*first1 < *first2)) {
+            *out++ = *first1;
+            ++first2;
+        }
+    }
+
+    return out;
+}
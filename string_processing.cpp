@@ -22,4 +22,16 @@ vector<string_view> SplitIntoWords(string_view str) {
     }
 
     return result;
+}
+
+// splitmix64 finalizer, spreads bits of std::hash well enough for fingerprints
+uint64_t MixHash(uint64_t x) {
+    x += 0x9e3779b97f4a7c15ull;
+    x = (x ^ (x >> 30)) * 0xbf58476d1ce4e5b9ull;
+    x = (x ^ (x >> 27)) * 0x94d049bb133111ebull;
+    return x ^ (x >> 31);
+}
+
+uint64_t HashWord(string_view word) {
+    return MixHash(hash<string_view>{}(word));
 }
\ No newline at end of file
@@ -1,11 +1,33 @@
 #pragma once
 
+#include <cstdint>
 #include <set>
 #include <string>
+#include <type_traits>
 #include <vector>
 
 std::vector<std::string_view> SplitIntoWords(std::string_view str);
 
+uint64_t MixHash(uint64_t x);
+uint64_t HashWord(std::string_view word);
+
+// Fingerprint of a sorted set of unique words: either plain words or (word, value) pairs.
+// Equal word sets always give equal fingerprints
+template <typename WordContainer>
+uint64_t ComputeWordSetFingerprint(const WordContainer& words) {
+    uint64_t fingerprint = MixHash(words.size());
+
+    for (const auto& item : words) {
+        if constexpr (std::is_convertible_v<decltype(item), std::string_view>) {
+            fingerprint = MixHash(fingerprint ^ HashWord(item));
+        } else {
+            fingerprint = MixHash(fingerprint ^ HashWord(item.first));
+        }
+    }
+
+    return fingerprint;
+}
+
 template <typename StringContainer>
 std::set<std::string, std::less<>> MakeUniqueNonEmptyStrings(StringContainer strings) {
     std::set<std::string, std::less<>> non_empty_strings;
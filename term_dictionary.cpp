@@ -0,0 +1,298 @@
+#include "term_dictionary.h"
+
+#include <algorithm>
+
+using namespace std;
+
+namespace {
+
+void AppendVarint(vector<char>& data, uint32_t value) {
+    while (value >= 0x80) {
+        data.push_back(static_cast<char>(value | 0x80));
+        value >>= 7;
+    }
+
+    data.push_back(static_cast<char>(value));
+}
+
+uint32_t ReadVarint(const char*& p) {
+    uint32_t value = 0;
+    int shift = 0;
+
+    while (true) {
+        const uint8_t byte = static_cast<uint8_t>(*p++);
+        value |= static_cast<uint32_t>(byte & 0x7f) << shift;
+
+        if ((byte & 0x80) == 0) {
+            return value;
+        }
+
+        shift += 7;
+    }
+}
+
+} // namespace
+
+TermDictionary::TermDictionary(const vector<pair<string_view, uint32_t>>& terms, const vector<uint32_t>& values) {
+    string_view previous;
+
+    for (size_t rank = 0; rank < terms.size(); ++rank) {
+        const string_view term = terms[rank].first;
+        const uint32_t term_id = terms[rank].second;
+        const uint32_t value = values.empty() ? UINT32_MAX : values.at(term_id);
+        size_t shared = 0;
+
+        if (rank % BLOCK_SIZE == 0) {
+            block_offsets_.push_back(static_cast<uint32_t>(data_.size()));
+            block_prefixes_.push_back(GetKeyPrefix(term));
+            block_max_values_.push_back(value);
+        } else {
+            block_max_values_.back() = max(block_max_values_.back(), value);
+
+            const size_t max_shared = min(previous.size(), term.size());
+
+            while (shared < max_shared && previous[shared] == term[shared]) {
+                ++shared;
+            }
+        }
+
+        AppendVarint(data_, static_cast<uint32_t>(shared));
+        AppendVarint(data_, static_cast<uint32_t>(term.size() - shared));
+        data_.insert(data_.end(), term.begin() + shared, term.end());
+
+        term_ids_.push_back(term_id);
+        previous = term;
+
+        if (term_id >= term_ranks_.size()) {
+            term_ranks_.resize(term_id + 1, UINT32_MAX);
+        }
+
+        term_ranks_[term_id] = static_cast<uint32_t>(rank);
+    }
+
+    data_.shrink_to_fit();
+}
+
+size_t TermDictionary::size() const {
+    return term_ids_.size();
+}
+
+uint64_t TermDictionary::GetKeyPrefix(string_view term) {
+    uint64_t prefix = 0;
+
+    for (size_t i = 0; i < sizeof(prefix); ++i) {
+        prefix = (prefix << 8) | (i < term.size() ? static_cast<unsigned char>(term[i]) : 0);
+    }
+
+    return prefix;
+}
+
+int TermDictionary::CompareBlockFirstTerm(size_t block, string_view key, uint64_t key_prefix) const {
+    if (block_prefixes_[block] != key_prefix) {
+        return block_prefixes_[block] < key_prefix ? -1 : 1;
+    }
+
+    return GetBlockFirstTerm(block).compare(key);
+}
+
+string_view TermDictionary::GetBlockFirstTerm(size_t block) const {
+    const char* p = data_.data() + block_offsets_[block];
+
+    ReadVarint(p); // shared prefix of the first term is always 0
+    const uint32_t size = ReadVarint(p);
+
+    return { p, size };
+}
+
+template <typename Callback>
+void TermDictionary::DecodeBlock(size_t block, Callback callback) const {
+    const char* p = data_.data() + block_offsets_[block];
+    const size_t first_rank = block * BLOCK_SIZE;
+    const size_t last_rank = min(first_rank + BLOCK_SIZE, term_ids_.size());
+
+    string term;
+
+    for (size_t rank = first_rank; rank < last_rank; ++rank) {
+        const uint32_t shared = ReadVarint(p);
+        const uint32_t suffix_size = ReadVarint(p);
+
+        term.resize(shared);
+        term.append(p, suffix_size);
+        p += suffix_size;
+
+        if (!callback(rank, string_view(term))) {
+            return;
+        }
+    }
+}
+
+size_t TermDictionary::LowerBound(string_view key) const {
+    // the last block starting with a term less than key holds the answer, unless it is past the block
+    const uint64_t key_prefix = GetKeyPrefix(key);
+    size_t first = 0;
+    size_t last = block_offsets_.size();
+
+    while (first < last) {
+        const size_t middle = first + (last - first) / 2;
+
+        if (CompareBlockFirstTerm(middle, key, key_prefix) < 0) {
+            first = middle + 1;
+        } else {
+            last = middle;
+        }
+    }
+
+    if (first == 0) {
+        return 0;
+    }
+
+    size_t result = min(first * BLOCK_SIZE, term_ids_.size());
+
+    DecodeBlock(first - 1, [&result, key](size_t rank, string_view term) {
+        if (term >= key) {
+            result = rank;
+            return false;
+        }
+
+        return true;
+    });
+
+    return result;
+}
+
+pair<size_t, size_t> TermDictionary::FindPrefixRange(string_view prefix) const {
+    const size_t first = LowerBound(prefix);
+    const string successor = GetPrefixSuccessor(prefix);
+
+    if (successor.empty()) {
+        return { first, term_ids_.size() };
+    }
+
+    return { first, LowerBound(successor) };
+}
+
+string TermDictionary::GetPrefixSuccessor(string_view prefix) {
+    string successor(prefix);
+
+    while (!successor.empty() && static_cast<unsigned char>(successor.back()) == 0xff) {
+        successor.pop_back();
+    }
+
+    if (!successor.empty()) {
+        ++successor.back();
+    }
+
+    return successor;
+}
+
+uint32_t TermDictionary::GetTermId(size_t rank) const {
+    return term_ids_.at(rank);
+}
+
+string TermDictionary::GetTerm(size_t rank) const {
+    string result;
+
+    DecodeBlock(rank / BLOCK_SIZE, [&result, rank](size_t term_rank, string_view term) {
+        if (term_rank == rank) {
+            result = string(term);
+            return false;
+        }
+
+        return true;
+    });
+
+    return result;
+}
+
+uint32_t TermDictionary::GetBlockMaxValue(size_t rank) const {
+    return block_max_values_.at(rank / BLOCK_SIZE);
+}
+
+size_t TermDictionary::GetBlockEnd(size_t rank) const {
+    return min((rank / BLOCK_SIZE + 1) * BLOCK_SIZE, term_ids_.size());
+}
+
+void TermDictionary::RaiseValue(uint32_t term_id, uint32_t value) {
+    if (term_id >= term_ranks_.size() || term_ranks_[term_id] == UINT32_MAX) {
+        return;
+    }
+
+    uint32_t& max_value = block_max_values_[term_ranks_[term_id] / BLOCK_SIZE];
+    max_value = max(max_value, value);
+}
+
+TermDictionary::Cursor::Cursor(const TermDictionary& dictionary)
+    : dictionary_(&dictionary) {
+    if (IsValid()) {
+        MoveToBlock(0);
+    }
+}
+
+bool TermDictionary::Cursor::IsValid() const {
+    return rank_ < dictionary_->size();
+}
+
+uint32_t TermDictionary::Cursor::GetTermId() const {
+    return dictionary_->term_ids_[rank_];
+}
+
+string_view TermDictionary::Cursor::GetTerm() const {
+    return term_;
+}
+
+void TermDictionary::Cursor::Next() {
+    if (++rank_ < dictionary_->size()) {
+        DecodeTerm();
+    }
+}
+
+void TermDictionary::Cursor::Seek(string_view key) {
+    if (!IsValid() || term_ >= key) {
+        return;
+    }
+
+    // gallop over the first terms of the next blocks to the last one not greater than key
+    const size_t block_count = dictionary_->block_offsets_.size();
+    size_t block = rank_ / BLOCK_SIZE;
+    const uint64_t key_prefix = GetKeyPrefix(key);
+    size_t step = 1;
+
+    while (block + step < block_count && dictionary_->CompareBlockFirstTerm(block + step, key, key_prefix) <= 0) {
+        block += step;
+        step *= 2;
+    }
+
+    for (step /= 2; step > 0; step /= 2) {
+        if (block + step < block_count && dictionary_->CompareBlockFirstTerm(block + step, key, key_prefix) <= 0) {
+            block += step;
+        }
+    }
+
+    if (block != rank_ / BLOCK_SIZE) {
+        MoveToBlock(block);
+    }
+
+    while (IsValid() && term_ < key) {
+        Next();
+    }
+}
+
+void TermDictionary::Cursor::MoveToBlock(size_t block) {
+    rank_ = block * BLOCK_SIZE;
+    data_ = dictionary_->data_.data() + dictionary_->block_offsets_[block];
+    DecodeTerm();
+}
+
+void TermDictionary::Cursor::DecodeTerm() {
+    const uint32_t shared = ReadVarint(data_);
+    const uint32_t suffix_size = ReadVarint(data_);
+
+    term_.resize(shared);
+    term_.append(data_, suffix_size);
+    data_ += suffix_size;
+}
+
+size_t TermDictionary::GetMemoryUsage() const {
+    return data_.capacity() + (block_offsets_.capacity() + term_ids_.capacity() + term_ranks_.capacity() + block_max_values_.capacity()) * sizeof(uint32_t)
+           + block_prefixes_.capacity() * sizeof(uint64_t);
+}
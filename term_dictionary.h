@@ -0,0 +1,93 @@
+#pragma once
+
+#include <cstdint>
+#include <string>
+#include <string_view>
+#include <utility>
+#include <vector>
+
+// Immutable sorted set of terms with their ids. Terms are front coded in blocks of
+// BLOCK_SIZE: the first term of a block is stored whole, every next one as the length
+// of the prefix shared with the previous term and the rest of it. Lookups binary search
+// the first terms of the blocks and decode a single block sequentially.
+//
+// Every block also keeps an upper bound of the values of its terms, such as document
+// counts, so searches for the terms with the largest values skip whole blocks.
+class TermDictionary {
+public:
+    TermDictionary() = default;
+
+    // terms must be sorted and unique, values are indexed by term id. Without values
+    // the bounds are never less than any value
+    explicit TermDictionary(const std::vector<std::pair<std::string_view, uint32_t>>& terms, const std::vector<uint32_t>& values = {});
+
+    size_t size() const;
+
+    // Rank of the first term not less than key
+    size_t LowerBound(std::string_view key) const;
+
+    // [first, last) ranks of the terms starting with prefix
+    std::pair<size_t, size_t> FindPrefixRange(std::string_view prefix) const;
+
+    uint32_t GetTermId(size_t rank) const;
+    std::string GetTerm(size_t rank) const;
+
+    // Upper bound of the values of the terms in the block of the rank, which ends at GetBlockEnd
+    uint32_t GetBlockMaxValue(size_t rank) const;
+    size_t GetBlockEnd(size_t rank) const;
+
+    // Keeps the bound of the term's block valid when its value grows, a value may only
+    // fall without it. Must not run concurrently with the searches
+    void RaiseValue(uint32_t term_id, uint32_t value);
+
+    // Reads the terms in order from the first one, decoding every block once
+    class Cursor {
+    public:
+        explicit Cursor(const TermDictionary& dictionary);
+
+        bool IsValid() const;
+        uint32_t GetTermId() const;
+        std::string_view GetTerm() const;
+
+        void Next();
+
+        // Moves forward to the first term not less than key
+        void Seek(std::string_view key);
+
+    private:
+        void MoveToBlock(size_t block);
+        void DecodeTerm();
+
+        const TermDictionary* dictionary_;
+        size_t rank_ = 0;
+        const char* data_ = nullptr;
+        std::string term_;
+    };
+
+    // The smallest string greater than all strings starting with prefix, empty if there is none
+    static std::string GetPrefixSuccessor(std::string_view prefix);
+
+    size_t GetMemoryUsage() const;
+
+private:
+    static constexpr size_t BLOCK_SIZE = 16;
+
+    // Calls callback(rank, term) for the terms of the block until it returns false
+    template <typename Callback>
+    void DecodeBlock(size_t block, Callback callback) const;
+
+    std::string_view GetBlockFirstTerm(size_t block) const;
+
+    // The first 8 bytes of a term as a big endian number, padded with zeros. Searches compare
+    // them first to stay in the small block_prefixes_ array
+    static uint64_t GetKeyPrefix(std::string_view term);
+
+    int CompareBlockFirstTerm(size_t block, std::string_view key, uint64_t key_prefix) const;
+
+    std::vector<char> data_;
+    std::vector<uint32_t> block_offsets_;
+    std::vector<uint64_t> block_prefixes_;
+    std::vector<uint32_t> term_ids_; // by rank
+    std::vector<uint32_t> term_ranks_; // by term id
+    std::vector<uint32_t> block_max_values_;
+};
@@ -1,5 +1,9 @@
 #include "test_example_functions.h"
 
+#include <csignal>
+
+#include <sys/resource.h>
+
 using namespace std;
 
 void AssertImpl(bool value, const string& expr_str, const string& file, const string& func, unsigned line,
@@ -427,6 +431,70 @@ void TestPaginator() {
     ASSERT_EQUAL(pages_count, 3);
 }
 
+void TestDeepPagination() {
+    SearchServer server("and with"s);
+
+    for (int id = 0; id < 12; ++id) {
+        server.AddDocument(id, "cat "s + string(id % 4 + 1, 'x') + " dog"s, DocumentStatus::ACTUAL, { id % 3 });
+    }
+
+    server.AddDocument(12, "cat dog"s, DocumentStatus::BANNED, { 1 });
+
+    // all ranked documents at once, no MAX_RESULT_DOCUMENT_COUNT cap
+    const auto all_documents = server.FindTopDocumentsPage("cat"s, 0, 100);
+    ASSERT_EQUAL(all_documents.size(), 12u);
+
+    constexpr size_t page_size = 5;
+
+    const auto last_page = server.FindTopDocumentsPage("cat"s, 2, page_size);
+    ASSERT_EQUAL(last_page.size(), 2u);
+    ASSERT_EQUAL(last_page[0].id, all_documents[10].id);
+    ASSERT_EQUAL(last_page[1].id, all_documents[11].id);
+
+    ASSERT(server.FindTopDocumentsPage("cat"s, 3, page_size).empty());
+
+    const auto banned = server.FindTopDocumentsPage("cat"s, [](int document_id, DocumentStatus status, int rating) {
+        return status == DocumentStatus::BANNED;
+    }, 0, page_size);
+    ASSERT_EQUAL(banned.size(), 1u);
+
+    // search-after pages and lazily requested pages give the same order
+    vector<int> ids_after;
+    auto page = server.FindTopDocumentsAfter("cat"s, all_documents[0], page_size);
+    ids_after.push_back(all_documents[0].id);
+
+    while (!page.empty()) {
+        for (const Document& document : page) {
+            ids_after.push_back(document.id);
+        }
+
+        page = server.FindTopDocumentsAfter("cat"s, page.back(), page_size);
+    }
+
+    vector<int> ids_lazy;
+    size_t pages_count = 0;
+    LazyPaginator pages([&server](size_t page_number) {
+        return server.FindTopDocumentsPage("cat"s, page_number, page_size);
+    });
+
+    for (const auto& lazy_page : pages) {
+        ++pages_count;
+
+        for (const Document& document : lazy_page) {
+            ids_lazy.push_back(document.id);
+        }
+    }
+
+    vector<int> ids_all;
+    for (const Document& document : all_documents) {
+        ids_all.push_back(document.id);
+    }
+
+    ASSERT_EQUAL(pages_count, 3u);
+    ASSERT_EQUAL(ids_after, ids_all);
+    ASSERT_EQUAL(ids_lazy, ids_all);
+}
+
 void TestRequestQueue() {
     SearchServer search_server("and on at"s);
     RequestQueue request_queue(search_server);
@@ -456,11 +524,62 @@ void TestRequestQueue() {
     ASSERT_EQUAL(request_queue.GetNoResultRequests(), 1437);
 }
 
+void TestRequestQueueMultiThread() {
+    SearchServer search_server("and on at"s);
+    RequestQueue request_queue(search_server);
+
+    search_server.AddDocument(1, "fluffy cat fluffy tail"s, DocumentStatus::ACTUAL, { 7, 2, 7 });
+    search_server.AddDocument(2, "fluffy dog and fancy collar"s, DocumentStatus::ACTUAL, { 1, 2, 3 });
+
+    // 600 empty requests and 400 requests with two documents each
+    vector<int> request_numbers(1000);
+    iota(request_numbers.begin(), request_numbers.end(), 0);
+
+    for_each(execution::par, request_numbers.begin(), request_numbers.end(), [&request_queue](int request_number) {
+        request_queue.AddFindRequest(request_number % 5 < 3 ? "empty request"s : "fluffy"s);
+    });
+
+    ASSERT_EQUAL(request_queue.GetNoResultRequests(), 600);
+
+    const auto statistics = request_queue.GetStatistics();
+    ASSERT_EQUAL(statistics.request_count, 1000u);
+    ASSERT_EQUAL(statistics.empty_result_count, 600u);
+    ASSERT_EQUAL(statistics.document_count, 800u);
+    ASSERT(InTheVicinity(statistics.GetEmptyResultRate(), 0.6, 1e-9));
+    ASSERT(statistics.max_latency >= statistics.GetAverageLatency());
+
+    // the first requests of a second race to reset its bucket, none of them may be lost
+    RequestStatistics request_statistics;
+    const auto now = RequestStatistics::Clock::now();
+
+    vector<int> record_numbers(20000);
+    iota(record_numbers.begin(), record_numbers.end(), 0);
+
+    for_each(execution::par, record_numbers.begin(), record_numbers.end(), [&request_statistics, now](int record_number) {
+        const auto finish = now - chrono::seconds(record_number % 4);
+        request_statistics.Record(finish - chrono::microseconds(10), finish, record_number % 2);
+    });
+
+    const auto snapshot = request_statistics.GetSnapshot();
+    ASSERT_EQUAL(snapshot.request_count, 20000u);
+    ASSERT_EQUAL(snapshot.empty_result_count, 10000u);
+    ASSERT_EQUAL(snapshot.document_count, 10000u);
+}
+
 // test from Oleg Tsoi
 bool InTheVicinity(const double d1, const double d2, const double delta) {
     return abs(d1 - d2) < delta;
 }
 
+void AssertSameDocuments(const vector<Document>& found, const vector<Document>& expected) {
+    ASSERT_EQUAL(found.size(), expected.size());
+
+    for (size_t i = 0; i < found.size(); ++i) {
+        ASSERT_EQUAL(found[i].id, expected[i].id);
+        ASSERT(InTheVicinity(found[i].relevance, expected[i].relevance, 1e-12));
+    }
+}
+
 void TestRemoveDocument() {
     SearchServer server("and with as"s);
 
@@ -556,230 +675,1758 @@ void TestRemoveDocument() {
 }
 
 
-void TestDuplicateDocumentsRemove() {
+void TestDocumentOrdinals() {
+    DocumentOrdinals ordinals(pmr::get_default_resource());
 
-    SearchServer search_server("and with"s);
+    ASSERT_EQUAL(ordinals.Add(10), 0u);
+    ASSERT_EQUAL(ordinals.Add(5), 1u);
+    ASSERT_EQUAL(ordinals.Add(7), 2u);
 
-    AddDocument(search_server, 1, "funny pet and nasty rat"s, DocumentStatus::ACTUAL, { 7, 2, 7 });
+    ASSERT(ordinals.Remove(5));
+    ASSERT(!ordinals.Remove(5));
+    ASSERT(!ordinals.Contains(5));
+    ASSERT(!ordinals.IsLive(1));
+    ASSERT_EQUAL(ordinals.Find(5), DocumentOrdinals::NO_ORDINAL);
 
-    AddDocument(search_server, 2, "funny pet with curly hair"s, DocumentStatus::ACTUAL, { 1, 2 });
+    // a removed id gets a new ordinal, old ordinals never move
+    ASSERT_EQUAL(ordinals.Add(5), 3u);
+    ASSERT_EQUAL(ordinals.Find(7), 2u);
+    ASSERT_EQUAL(ordinals.GetDocumentId(3), 5);
 
-    // is a duplicate of document 2
-    AddDocument(search_server, 3, "funny pet with curly hair"s, DocumentStatus::ACTUAL, { 1, 2 });
+    ASSERT_EQUAL(ordinals.size(), 3u);
+    ASSERT_EQUAL(ordinals.GetOrdinalCount(), 4u);
+    ASSERT_EQUAL(vector<int>(ordinals.begin(), ordinals.end()), vector<int>({ 10, 7, 5 }));
 
-    // difference only in stop words => is a duplicate
-    AddDocument(search_server, 4, "funny pet and curly hair"s, DocumentStatus::ACTUAL, { 1, 2 });
+    SearchServer server(""s);
+    server.AddDocument(3, "white cat"s, DocumentStatus::ACTUAL, { 1 });
+    server.AddDocument(1, "black cat"s, DocumentStatus::ACTUAL, { 1 });
+    server.RemoveDocument(3);
+    server.AddDocument(3, "grey cat"s, DocumentStatus::ACTUAL, { 1 });
+
+    // iteration follows the order of addition
+    ASSERT_EQUAL(vector<int>(server.begin(), server.end()), vector<int>({ 1, 3 }));
+    ASSERT_EQUAL(server.FindTopDocuments("cat"s).size(), 2u);
+
+    // compaction keeps the order and frees the dead ordinals
+    ordinals.Compact();
+    ASSERT_EQUAL(ordinals.GetOrdinalCount(), 3u);
+    ASSERT_EQUAL(ordinals.GetDeadCount(), 0u);
+    ASSERT_EQUAL(ordinals.Find(10), 0u);
+    ASSERT_EQUAL(ordinals.Find(7), 1u);
+    ASSERT_EQUAL(ordinals.Find(5), 2u);
+    ASSERT_EQUAL(vector<int>(ordinals.begin(), ordinals.end()), vector<int>({ 10, 7, 5 }));
+    ASSERT_EQUAL(ordinals.Add(8), 3u);
+
+    // a server replacing its documents over and over keeps its ordinal arrays small
+    SearchServer churn_server(""s);
+    churn_server.SetPositionalIndexEnabled(true);
+    churn_server.SetScoringMode(ScoringMode::FLOAT);
+
+    for (int id = 0; id < 100; ++id) {
+        churn_server.AddDocument(id, "white cat "s + to_string(id), DocumentStatus::ACTUAL, { 1 });
+    }
 
-    // the same words set =>  is a duplicate of document 1
-    AddDocument(search_server, 5, "funny funny pet and nasty nasty rat"s, DocumentStatus::ACTUAL, { 1, 2 });
+    const size_t forward_index_memory = churn_server.GetForwardIndexMemoryUsage();
 
-    // added new words => not a duplicate
-    AddDocument(search_server, 6, "funny pet and not very nasty rat"s, DocumentStatus::ACTUAL, { 1, 2 });
+    for (int id = 100; id < 20000; ++id) {
+        churn_server.RemoveDocument(id - 100);
+        churn_server.AddDocument(id, "white cat "s + to_string(id), DocumentStatus::ACTUAL, { 1 });
+    }
 
-    // the same words set as in 6 => is a duplicate
-    AddDocument(search_server, 7, "very nasty rat and not very funny pet"s, DocumentStatus::ACTUAL, { 1, 2 });
+    ASSERT(churn_server.GetForwardIndexMemoryUsage() < 20 * forward_index_memory);
+    ASSERT_EQUAL(churn_server.GetWordFrequencies(19950).size(), 3u);
+    ASSERT_EQUAL(churn_server.FindTopDocuments("cat 19990"s)[0].id, 19990);
+    ASSERT_EQUAL(churn_server.FindTopDocuments("\"white cat 19950\""s).size(), 1u);
+    ASSERT_EQUAL(churn_server.FindTopDocumentsPage("cat"s, 0, 1000).size(), 100u);
+}
 
-    // not all words => not a duplicate
-    AddDocument(search_server, 8, "pet with rat and rat and rat"s, DocumentStatus::ACTUAL, { 1, 2 });
+void TestForwardIndex() {
+    SearchServer server("and with"s);
 
-    // words from different documents => not a duplicate
-    AddDocument(search_server, 9, "nasty rat with curly hair"s, DocumentStatus::ACTUAL, { 1, 2 });
+    AddDocument(server, 1, "funny pet and nasty rat"s, DocumentStatus::ACTUAL, { 1, 2 });
+    AddDocument(server, 2, "funny pet with curly curly hair"s, DocumentStatus::ACTUAL, { 1, 2 });
+    AddDocument(server, 3, "nasty rat with curly hair"s, DocumentStatus::ACTUAL, { 1, 2 });
 
-    ASSERT_EQUAL(search_server.GetDocumentCount(), 9);
+    {
+        const auto word_freqs = server.GetWordFrequencies(2);
+        const vector<pair<string_view, double>> expected = { { "curly"sv, 0.4 }, { "funny"sv, 0.2 }, { "hair"sv, 0.2 }, { "pet"sv, 0.2 } };
+
+        ASSERT_EQUAL(word_freqs.size(), expected.size());
+        ASSERT(word_freqs.Contains("hair"sv));
+        ASSERT(!word_freqs.Contains("rat"sv));
+
+        size_t i = 0;
+        for (const auto& [word, freq] : word_freqs) {
+            ASSERT_EQUAL(word, expected[i].first);
+            ASSERT(InTheVicinity(freq, expected[i].second, 1e-9));
+            ++i;
+        }
+    }
 
-    const vector<int> added_document_ids = { 1, 2, 3, 4, 5, 6, 7, 8, 9 };
+    const auto relevance_before = server.FindTopDocuments("curly rat"s);
 
-    vector<int> availible_document_ids;
+    server.SetForwardIndexEnabled(false);
+    ASSERT(!server.IsForwardIndexEnabled());
+    ASSERT_EQUAL(server.GetForwardIndexMemoryUsage(), 0u);
 
-    for (const auto& document_id : search_server) {
-        availible_document_ids.push_back(document_id);
+    try {
+        server.GetWordFrequencies(1);
+        ASSERT_HINT(false, "Forward index is disabled"s);
+    } catch (const logic_error&) {
     }
 
-    ASSERT_EQUAL(added_document_ids, availible_document_ids);
-
-    // Temporary switch off cout output
-    // get underlying buffer
-      streambuf* orig_buf = cout.rdbuf();
+    try {
+        server.SetDuplicatePolicy(DuplicatePolicy::REJECT);
+        ASSERT_HINT(false, "Duplicate detection needs the forward index"s);
+    } catch (const logic_error&) {
+    }
 
-    // set null
-      cout.rdbuf(NULL);
+    // matching and removal work without the forward index
+    {
+        const auto [words, status] = server.MatchDocument("curly hair -rat"s, 2);
+        ASSERT_EQUAL(words, vector<string_view>({ "curly"sv, "hair"sv }));
+    }
 
-    RemoveDuplicates(search_server);
+    AddDocument(server, 4, "big dog"s, DocumentStatus::ACTUAL, { 1, 2 });
+    server.RemoveDocument(4);
+    ASSERT(server.FindTopDocuments("dog"s).empty());
 
-    // restore buffer
-      cout.rdbuf(orig_buf);
+    server.SetForwardIndexEnabled(true);
+    ASSERT_EQUAL(server.GetWordFrequencies(2).size(), 4u);
+    ASSERT(server.GetWordFrequencies(4).empty());
 
-    const vector<int> residual_document_ids = { 1, 2, 6, 8, 9 };
+    const auto relevance_after = server.FindTopDocuments("curly rat"s);
+    ASSERT_EQUAL(relevance_before.size(), relevance_after.size());
 
-    vector<int> after_deduplication_document_ids;
+    // removed documents leave garbage in the forward index until it is compacted
+    for (int id = 10; id < 110; ++id) {
+        server.AddDocument(id, "white cat number "s + to_string(id), DocumentStatus::ACTUAL, { 1 });
+    }
 
-    for (const auto& document_id : search_server) {
-        after_deduplication_document_ids.push_back(document_id);
+    for (int id = 10; id < 110; ++id) {
+        server.RemoveDocument(id);
     }
 
-    ASSERT_EQUAL(residual_document_ids, after_deduplication_document_ids);
+    ASSERT_EQUAL(server.GetWordFrequencies(3).size(), 4u);
+    ASSERT(server.GetWordFrequencies(3).Contains("nasty"sv));
 }
 
-////// Sprint 8 /////
+void TestFloatScoringMode() {
+    SearchServer server("and with"s);
 
-void TestProcessQueries() {
+    for (int id = 0; id < 300; ++id) {
+        const string text = "cat"s + to_string(id % 7) + " dog"s + to_string(id % 11) + " bird"s + to_string(id % 13) + " cat"s + to_string(id % 5);
+        server.AddDocument(id, text + (id % 150 == 1 || id == 8 ? " owl"s : ""s), id % 4 == 0 ? DocumentStatus::BANNED : DocumentStatus::ACTUAL, { id % 9 });
+    }
 
-    SearchServer search_server("and with"s);
+    // owl is scored from the few ordinals it touched, the other words by the dense scan
+    const vector<string> queries = { "cat1 dog2 bird3"s, "cat0 cat4 -dog5"s, "bird12 -cat2 -cat3"s, "cat1 cat2 cat3 cat4 dog0"s, "unknown"s, "owl"s, "owl -cat1"s };
 
-    for (
-        int id = 0;
-        const string& text : {
-            "funny pet and nasty rat"s,
-            "funny pet with curly hair"s,
-            "funny pet and not very nasty rat"s,
-            "pet with rat and rat and rat"s,
-            "nasty rat with curly hair"s,
-        }) {
-        search_server.AddDocument(++id, text, DocumentStatus::ACTUAL, { 1, 2 });
-    }
+    const auto check_same_results = [&server, &queries]() {
+        for (const string& query : queries) {
+            server.SetScoringMode(ScoringMode::DOUBLE);
+            const auto is_actual = [](int, DocumentStatus status, int) {
+                return status == DocumentStatus::ACTUAL;
+            };
 
-    const vector<string> queries = {
-        "nasty rat -not"s,
-        "not very funny nasty pet"s,
-        "curly hair"s
+            const auto expected = server.FindTopDocumentsPage(query, 0, 1000);
+            const auto expected_explained = get<0>(server.FindTopDocumentsExplained(execution::par, query, is_actual));
+            const auto expected_banned = server.FindTopDocuments(query, DocumentStatus::BANNED);
+
+            server.SetScoringMode(ScoringMode::FLOAT);
+            ASSERT(server.GetCompactPostingsMemoryUsage() > 0);
+
+            for (const auto& [found, expected_found] : { pair{ server.FindTopDocumentsPage(query, 0, 1000), expected },
+                                                         pair{ get<0>(server.FindTopDocumentsExplained(execution::par, query, is_actual)), expected_explained } }) {
+                ASSERT_EQUAL(found.size(), expected_found.size());
+
+                for (size_t i = 0; i < found.size(); ++i) {
+                    ASSERT_EQUAL(found[i].id, expected_found[i].id);
+                    ASSERT(InTheVicinity(found[i].relevance, expected_found[i].relevance, 1e-6));
+                }
+            }
+
+            const auto found_banned = server.FindTopDocuments(execution::par, query, DocumentStatus::BANNED);
+            ASSERT_EQUAL(found_banned.size(), expected_banned.size());
+
+            for (size_t i = 0; i < found_banned.size(); ++i) {
+                ASSERT_EQUAL(found_banned[i].id, expected_banned[i].id);
+            }
+        }
     };
 
-    std::vector<std::vector<Document>> result = ProcessQueries(search_server, queries);
-    ASSERT_EQUAL(result[0].size(), 3);
-    ASSERT_EQUAL(result[1].size(), 5);
-    ASSERT_EQUAL(result[2].size(), 2);
+    check_same_results();
+
+    // the compact postings are kept up to date while the mode is on
+    server.SetScoringMode(ScoringMode::FLOAT);
+    server.RemoveDocument(1);
+    server.RemoveDocument(execution::par, 2);
+    server.AddDocument(1000, "cat1 dog2 bird3"s, DocumentStatus::ACTUAL, { 5 });
+
+    check_same_results();
+
+    server.SetForwardIndexEnabled(false);
+    server.SetScoringMode(ScoringMode::FLOAT);
+    server.RemoveDocument(1000);
+    server.AddDocument(1001, "cat1 cat1 dog2"s, DocumentStatus::ACTUAL, { 5 });
+
+    check_same_results();
+
+    server.SetScoringMode(ScoringMode::DOUBLE);
+    ASSERT_EQUAL(server.GetCompactPostingsMemoryUsage(), 0u);
 }
 
-void TestProcessQueriesJoined() {
-    SearchServer search_server("and with"s);
+void TestBm25Ranking() {
+    SearchServer server("in the"s);
 
-    for (
-        int id = 0;
-        const string& text : {
-            "funny pet and nasty rat"s,
-            "funny pet with curly hair"s,
-            "funny pet and not very nasty rat"s,
-            "pet with rat and rat and rat"s,
-            "nasty rat with curly hair"s,
-        }) {
-        search_server.AddDocument(++id, text, DocumentStatus::ACTUAL, { 1, 2 });
-    }
+    server.AddDocument(0, "white cat and model colle"s, DocumentStatus::ACTUAL, { 1 });
+    server.AddDocument(1, "fur cat fur cock"s, DocumentStatus::ACTUAL, { 1 });
+    server.AddDocument(2, "cared dog exiting eyes"s, DocumentStatus::ACTUAL, { 1 });
+    server.AddDocument(3, "cared"s, DocumentStatus::BANNED, { 1 });
+    server.RemoveDocument(3);
 
-    const vector<string> queries = {
-        "nasty rat -not"s,
-        "not very funny nasty pet"s,
-        "curly hair"s
+    const auto is_actual = [](int, DocumentStatus status, int) {
+        return status == DocumentStatus::ACTUAL;
     };
 
-    std::vector<Document> result = ProcessQueriesJoined(search_server, queries);
-    ASSERT_EQUAL(result[0].id, 1);
-    ASSERT_EQUAL(result[1].id, 5);
-    ASSERT_EQUAL(result[2].id, 4);
-    ASSERT_EQUAL(result[3].id, 3);
-    ASSERT_EQUAL(result[4].id, 1);
-    ASSERT_EQUAL(result[5].id, 2);
-    ASSERT_EQUAL(result[6].id, 5);
-    ASSERT_EQUAL(result[7].id, 4);
-    ASSERT_EQUAL(result[8].id, 2);
-    ASSERT_EQUAL(result[9].id, 5);
-}
+    const vector<pair<int, double>> expected = { { 1, 1.863737 }, { 2, 1.012697 }, { 0, 0.442174 } };
 
-void TestRemoveDocumentMultiTread() {
-    SearchServer search_server("and with"s);
+    for (const ScoringMode mode : { ScoringMode::DOUBLE, ScoringMode::FLOAT }) {
+        server.SetScoringMode(mode);
 
-    for (
-        int id = 0;
-        const string& text : {
-            "funny pet and nasty rat"s,
-            "funny pet with curly hair"s,
-            "funny pet and not very nasty rat"s,
-            "pet with rat and rat and rat"s,
-            "nasty rat with curly hair"s,
-        }) {
-        search_server.AddDocument(++id, text, DocumentStatus::ACTUAL, { 1, 2 });
-    }
+        for (const auto& found_docs : { server.FindTopDocuments("fur cared cat"s, is_actual, Bm25Ranking{}),
+                                        server.FindTopDocuments(execution::par, "fur cared cat"s, is_actual, Bm25Ranking{}) }) {
+            ASSERT_EQUAL(found_docs.size(), expected.size());
 
-    const string query = "curly and funny"s;
+            for (size_t i = 0; i < expected.size(); ++i) {
+                ASSERT_EQUAL(found_docs[i].id, expected[i].first);
+                ASSERT(InTheVicinity(found_docs[i].relevance, expected[i].second, 1e-5));
+            }
+        }
 
-    ASSERT_EQUAL(search_server.GetDocumentCount(), 5);
-    ASSERT_EQUAL(search_server.FindTopDocuments(query).size(), 4);
-    // single thread version
-    search_server.RemoveDocument(5);
-    ASSERT_EQUAL(search_server.GetDocumentCount(), 4);
-    ASSERT_EQUAL(search_server.FindTopDocuments(query).size(), 3);
+        // the default ranking is unchanged
+        const auto tf_idf_docs = server.FindTopDocuments(execution::seq, "fur cared cat"s, is_actual, TfIdfRanking{});
+        ASSERT_EQUAL(tf_idf_docs.size(), 3u);
+        ASSERT(InTheVicinity(tf_idf_docs[0].relevance, 0.650672, 1e-6));
+    }
 
-    // single thread version
-    search_server.RemoveDocument(execution::seq, 1);
-    ASSERT_EQUAL(search_server.GetDocumentCount(), 3);
-    ASSERT_EQUAL(search_server.FindTopDocuments(query).size(), 2);
+    // b = 0 turns the length normalization off
+    Bm25Ranking no_length_norm;
+    no_length_norm.b = 0.0;
 
-    // multi thread version
-    search_server.RemoveDocument(execution::par, 2);
-    ASSERT_EQUAL(search_server.GetDocumentCount(), 2);
-    ASSERT_EQUAL(search_server.FindTopDocuments(query).size(), 1);
+    const auto found_docs = server.FindTopDocuments("cat"s, is_actual, no_length_norm);
+    ASSERT_EQUAL(found_docs.size(), 2u);
+    ASSERT(InTheVicinity(found_docs[0].relevance, found_docs[1].relevance, 1e-9));
 }
 
-void TestMatchDocumentMultiTread() {
-    SearchServer search_server("and with"s);
+void TestPhraseQueries() {
+    SearchServer server("and with the"s);
 
-    for (
-        int id = 0;
-        const string& text : {
-            "funny pet and nasty rat"s,
-            "funny pet with curly hair"s,
-            "funny pet and not very nasty rat"s,
-            "pet with rat and rat and rat"s,
-            "nasty rat with curly hair"s,
-        }) {
-        search_server.AddDocument(++id, text, DocumentStatus::ACTUAL, { 1, 2 });
+    server.AddDocument(1, "funny pet and nasty rat"s, DocumentStatus::ACTUAL, { 1 });
+    server.AddDocument(2, "nasty pet with funny rat"s, DocumentStatus::ACTUAL, { 2 });
+    server.AddDocument(3, "the funny pet the funny pet"s, DocumentStatus::ACTUAL, { 3 });
+
+    // quoted phrases need the positional index
+    try {
+        server.FindTopDocuments("\"funny pet\""s);
+        ASSERT_HINT(false, "Phrase queries need the positional index"s);
+    } catch (const logic_error&) {
     }
 
-    const string query = "curly and funny -not"s;
+    server.SetPositionalIndexEnabled(true);
+    ASSERT(server.GetPositionalIndexMemoryUsage() > 0);
 
-    {
-        const auto [words, status] = search_server.MatchDocument(query, 1);
-        ASSERT_EQUAL(words.size(), 1);
-    }
+    server.AddDocument(4, "pet funny rat"s, DocumentStatus::ACTUAL, { 4 });
 
-    {
-        const auto [words, status] = search_server.MatchDocument(execution::seq, query, 2);
-        ASSERT_EQUAL(words.size(), 2);
-    }
+    const auto found_ids = [&server](const string& query) {
+        vector<int> ids;
 
-    {
-        const auto [words, status] = search_server.MatchDocument(execution::par, query, 3);
-        ASSERT_EQUAL(words.size(), 0);
-    }
-}
+        for (const auto& document : server.FindTopDocuments(query)) {
+            ids.push_back(document.id);
+        }
 
-void TestFindTopDocumentsMultiTread() {
-    SearchServer search_server("and with"s);
+        sort(ids.begin(), ids.end());
+        return ids;
+    };
 
-    for (
-        int id = 0;
-        const string& text : {
-            "white cat and yellow hat"s,
-            "curly cat curly tail"s,
-            "nasty dog with big eyes"s,
-            "nasty pigeon john"s,
-        }) {
-        search_server.AddDocument(++id, text, DocumentStatus::ACTUAL, { 1, 2 });
+    ASSERT_EQUAL(found_ids("\"funny pet\""s), vector<int>({ 1, 3 }));
+    ASSERT_EQUAL(found_ids("\"funny rat\""s), vector<int>({ 2, 4 }));
+    ASSERT_EQUAL(found_ids("\"funny pet\" -nasty"s), vector<int>({ 3 }));
+
+    // stop words inside the phrase keep their place, any stop word may stand there
+    ASSERT_EQUAL(found_ids("\"pet and nasty\""s), vector<int>({ 1 }));
+    ASSERT_EQUAL(found_ids("\"pet with nasty\""s), vector<int>({ 1 }));
+    ASSERT_EQUAL(found_ids("\"pet nasty\""s), vector<int>());
+
+    // slop lets phrase words move from their places
+    ASSERT_EQUAL(found_ids("\"pet nasty\"~1"s), vector<int>({ 1 }));
+    ASSERT_EQUAL(found_ids("\"pet rat\"~1"s), vector<int>({ 4 }));
+    ASSERT_EQUAL(found_ids("\"pet rat\"~2"s), vector<int>({ 1, 2, 4 }));
+
+    // phrase words still score as plus words
+    ASSERT_EQUAL(found_ids("\"funny pet\" rat"s), vector<int>({ 1, 3 }));
+    ASSERT_EQUAL(found_ids("\"unknown pet\""s), vector<int>());
+
+    ASSERT_EQUAL(get<0>(server.MatchDocument("\"funny pet\""s, 1)), vector<string_view>({ "funny"sv, "pet"sv }));
+    ASSERT(get<0>(server.MatchDocument("\"funny pet\""s, 2)).empty());
+    ASSERT_EQUAL(server.MatchAllDocuments("\"funny pet\""s).size(), 2u);
+
+    server.SetScoringMode(ScoringMode::FLOAT);
+    ASSERT_EQUAL(found_ids("\"funny pet\""s), vector<int>({ 1, 3 }));
+
+    server.RemoveDocument(3);
+    ASSERT_EQUAL(found_ids("\"funny pet\""s), vector<int>({ 1 }));
+
+    for (const string& query : { "\"funny pet"s, "\"funny -pet\""s, "\"funny pet\"~"s, "\"funny pet\"x"s }) {
+        try {
+            server.FindTopDocuments(query);
+            ASSERT_HINT(false, "Invalid phrase "s + query);
+        } catch (const invalid_argument&) {
+        }
     }
 
-    // seq version by default
-    auto document = search_server.FindTopDocuments("curly nasty cat"s);
-    ASSERT_EQUAL(document[0].id, 2);
-    ASSERT_EQUAL(document[1].id, 4);
-    ASSERT_EQUAL(document[2].id, 1);
-    ASSERT_EQUAL(document[3].id, 3);
+    // a word before its offset in the document doesn't start the phrase
+    SearchServer gap_server("and"s);
+    gap_server.SetPositionalIndexEnabled(true);
+    gap_server.AddDocument(1, "cat dog"s, DocumentStatus::ACTUAL, { 1 });
+    gap_server.AddDocument(2, "cat and dog"s, DocumentStatus::ACTUAL, { 2 });
+    gap_server.AddDocument(3, "cat cat dog"s, DocumentStatus::ACTUAL, { 3 });
+    gap_server.AddDocument(4, "cat dog cat"s, DocumentStatus::ACTUAL, { 4 });
 
-    // seq version
-    document = search_server.FindTopDocuments(execution::seq, "curly nasty cat"s, DocumentStatus::BANNED);
-    ASSERT_EQUAL(document.size(), 0);
+    const auto gap_found_ids = [&gap_server](const string& query) {
+        vector<int> ids;
 
-    // par version
-    document = search_server.FindTopDocuments(execution::par, "curly nasty cat"s, [](int document_id, DocumentStatus status, int rating) { return document_id % 2 == 0; });
-    ASSERT_EQUAL(document[0].id, 2);
+        for (const auto& document : gap_server.FindTopDocuments(query)) {
+            ids.push_back(document.id);
+        }
+
+        sort(ids.begin(), ids.end());
+        return ids;
+    };
+
+    // the place of the stop word may hold any word, but it can't be skipped
+    ASSERT_EQUAL(gap_found_ids("\"cat and dog\""s), vector<int>({ 2, 3 }));
+    ASSERT_EQUAL(gap_found_ids("\"cat dog\""s), vector<int>({ 1, 3, 4 }));
+
+    // copies of a repeated word need occurrences of their own, with slop as well
+    ASSERT_EQUAL(gap_found_ids("\"cat cat\""s), vector<int>({ 3 }));
+    ASSERT_EQUAL(gap_found_ids("\"cat cat\"~1"s), vector<int>({ 3, 4 }));
+    ASSERT_EQUAL(gap_found_ids("\"cat cat cat\"~2"s), vector<int>());
+}
+
+void TestRequiredWords() {
+    SearchServer server("and with"s);
+
+    server.AddDocument(1, "funny pet and nasty rat"s, DocumentStatus::ACTUAL, { 1 });
+    server.AddDocument(2, "funny pet with curly hair"s, DocumentStatus::ACTUAL, { 2 });
+    server.AddDocument(3, "nasty rat with curly hair"s, DocumentStatus::ACTUAL, { 3 });
+    server.AddDocument(4, "funny curly dog"s, DocumentStatus::BANNED, { 4 });
+
+    const auto found_ids = [&server](const string& query) {
+        vector<int> ids;
+
+        for (const auto& document : server.FindTopDocuments(query)) {
+            ids.push_back(document.id);
+        }
+
+        sort(ids.begin(), ids.end());
+        return ids;
+    };
+
+    for (const ScoringMode mode : { ScoringMode::DOUBLE, ScoringMode::FLOAT }) {
+        server.SetScoringMode(mode);
+
+        ASSERT_EQUAL(found_ids("+funny +curly"s), vector<int>({ 2 }));
+        ASSERT_EQUAL(found_ids("+curly rat"s), vector<int>({ 2, 3 }));
+        ASSERT_EQUAL(found_ids("+curly -pet"s), vector<int>({ 3 }));
+        ASSERT_EQUAL(found_ids("+curly +unknown"s), vector<int>());
+        ASSERT_EQUAL(found_ids("+and funny"s), vector<int>({ 1, 2 }));
+
+        // relevance of the survivors is the same as in a plain query
+        const auto required = server.FindTopDocuments(execution::par, "+curly rat"s);
+        const auto plain = server.FindTopDocuments("curly rat"s);
+
+        ASSERT_EQUAL(required.size(), 2u);
+
+        for (const Document& document : required) {
+            const auto it = find_if(plain.begin(), plain.end(), [&document](const Document& other) {
+                return other.id == document.id;
+            });
+
+            ASSERT(it != plain.end());
+            ASSERT(InTheVicinity(document.relevance, it->relevance, 1e-6));
+        }
+
+        ASSERT_EQUAL(server.FindTopDocuments("+funny +curly"s, DocumentStatus::BANNED).size(), 1u);
+    }
+
+    ASSERT_EQUAL(get<0>(server.MatchDocument("+nasty curly"s, 3)), vector<string_view>({ "curly"sv, "nasty"sv }));
+    ASSERT(get<0>(server.MatchDocument("+nasty curly"s, 2)).empty());
+    ASSERT_EQUAL(server.MatchAllDocuments("+curly hair"s).size(), 3u);
+
+    server.SetForwardIndexEnabled(false);
+    ASSERT(get<0>(server.MatchDocument("+nasty curly"s, 2)).empty());
+
+    for (const string& query : { "+"s, "++cat"s, "+-cat"s }) {
+        try {
+            server.FindTopDocuments(query);
+            ASSERT_HINT(false, "Invalid query "s + query);
+        } catch (const invalid_argument&) {
+        }
+    }
+}
+
+void TestMinusWordBitmaps() {
+    {
+        RoaringBitmap bitmap;
+
+        // the first group grows past 4096 values and turns into a bitmap
+        for (uint32_t value = 0; value < 10000; value += 2) {
+            bitmap.Add(value);
+        }
+
+        bitmap.Add(1u << 20);
+        bitmap.Add(1u << 20);
+
+        ASSERT_EQUAL(bitmap.size(), 5001u);
+        ASSERT(bitmap.Contains(9998) && !bitmap.Contains(9999) && bitmap.Contains(1u << 20));
+
+        for (uint32_t value = 0; value < 10000; value += 4) {
+            bitmap.Remove(value);
+        }
+
+        ASSERT_EQUAL(bitmap.size(), 2501u);
+        ASSERT(!bitmap.Contains(4) && bitmap.Contains(6));
+
+        RoaringBitmap other;
+        other.Add(4);
+        other.Add(70000);
+        bitmap |= other;
+
+        ASSERT_EQUAL(bitmap.size(), 2503u);
+        ASSERT(bitmap.Contains(4) && bitmap.Contains(70000) && bitmap.Contains(1u << 20));
+    }
+
+    {
+        // a bitmap container at the array bound stays one until half of it is removed
+        RoaringBitmap bitmap;
+
+        for (uint32_t value = 0; value <= 4096; ++value) {
+            bitmap.Add(value);
+        }
+
+        const size_t bitmap_memory_usage = bitmap.GetMemoryUsage();
+
+        bitmap.Remove(0);
+        bitmap.Add(0);
+        bitmap.Remove(0);
+        ASSERT_EQUAL(bitmap.GetMemoryUsage(), bitmap_memory_usage);
+
+        for (uint32_t value = 1; value <= 2048; ++value) {
+            bitmap.Remove(value);
+        }
+
+        ASSERT_EQUAL(bitmap.size(), 2048u);
+        ASSERT(bitmap.GetMemoryUsage() < bitmap_memory_usage);
+        ASSERT(!bitmap.Contains(2048) && bitmap.Contains(2049) && bitmap.Contains(4096));
+    }
+
+    SearchServer server(""s);
+
+    for (int id = 0; id < 300; ++id) {
+        const string text = "laptop"s + (id % 3 == 0 ? " refurbished"s : ""s) + (id % 5 == 0 ? " cheap"s : ""s);
+        server.AddDocument(id, text, id % 7 == 0 ? DocumentStatus::BANNED : DocumentStatus::ACTUAL, { id });
+    }
+
+    const auto count_found = [&server](const string& query, auto predicate) {
+        return server.FindTopDocumentsPage(query, predicate, 0, 1000).size();
+    };
+
+    const auto is_actual = [](int, DocumentStatus status, int) {
+        return status == DocumentStatus::ACTUAL;
+    };
+
+    // 200 documents without refurbished, 28 of them are banned
+    for (int i = 0; i < 3; ++i) {
+        ASSERT_EQUAL(count_found("laptop -refurbished"s, DocumentStatusPredicate{ DocumentStatus::ACTUAL }), 172u);
+        ASSERT_EQUAL(count_found("laptop -refurbished"s, is_actual), 172u);
+        ASSERT_EQUAL(count_found("laptop -refurbished -cheap"s, DocumentStatusPredicate{ DocumentStatus::BANNED }), 22u);
+    }
+
+    // cached bitmaps follow the changes of the index
+    server.AddDocument(1000, "laptop refurbished"s, DocumentStatus::ACTUAL, { 1 });
+    server.RemoveDocument(0);
+    server.RemoveDocument(3);
+
+    ASSERT_EQUAL(count_found("laptop -refurbished"s, is_actual), 172u);
+    ASSERT_EQUAL(count_found("laptop -cheap"s, DocumentStatusPredicate{ DocumentStatus::ACTUAL }), 206u);
+    ASSERT_EQUAL(server.FindTopDocuments(execution::par, "laptop -refurbished"s, DocumentStatus::ACTUAL).size(), 5u);
+}
+
+void TestImpactOrderedPostings() {
+    SearchServer server("and with"s);
+    SearchServer impact_server("and with"s);
+
+    impact_server.SetImpactOrderedPostingsEnabled(true);
+
+    for (int id = 0; id < 500; ++id) {
+        string text = "cat"s + to_string(id % 17) + " dog"s + to_string(id % 23);
+
+        // repeated words give a spread of term frequencies
+        for (int i = 0; i < id % 4; ++i) {
+            text += " cat"s + to_string(id % 17);
+        }
+
+        text += id % 9 == 0 ? " parrot"s : " fish"s + to_string(id % 31);
+
+        for (SearchServer* target : { &server, &impact_server }) {
+            target->AddDocument(id, text, id % 5 == 0 ? DocumentStatus::BANNED : DocumentStatus::ACTUAL, { id % 11 });
+        }
+    }
+
+    ASSERT(impact_server.GetImpactOrderedPostingsMemoryUsage() > 0);
+
+    const vector<string> queries = { "cat1 dog2"s, "cat3 cat4 dog5 parrot"s, "parrot -cat1"s, "fish7 cat7 -dog7"s, "unknown"s, "cat1 +dog1"s };
+
+    const auto check_same_results = [&]() {
+        for (const string& query : queries) {
+            const auto expected = server.FindTopDocuments(query);
+
+            for (const auto& found : { impact_server.FindTopDocuments(query), impact_server.FindTopDocuments(execution::par, query) }) {
+                ASSERT_EQUAL(found.size(), expected.size());
+
+                for (size_t i = 0; i < found.size(); ++i) {
+                    ASSERT_EQUAL(found[i].id, expected[i].id);
+                    ASSERT(InTheVicinity(found[i].relevance, expected[i].relevance, 1e-6));
+                }
+            }
+        }
+    };
+
+    check_same_results();
+
+    // the impact order follows the changes of the index
+    const int best_id = server.FindTopDocuments(queries[0])[0].id;
+
+    for (SearchServer* target : { &server, &impact_server }) {
+        target->RemoveDocument(best_id);
+        target->AddDocument(1000, "cat1 cat1 cat1 dog2"s, DocumentStatus::ACTUAL, { 1 });
+        target->SetForwardIndexEnabled(false);
+        target->RemoveDocument(1);
+    }
+
+    ASSERT_EQUAL(impact_server.FindTopDocuments(queries[0])[0].id, 1000);
+    check_same_results();
+
+    // switching on builds the impact order of existing documents
+    server.SetImpactOrderedPostingsEnabled(true);
+    impact_server.SetImpactOrderedPostingsEnabled(false);
+    check_same_results();
+}
+
+void TestPrefixQueries() {
+    SearchServer server("and with"s);
+
+    server.AddDocument(1, "cat and caterpillar"s, DocumentStatus::ACTUAL, { 1 });
+    server.AddDocument(2, "catalog with cat"s, DocumentStatus::ACTUAL, { 2 });
+    server.AddDocument(3, "category"s, DocumentStatus::ACTUAL, { 3 });
+    server.AddDocument(4, "car and dog"s, DocumentStatus::ACTUAL, { 4 });
+
+    // enough words for several dictionary blocks
+    for (int id = 0; id < 100; ++id) {
+        server.AddDocument(100 + id, "word"s + to_string(1000 + id), DocumentStatus::ACTUAL, { 0 });
+    }
+
+    const vector<pair<string_view, size_t>> completions = { { "cat"sv, 2 }, { "catalog"sv, 1 }, { "category"sv, 1 }, { "caterpillar"sv, 1 } };
+    ASSERT(server.CompleteWord("cat"sv, 10) == completions);
+    ASSERT(server.CompleteWord("cat"sv, 2) == vector(completions.begin(), completions.begin() + 2));
+    ASSERT_EQUAL(server.CompleteWord("word"sv, 1000).size(), 100u);
+    ASSERT_EQUAL(server.CompleteWord("word105"sv, 1000).size(), 10u);
+    ASSERT(server.CompleteWord("word1050"sv, 1)[0].first == "word1050"sv);
+    ASSERT(server.CompleteWord("x"sv, 10).empty());
+
+    // counts of known words grow without rebuilding the dictionary, blocks must not be skipped by stale bounds
+    for (int id = 0; id < 3; ++id) {
+        server.AddDocument(300 + id, "word1099 word1042"s, DocumentStatus::ACTUAL, { 0 });
+    }
+
+    server.AddDocument(303, "word1042"s, DocumentStatus::ACTUAL, { 0 });
+
+    ASSERT(server.CompleteWord("word"sv, 2) == (vector<pair<string_view, size_t>>{ { "word1042"sv, 5 }, { "word1099"sv, 4 } }));
+    ASSERT(server.CompleteWord("word10"sv, 3)[2].first == "word1000"sv);
+
+    for (int id = 300; id < 304; ++id) {
+        server.RemoveDocument(id);
+    }
+
+    ASSERT(server.CompleteWord("word"sv, 1)[0].first == "word1000"sv);
+
+    const auto get_ids = [&server](string_view query) {
+        set<int> ids;
+
+        for (const auto& document : server.FindTopDocuments(query)) {
+            ids.insert(document.id);
+        }
+
+        return ids;
+    };
+
+    ASSERT_EQUAL(get_ids("cat*"sv), (set<int>{ 1, 2, 3 }));
+    ASSERT_EQUAL(get_ids("ca* -cate*"sv), (set<int>{ 2, 4 }));
+    ASSERT_EQUAL(get_ids("dog cat*"sv), get_ids("dog cat catalog caterpillar category"sv));
+
+    const auto [words, _] = server.MatchDocument("cater*"sv, 1);
+    ASSERT_EQUAL(words, vector<string_view>{ "caterpillar"sv });
+
+    // removed words and new ones show up in the dictionary
+    server.RemoveDocument(3);
+    server.AddDocument(5, "catfish"s, DocumentStatus::ACTUAL, { 5 });
+    ASSERT(server.CompleteWord("categ"sv, 10).empty());
+    ASSERT_EQUAL(get_ids("catf*"sv), set<int>{ 5 });
+
+    // new words are searched beside the dictionary until enough of them rebuild it
+    for (int id = 0; id < 5000; ++id) {
+        server.AddDocument(1000 + id, "new"s + to_string(10000 + id) + (id % 2 == 0 ? " catkin"s : ""s), DocumentStatus::ACTUAL, { 0 });
+
+        if (id == 10 || id == 4999) {
+            ASSERT_EQUAL(server.CompleteWord("new"sv, 10000).size(), static_cast<size_t>(id + 1));
+            ASSERT(server.CompleteWord("cat"sv, 1) == (vector<pair<string_view, size_t>>{ { "catkin"sv, static_cast<size_t>(id / 2 + 1) } }));
+        }
+    }
+
+    for (const string& query : { "+cat*"s, "\"cat* dog\""s }) {
+        try {
+            server.FindTopDocuments(query);
+            ASSERT_HINT(false, "Prefix is not allowed in "s + query);
+        } catch (const invalid_argument&) {
+        }
+    }
+}
+
+void TestFuzzyMatching() {
+    SearchServer server("and with"s);
+
+    server.AddDocument(1, "curly hair"s, DocumentStatus::ACTUAL, { 1 });
+    server.AddDocument(2, "curry sauce"s, DocumentStatus::ACTUAL, { 2 });
+    server.AddDocument(3, "burly man"s, DocumentStatus::ACTUAL, { 3 });
+    server.AddDocument(4, "fluffy cat"s, DocumentStatus::ACTUAL, { 4 });
+
+    const auto get_ids = [&server](string_view query) {
+        vector<int> ids;
+
+        for (const auto& document : server.FindTopDocuments(query)) {
+            ids.push_back(document.id);
+        }
+
+        return ids;
+    };
+
+    ASSERT(get_ids("curlt"sv).empty());
+
+    server.SetMaxEditDistance(1);
+    ASSERT_EQUAL(server.GetMaxEditDistance(), 1);
+    ASSERT_EQUAL(get_ids("curlt"sv), vector<int>{ 1 });
+
+    // the exact match weighs more than the fuzzy one
+    ASSERT_EQUAL(get_ids("burly"sv), (vector<int>{ 3, 1 }));
+    ASSERT_EQUAL(server.FindTopDocuments("burly"sv)[1].relevance * 2, server.FindTopDocuments("burly"sv)[0].relevance);
+
+    // short words are matched exactly, required and minus words as well
+    ASSERT(get_ids("ca"sv).empty());
+    ASSERT(get_ids("+curlt"sv).empty());
+    ASSERT_EQUAL(get_ids("burly -curlt"sv), (vector<int>{ 3, 1 }));
+
+    server.SetMaxEditDistance(2);
+    ASSERT_EQUAL(get_ids("fluffly"sv), vector<int>{ 4 });
+    ASSERT_EQUAL(get_ids("fuffly"sv), vector<int>{ 4 });
+
+    try {
+        server.SetMaxEditDistance(3);
+        ASSERT_HINT(false, "Max edit distance 3 is not supported"s);
+    } catch (const invalid_argument&) {
+    }
+
+    // every word within the distance is found, compared with a brute force search
+    const auto get_edit_distance = [](string_view lhs, string_view rhs) {
+        vector<int> row(rhs.size() + 1);
+        iota(row.begin(), row.end(), 0);
+
+        for (size_t i = 0; i < lhs.size(); ++i) {
+            int diagonal = row[0];
+            row[0] = static_cast<int>(i + 1);
+
+            for (size_t j = 1; j <= rhs.size(); ++j) {
+                const int above = row[j];
+                row[j] = min({ row[j] + 1, row[j - 1] + 1, diagonal + (lhs[i] == rhs[j - 1] ? 0 : 1) });
+                diagonal = above;
+            }
+        }
+
+        return row.back();
+    };
+
+    SearchServer random_server(""s);
+    random_server.SetMaxEditDistance(2);
+
+    vector<string> words;
+    mt19937 generator(45);
+
+    for (int id = 0; id < 2000; ++id) {
+        string word(3 + generator() % 6, 'a');
+
+        for (char& c : word) {
+            c = static_cast<char>('a' + generator() % 6);
+        }
+
+        words.push_back(word);
+        random_server.AddDocument(id, word, DocumentStatus::ACTUAL, { 1 });
+
+        // the later words are found beside the dictionary built here
+        if (id == 1000) {
+            random_server.FindTopDocuments(word);
+        }
+    }
+
+    for (int i = 0; i < 200; ++i) {
+        const string& query = words[generator() % words.size()];
+        const int max_edit_distance = query.size() < 6 ? 1 : 2;
+
+        set<string_view> expected_words;
+
+        for (const string& word : words) {
+            if (get_edit_distance(query, word) <= max_edit_distance) {
+                expected_words.insert(word);
+            }
+        }
+
+        // more words than an expansion takes
+        if (expected_words.size() > 16) {
+            continue;
+        }
+
+        set<string_view> found_words;
+
+        for (const auto& [document_id, _] : random_server.MatchAllDocuments(query)) {
+            found_words.insert(words[document_id]);
+        }
+
+        ASSERT_EQUAL(found_words, expected_words);
+    }
+}
+
+void TestShardedSearchServer() {
+    SearchServer server("and with"s);
+    ShardedSearchServer sharded_server(4, "and with"s);
+
+    ASSERT_EQUAL(sharded_server.GetShardCount(), 4u);
+
+    for (int id = 0; id < 400; ++id) {
+        string text = "cat"s + to_string(id % 13) + " and dog"s + to_string(id % 29);
+
+        for (int i = 0; i < id % 3; ++i) {
+            text += " parrot"s;
+        }
+
+        const DocumentStatus status = id % 7 == 0 ? DocumentStatus::BANNED : DocumentStatus::ACTUAL;
+
+        server.AddDocument(id, text, status, { id % 10 });
+        sharded_server.AddDocument(id, text, status, { id % 10 });
+    }
+
+    ASSERT_EQUAL(sharded_server.GetDocumentCount(), 400);
+
+    // every shard gets a part of the documents
+    for (size_t i = 0; i < sharded_server.GetShardCount(); ++i) {
+        ASSERT(sharded_server.GetShard(i).GetDocumentCount() > 50);
+    }
+
+    const auto check_same_results = [&]() {
+        for (const string& query : { "cat1 dog2"s, "parrot cat3 -dog4"s, "+parrot cat5"s, "dog28"s, "unknown"s }) {
+            AssertSameDocuments(sharded_server.FindTopDocuments(query), server.FindTopDocuments(query));
+            AssertSameDocuments(sharded_server.FindTopDocuments(query, DocumentStatus::BANNED), server.FindTopDocuments(query, DocumentStatus::BANNED));
+            AssertSameDocuments(sharded_server.FindTopDocuments(query, [](int id, DocumentStatus, int) { return id % 2 == 0; }, Bm25Ranking{}),
+                        server.FindTopDocuments(query, [](int id, DocumentStatus, int) { return id % 2 == 0; }, Bm25Ranking{}));
+        }
+    };
+
+    check_same_results();
+
+    for (int id = 0; id < 400; id += 3) {
+        server.RemoveDocument(id);
+        sharded_server.RemoveDocument(id);
+    }
+
+    check_same_results();
+
+    ASSERT(get<0>(sharded_server.MatchDocument("cat1 dog1"s, 1)) == get<0>(server.MatchDocument("cat1 dog1"s, 1)));
+
+    try {
+        sharded_server.AddDocument(1, "cat"s, DocumentStatus::ACTUAL, { 1 });
+        ASSERT_HINT(false, "Document 1 is added twice"s);
+    } catch (const invalid_argument&) {
+    }
+
+    try {
+        sharded_server.FindTopDocuments("cat --dog"s);
+        ASSERT_HINT(false, "Query is invalid"s);
+    } catch (const invalid_argument&) {
+    }
+}
+
+void TestQueryProtocol() {
+    SearchServer server("and with"s);
+    QueryProtocol protocol(server);
+
+    ASSERT_EQUAL(protocol.Execute("ADD 1 ACTUAL 1,2,3 curly cat and dog"s), "OK"s);
+    ASSERT_EQUAL(protocol.Execute("ADD 2 BANNED - curly parrot"s), "OK"s);
+    ASSERT_EQUAL(protocol.Execute("COUNT"s), "OK 2"s);
+
+    ASSERT_EQUAL(protocol.Execute("FIND curly cat"s), "OK 1:0.23104906018664842:2"s);
+    ASSERT_EQUAL(protocol.Execute("FIND_STATUS BANNED curly"s), "OK 2:0:0"s);
+    ASSERT_EQUAL(protocol.Execute("FIND parrot"s), "OK"s);
+    ASSERT_EQUAL(protocol.Execute("MATCH 1 dog cat parrot"s), "OK ACTUAL cat dog"s);
+
+    ASSERT_EQUAL(protocol.Execute("REMOVE 1"s), "OK"s);
+    ASSERT_EQUAL(protocol.Execute("COUNT"s), "OK 1"s);
+
+    for (const string& request : { "FIND --cat"s, "ADD 2 ACTUAL - curly"s, "ADD x ACTUAL - curly"s, "ADD 3 GOOD - curly"s,
+                                   "ADD 3 ACTUAL 1,,2 curly"s, "MATCH 7 cat"s, "HELLO"s, ""s }) {
+        ASSERT_HINT(protocol.Execute(request).rfind("ERROR "s, 0) == 0, request);
+    }
+}
+
+void TestAsyncQueries() {
+    SearchServer server("and with"s);
+
+    for (int id = 0; id < 10000; ++id) {
+        server.AddDocument(id, "cat and dog"s + to_string(id % 17), id % 5 == 0 ? DocumentStatus::BANNED : DocumentStatus::ACTUAL, { id % 10 });
+    }
+
+    QueryScheduler scheduler(server, 2);
+    ASSERT_EQUAL(scheduler.GetThreadCount(), 2u);
+
+    {
+        string query = "dog3 cat"s;
+        auto found = scheduler.FindTopDocuments(query);
+        auto found_banned = scheduler.FindTopDocuments(query, DocumentStatus::BANNED);
+        auto found_even = scheduler.FindTopDocuments(query, [](int id, DocumentStatus, int) { return id % 2 == 0; });
+
+        // the scheduler keeps its own copy of the query
+        query.clear();
+
+        AssertSameDocuments(found.get(), server.FindTopDocuments("dog3 cat"s));
+        AssertSameDocuments(found_banned.get(), server.FindTopDocuments("dog3 cat"s, DocumentStatus::BANNED));
+        AssertSameDocuments(found_even.get(), server.FindTopDocuments("dog3 cat"s, [](int id, DocumentStatus, int) { return id % 2 == 0; }));
+    }
+
+    const auto assert_cancelled = [](future<vector<Document>> found) {
+        try {
+            found.get();
+            ASSERT_HINT(false, "Query must be cancelled"s);
+        } catch (const QueryCancelledError&) {
+        }
+    };
+
+    // cancelled while queued
+    CancellationToken cancelled;
+    cancelled.Cancel();
+    assert_cancelled(scheduler.FindTopDocuments("cat"s, cancelled));
+
+    // the deadline has passed
+    assert_cancelled(scheduler.FindTopDocuments("cat"s, CancellationToken(CancellationToken::Clock::now() - 1ms)));
+
+    // cancelled in the middle of the postings scan of the only word
+    CancellationToken cancelled_later;
+    assert_cancelled(scheduler.FindTopDocuments(
+        "cat"s, [cancelled_later](int, DocumentStatus, int) mutable {
+            cancelled_later.Cancel();
+            return true;
+        },
+        cancelled_later));
+
+    // the FLOAT scan checks the token inside the postings of a word, not only between words
+    {
+        CompactPostings postings(pmr::get_default_resource());
+
+        for (uint32_t ordinal = 0; ordinal < 10000; ++ordinal) {
+            postings.Add(0, ordinal, 0.5f);
+            postings.SetDocumentLength(ordinal, 2);
+        }
+
+        CompactPostings::ScoreBuffer buffer;
+        buffer.Reset(10000);
+
+        ASSERT(!postings.Accumulate(postings.Get(0), TfIdfRanking{}, 1.0f, 2.0f, buffer, 0, 10000, &cancelled, 4096));
+        ASSERT_EQUAL(buffer.GetTouchedCount(), 0u);
+
+        CancellationToken cancelled_never;
+        ASSERT(postings.Accumulate(postings.Get(0), TfIdfRanking{}, 1.0f, 2.0f, buffer, 0, 10000, &cancelled_never, 4096));
+        ASSERT_EQUAL(buffer.GetTouchedCount(), 10000u);
+    }
+
+    server.SetScoringMode(ScoringMode::FLOAT);
+
+    assert_cancelled(scheduler.FindTopDocuments("cat"s, cancelled));
+
+    CancellationToken cancelled_float;
+    assert_cancelled(scheduler.FindTopDocuments(
+        "cat"s, [cancelled_float](int, DocumentStatus, int) mutable {
+            cancelled_float.Cancel();
+            return true;
+        },
+        cancelled_float));
+
+    server.SetScoringMode(ScoringMode::DOUBLE);
+
+    // a token that is never cancelled changes nothing
+    AssertSameDocuments(server.FindTopDocuments(CancellationToken(CancellationToken::Clock::now() + 1h), "dog3 cat"s), server.FindTopDocuments("dog3 cat"s));
+
+    // invalid queries fail as usual
+    try {
+        scheduler.FindTopDocuments("cat --dog"s).get();
+        ASSERT_HINT(false, "Query is invalid"s);
+    } catch (const invalid_argument&) {
+    }
+}
+
+void TestAdmissionControl() {
+    SearchServer server("and with"s);
+
+    for (int id = 0; id < 1000; ++id) {
+        string text = "common"s;
+        text += id % 10 == 0 ? " medium"s : ""s;
+        text += id % 100 == 0 ? " rare"s : ""s;
+
+        server.AddDocument(id, text, DocumentStatus::ACTUAL, { id % 10 });
+    }
+
+    ASSERT_EQUAL(server.EstimateQueryCost("common rare"s), 1010u);
+    ASSERT_EQUAL(server.EstimateQueryCost("rare -medium unknown"s), 110u);
+    ASSERT_EQUAL(server.EstimateQueryCost("comm*"s), 1000u);
+
+    // the most common words go first, a query without required words keeps the rarest one
+    const CancellationToken token;
+    AssertSameDocuments(server.FindTopDocumentsPruned(token, "common medium rare"s, 200, DocumentStatusPredicate{}), server.FindTopDocuments("medium rare"s));
+    AssertSameDocuments(server.FindTopDocumentsPruned(token, "common medium rare"s, 1, DocumentStatusPredicate{}), server.FindTopDocuments("rare"s));
+    AssertSameDocuments(server.FindTopDocumentsPruned(token, "+common rare"s, 1, DocumentStatusPredicate{}), server.FindTopDocuments("+common"s));
+    AssertSameDocuments(server.FindTopDocumentsPruned(token, "common rare"s, 5000, DocumentStatusPredicate{}), server.FindTopDocuments("common rare"s));
+
+    // a query parsed once is estimated and searched as many times as needed
+    {
+        string raw_query = "common medium rare"s;
+        const auto query = server.PrepareQuery(raw_query);
+        raw_query.assign(raw_query.size(), 'x');
+
+        ASSERT_EQUAL(server.EstimateQueryCost(query), 1110u);
+        AssertSameDocuments(server.FindTopDocumentsPruned(token, query, 200, DocumentStatusPredicate{}), server.FindTopDocuments("medium rare"s));
+        AssertSameDocuments(server.FindTopDocumentsPruned(token, query, 5000, DocumentStatusPredicate{}), server.FindTopDocuments("common medium rare"s));
+    }
+
+    const auto assert_rejected = [](future<vector<Document>> found) {
+        try {
+            found.get();
+            ASSERT_HINT(false, "Query must be rejected"s);
+        } catch (const QueryRejectedError&) {
+        }
+    };
+
+    AdmissionOptions options;
+    options.max_query_cost = 500;
+
+    {
+        QueryScheduler scheduler(server, 1, options);
+
+        assert_rejected(scheduler.FindTopDocuments("common rare"s));
+        AssertSameDocuments(scheduler.FindTopDocuments("medium rare"s).get(), server.FindTopDocuments("medium rare"s));
+    }
+
+    options.expensive_query_policy = AdmissionPolicy::DEGRADE;
+
+    {
+        QueryScheduler scheduler(server, 1, options);
+        AssertSameDocuments(scheduler.FindTopDocuments("common rare"s).get(), server.FindTopDocuments("rare"s));
+    }
+
+    options.expensive_query_policy = AdmissionPolicy::LOW_PRIORITY;
+
+    {
+        QueryScheduler scheduler(server, 1, options);
+        AssertSameDocuments(scheduler.FindTopDocuments("common rare"s).get(), server.FindTopDocuments("common rare"s));
+    }
+
+    // the only place is taken by a query waiting for the release
+    options = {};
+    options.max_pending_queries = 1;
+
+    {
+        QueryScheduler scheduler(server, 1, options);
+        promise<void> release;
+        shared_future<void> released = release.get_future().share();
+
+        auto blocked = scheduler.FindTopDocuments("rare"s, [released](int, DocumentStatus, int) {
+            released.wait();
+            return true;
+        });
+
+        ASSERT_EQUAL(scheduler.GetPendingQueryCount(), 1u);
+        assert_rejected(scheduler.FindTopDocuments("rare"s));
+
+        release.set_value();
+        ASSERT_EQUAL(blocked.get().size(), 5u);
+        ASSERT_EQUAL(scheduler.GetPendingQueryCount(), 0u);
+        ASSERT_EQUAL(scheduler.FindTopDocuments("rare"s).get().size(), 5u);
+    }
+
+    options.max_pending_queries = 0;
+
+    try {
+        QueryScheduler scheduler(server, 1, options);
+        ASSERT_HINT(false, "Pending query limit must be positive"s);
+    } catch (const invalid_argument&) {
+    }
+}
+
+void TestWriteAheadLog() {
+    const filesystem::path directory = filesystem::temp_directory_path() / ("search_server_wal_test_"s + to_string(random_device{}()));
+    filesystem::create_directories(directory);
+
+    const string path = (directory / "index.wal"s).string();
+
+    const auto add_document = [](SearchServer& server, WriteAheadLog& log, int id, const string& text, const vector<int>& ratings) {
+        server.AddDocument(id, text, DocumentStatus::ACTUAL, ratings);
+        log.Commit(log.AppendAddDocument(id, text, DocumentStatus::ACTUAL, ratings));
+    };
+
+    const auto remove_document = [](SearchServer& server, WriteAheadLog& log, int id) {
+        server.RemoveDocument(id);
+        log.Commit(log.AppendRemoveDocument(id));
+    };
+
+    {
+        SearchServer server("and with"s);
+        WriteAheadLog log(path, server);
+        ASSERT_EQUAL(log.GetRecoveredRecordCount(), 0u);
+
+        add_document(server, log, 1, "curly cat and dog"s, { 1, 2, 6 });
+        add_document(server, log, 2, "curly parrot"s, { 5 });
+        add_document(server, log, 3, "fluffy dog"s, {});
+        remove_document(server, log, 2);
+
+        ASSERT_EQUAL(log.GetLastSequence(), 4u);
+        ASSERT_EQUAL(log.GetSyncCount(), 4u);
+    }
+
+    size_t log_size = 0;
+
+    {
+        SearchServer server("and with"s);
+        WriteAheadLog log(path, server);
+
+        ASSERT_EQUAL(log.GetRecoveredRecordCount(), 4u);
+        ASSERT_EQUAL(server.GetDocumentCount(), 2);
+        ASSERT_EQUAL(server.GetDocumentById(1).rating, 3);
+        ASSERT_EQUAL(server.FindTopDocuments("curly dog"s).size(), 2u);
+        ASSERT(server.FindTopDocuments("parrot"s).empty());
+
+        log_size = log.GetLogSize();
+    }
+
+    // a record torn by a crash is cut off
+    {
+        ofstream(path, ios::binary | ios::app) << "\x20\x00\x00\x00torn"s;
+
+        SearchServer server("and with"s);
+        WriteAheadLog log(path, server);
+
+        ASSERT_EQUAL(server.GetDocumentCount(), 2);
+        ASSERT_EQUAL(log.GetLogSize(), log_size);
+        ASSERT_EQUAL(filesystem::file_size(path), log_size);
+
+        add_document(server, log, 4, "white cat"s, { 4 });
+    }
+
+    string old_log;
+
+    {
+        SearchServer server("and with"s);
+        WriteAheadLog log(path, server);
+        ASSERT_EQUAL(server.GetDocumentCount(), 3);
+
+        old_log.resize(log.GetLogSize());
+        ifstream(path, ios::binary).read(old_log.data(), old_log.size());
+
+        log.Checkpoint(server);
+        ASSERT_EQUAL(log.GetLogSize(), 0u);
+        ASSERT(filesystem::exists(path + ".snapshot"s));
+
+        add_document(server, log, 5, "black cat"s, { 1 });
+        remove_document(server, log, 1);
+    }
+
+    {
+        SearchServer server("and with"s);
+        WriteAheadLog log(path, server);
+
+        // three snapshot documents and two records
+        ASSERT_EQUAL(log.GetRecoveredRecordCount(), 5u);
+        ASSERT_EQUAL(log.GetLastSequence(), 7u);
+        ASSERT_EQUAL(server.GetDocumentCount(), 3);
+        ASSERT_EQUAL(server.GetDocumentById(4).rating, 4);
+        ASSERT_EQUAL(server.FindTopDocuments("cat"s).size(), 2u);
+
+        log.Checkpoint(server);
+    }
+
+    // the truncation of the log is lost, its records are in the snapshot already
+    {
+        ofstream(path, ios::binary) << old_log;
+
+        SearchServer server("and with"s);
+        WriteAheadLog log(path, server);
+
+        ASSERT_EQUAL(server.GetDocumentCount(), 3);
+        ASSERT_EQUAL(log.GetRecoveredRecordCount(), 3u);
+    }
+
+    // syncs of the policies
+    for (const auto& [policy, sync_count] : { pair{ LogSyncPolicy::EVERY_COMMIT, 8u }, pair{ LogSyncPolicy::BATCH, 2u }, pair{ LogSyncPolicy::NONE, 0u } }) {
+        filesystem::remove(path);
+        filesystem::remove(path + ".snapshot"s);
+
+        WriteAheadLogOptions options;
+        options.sync_policy = policy;
+        options.batch_size = 4;
+
+        SearchServer server("and with"s);
+        WriteAheadLog log(path, server, options);
+
+        for (int id = 0; id < 8; ++id) {
+            add_document(server, log, id, "cat"s, { id });
+        }
+
+        ASSERT_EQUAL(log.GetSyncCount(), sync_count);
+        ASSERT_EQUAL(filesystem::file_size(path), log.GetLogSize());
+    }
+
+    // the daemon protocol logs its mutations and checkpoints a big log
+    {
+        filesystem::remove(path);
+
+        WriteAheadLogOptions options;
+        options.checkpoint_log_size = 128;
+
+        SearchServer server("and with"s);
+        WriteAheadLog log(path, server, options);
+        QueryProtocol protocol(server, &log);
+
+        for (int id = 0; id < 10; ++id) {
+            ASSERT_EQUAL(protocol.Execute("ADD "s + to_string(id) + " ACTUAL 1 curly cat"s), "OK"s);
+        }
+
+        ASSERT_EQUAL(protocol.Execute("REMOVE 3"s), "OK"s);
+        ASSERT(log.GetLogSize() < 128u);
+        ASSERT_EQUAL(protocol.Execute("CHECKPOINT"s), "OK"s);
+        ASSERT_EQUAL(log.GetLogSize(), 0u);
+    }
+
+    // a write failure fails the log and rolls back the mutation, the file keeps whole records only
+    {
+        SearchServer server("and with"s);
+        WriteAheadLog log(path, server);
+        QueryProtocol protocol(server, &log);
+        ASSERT_EQUAL(server.GetDocumentCount(), 9);
+
+        const size_t log_size = log.GetLogSize();
+
+        rlimit old_limit{};
+        getrlimit(RLIMIT_FSIZE, &old_limit);
+        const auto old_handler = signal(SIGXFSZ, SIG_IGN);
+
+        rlimit limit = old_limit;
+        limit.rlim_cur = log_size + 10;
+        setrlimit(RLIMIT_FSIZE, &limit);
+
+        ASSERT(protocol.Execute("ADD 20 ACTUAL 1 curly dog"s).rfind("ERROR "s, 0) == 0);
+        ASSERT(protocol.Execute("REMOVE 4"s).rfind("ERROR "s, 0) == 0);
+
+        setrlimit(RLIMIT_FSIZE, &old_limit);
+        signal(SIGXFSZ, old_handler);
+
+        ASSERT(log.IsFailed());
+        ASSERT_EQUAL(server.GetDocumentCount(), 9);
+        ASSERT(server.FindTopDocuments("dog"s).empty());
+        ASSERT_EQUAL(filesystem::file_size(path), log_size);
+
+        // the log fails until a checkpoint, later mutations are refused before they are applied
+        ASSERT(protocol.Execute("ADD 21 ACTUAL 1 curly dog"s).rfind("ERROR "s, 0) == 0);
+        ASSERT_EQUAL(server.GetDocumentCount(), 9);
+
+        try {
+            log.Commit(log.GetLastSequence() + 1);
+            ASSERT_HINT(false, "Log has failed"s);
+        } catch (const runtime_error&) {
+        }
+
+        ASSERT_EQUAL(protocol.Execute("CHECKPOINT"s), "OK"s);
+        ASSERT(!log.IsFailed());
+        ASSERT_EQUAL(protocol.Execute("REMOVE 4"s), "OK"s);
+    }
+
+    {
+        SearchServer server("and with"s);
+        WriteAheadLog log(path, server);
+        ASSERT_EQUAL(server.GetDocumentCount(), 8);
+        ASSERT(server.FindTopDocuments("dog"s).empty());
+    }
+
+    // a rolled back ADD puts back the document it replaced
+    {
+        SearchServer server("and with"s);
+        WriteAheadLog log(path, server);
+        QueryProtocol protocol(server, &log);
+        server.SetDuplicatePolicy(DuplicatePolicy::REPLACE);
+
+        ASSERT_EQUAL(protocol.Execute("ADD 30 BANNED 7 white owl"s), "OK"s);
+        ASSERT_EQUAL(server.FindOriginalDocument("owl and white"sv), 30);
+
+        rlimit old_limit{};
+        getrlimit(RLIMIT_FSIZE, &old_limit);
+        const auto old_handler = signal(SIGXFSZ, SIG_IGN);
+
+        rlimit limit = old_limit;
+        limit.rlim_cur = log.GetLogSize() + 10;
+        setrlimit(RLIMIT_FSIZE, &limit);
+
+        ASSERT(protocol.Execute("ADD 31 ACTUAL 1 owl and white"s).rfind("ERROR "s, 0) == 0);
+
+        setrlimit(RLIMIT_FSIZE, &old_limit);
+        signal(SIGXFSZ, old_handler);
+
+        const auto documents = server.FindTopDocuments("owl"s, DocumentStatus::BANNED);
+        ASSERT_EQUAL(documents.size(), 1u);
+        ASSERT_EQUAL(documents[0].id, 30);
+        ASSERT_EQUAL(documents[0].rating, 7);
+        ASSERT(server.FindTopDocuments("owl"s).empty());
+
+        ASSERT_EQUAL(protocol.Execute("CHECKPOINT"s), "OK"s);
+    }
+
+    {
+        SearchServer server("and with"s);
+        ASSERT(QueryProtocol(server).Execute("CHECKPOINT"s).rfind("ERROR "s, 0) == 0);
+    }
+
+    // a snapshot is written complete, so a damaged one is an error
+    {
+        fstream snapshot(path + ".snapshot"s, ios::binary | ios::in | ios::out);
+        snapshot.seekp(20);
+        snapshot.put('x');
+    }
+
+    try {
+        SearchServer server("and with"s);
+        WriteAheadLog log(path, server);
+        ASSERT_HINT(false, "Snapshot is corrupted"s);
+    } catch (const runtime_error&) {
+    }
+
+    filesystem::remove_all(directory);
+}
+
+void TestDuplicateDocumentsRemove() {
+
+    SearchServer search_server("and with"s);
+
+    AddDocument(search_server, 1, "funny pet and nasty rat"s, DocumentStatus::ACTUAL, { 7, 2, 7 });
+
+    AddDocument(search_server, 2, "funny pet with curly hair"s, DocumentStatus::ACTUAL, { 1, 2 });
+
+    // is a duplicate of document 2
+    AddDocument(search_server, 3, "funny pet with curly hair"s, DocumentStatus::ACTUAL, { 1, 2 });
+
+    // difference only in stop words => is a duplicate
+    AddDocument(search_server, 4, "funny pet and curly hair"s, DocumentStatus::ACTUAL, { 1, 2 });
+
+    // the same words set =>  is a duplicate of document 1
+    AddDocument(search_server, 5, "funny funny pet and nasty nasty rat"s, DocumentStatus::ACTUAL, { 1, 2 });
+
+    // added new words => not a duplicate
+    AddDocument(search_server, 6, "funny pet and not very nasty rat"s, DocumentStatus::ACTUAL, { 1, 2 });
+
+    // the same words set as in 6 => is a duplicate
+    AddDocument(search_server, 7, "very nasty rat and not very funny pet"s, DocumentStatus::ACTUAL, { 1, 2 });
+
+    // not all words => not a duplicate
+    AddDocument(search_server, 8, "pet with rat and rat and rat"s, DocumentStatus::ACTUAL, { 1, 2 });
+
+    // words from different documents => not a duplicate
+    AddDocument(search_server, 9, "nasty rat with curly hair"s, DocumentStatus::ACTUAL, { 1, 2 });
+
+    ASSERT_EQUAL(search_server.GetDocumentCount(), 9);
+
+    const vector<int> added_document_ids = { 1, 2, 3, 4, 5, 6, 7, 8, 9 };
+
+    vector<int> availible_document_ids;
+
+    for (const auto& document_id : search_server) {
+        availible_document_ids.push_back(document_id);
+    }
+
+    ASSERT_EQUAL(added_document_ids, availible_document_ids);
+
+    // Temporary switch off cout output
+    // get underlying buffer
+      streambuf* orig_buf = cout.rdbuf();
+
+    // set null
+      cout.rdbuf(NULL);
+
+    RemoveDuplicates(search_server);
+
+    // restore buffer
+      cout.rdbuf(orig_buf);
+
+    const vector<int> residual_document_ids = { 1, 2, 6, 8, 9 };
+
+    vector<int> after_deduplication_document_ids;
+
+    for (const auto& document_id : search_server) {
+        after_deduplication_document_ids.push_back(document_id);
+    }
+
+    ASSERT_EQUAL(residual_document_ids, after_deduplication_document_ids);
+}
+
+void TestNearDuplicateDocumentsRemove() {
+    SearchServer search_server("and with"s);
+
+    AddDocument(search_server, 1, "funny pet and nasty rat with curly hair and long tail"s, DocumentStatus::ACTUAL, { 1, 2 });
+
+    // one word of eight is different => Jaccard index 7/9
+    AddDocument(search_server, 2, "funny pet and nasty rat with curly hair and short tail"s, DocumentStatus::ACTUAL, { 1, 2 });
+
+    // exact duplicate of document 1
+    AddDocument(search_server, 3, "long tail and curly hair with funny pet nasty rat"s, DocumentStatus::ACTUAL, { 1, 2 });
+
+    // half of the words are different => not a duplicate
+    AddDocument(search_server, 4, "funny pet and nasty dog with big eyes and no tail"s, DocumentStatus::ACTUAL, { 1, 2 });
+
+    // nothing in common
+    AddDocument(search_server, 5, "white cat and yellow hat"s, DocumentStatus::ACTUAL, { 1, 2 });
+
+    streambuf* orig_buf = cout.rdbuf();
+    cout.rdbuf(NULL);
+
+    try {
+        RemoveNearDuplicates(search_server, 0.0);
+        ASSERT_HINT(false, "Threshold must be checked"s);
+    } catch (const invalid_argument&) {
+    }
+
+    RemoveNearDuplicates(search_server, 0.75);
+
+    cout.rdbuf(orig_buf);
+
+    const vector<int> residual_document_ids = { 1, 4, 5 };
+    const vector<int> after_deduplication_document_ids(search_server.begin(), search_server.end());
+
+    ASSERT_EQUAL(residual_document_ids, after_deduplication_document_ids);
+    ASSERT_EQUAL(search_server.GetDocumentCount(), 3);
+
+    // postings of removed documents are cleaned up as well
+    ASSERT(search_server.FindTopDocuments("short"s).empty());
+    ASSERT_EQUAL(search_server.FindTopDocuments("tail"s).size(), 2u);
+}
+
+void TestDuplicatePolicyOnAdd() {
+    {
+        SearchServer search_server("and with"s);
+        ASSERT(search_server.GetDuplicatePolicy() == DuplicatePolicy::ALLOW);
+
+        search_server.AddDocument(1, "funny pet and nasty rat"s, DocumentStatus::ACTUAL, { 1, 2 });
+        search_server.AddDocument(2, "funny funny pet with nasty rat"s, DocumentStatus::ACTUAL, { 1, 2 });
+
+        // the index is built for documents added before the switch
+        search_server.SetDuplicatePolicy(DuplicatePolicy::REJECT);
+
+        try {
+            search_server.AddDocument(3, "nasty rat and funny pet"s, DocumentStatus::ACTUAL, { 1, 2 });
+            ASSERT_HINT(false, "Duplicate must be rejected"s);
+        } catch (const invalid_argument& e) {
+            ASSERT_EQUAL(e.what(), "Document 3 is a duplicate of document 1"s);
+        }
+
+        search_server.AddDocument(4, "nasty rat and curly pet"s, DocumentStatus::ACTUAL, { 1, 2 });
+        ASSERT_EQUAL(search_server.GetDocumentCount(), 3);
+
+        // after the original is removed the same words may be added again
+        search_server.RemoveDocument(1);
+        search_server.RemoveDocument(2);
+        search_server.AddDocument(5, "rat pet funny nasty"s, DocumentStatus::ACTUAL, { 1, 2 });
+        ASSERT_EQUAL(search_server.GetDocumentCount(), 2);
+    }
+
+    {
+        SearchServer search_server("and with"s);
+        search_server.SetDuplicatePolicy(DuplicatePolicy::FLAG);
+
+        search_server.AddDocument(1, "funny pet and nasty rat"s, DocumentStatus::ACTUAL, { 1, 2 });
+        search_server.AddDocument(2, "funny pet with nasty rat"s, DocumentStatus::ACTUAL, { 1, 2 });
+        search_server.AddDocument(3, "funny pet with curly hair"s, DocumentStatus::ACTUAL, { 1, 2 });
+
+        ASSERT_EQUAL(search_server.GetDocumentCount(), 3);
+        ASSERT(search_server.GetFlaggedDuplicates() == (map<int, int>{ { 2, 1 } }));
+
+        search_server.RemoveDocument(1);
+        ASSERT(search_server.GetFlaggedDuplicates().empty());
+    }
+
+    {
+        SearchServer search_server("and with"s);
+        search_server.SetDuplicatePolicy(DuplicatePolicy::REPLACE);
+
+        search_server.AddDocument(1, "funny pet and nasty rat"s, DocumentStatus::ACTUAL, { 1, 2 });
+        search_server.AddDocument(2, "funny pet with curly hair"s, DocumentStatus::ACTUAL, { 1, 2 });
+        search_server.AddDocument(3, "nasty rat with funny pet"s, DocumentStatus::ACTUAL, { 5 });
+
+        const vector<int> document_ids(search_server.begin(), search_server.end());
+        ASSERT_EQUAL(document_ids, vector<int>({ 2, 3 }));
+        ASSERT_EQUAL(search_server.FindTopDocuments("nasty"s).at(0).rating, 5);
+    }
+}
+
+////// Sprint 8 /////
+
+void TestProcessQueries() {
+
+    SearchServer search_server("and with"s);
+
+    for (
+        int id = 0;
+        const string& text : {
+            "funny pet and nasty rat"s,
+            "funny pet with curly hair"s,
+            "funny pet and not very nasty rat"s,
+            "pet with rat and rat and rat"s,
+            "nasty rat with curly hair"s,
+        }) {
+        search_server.AddDocument(++id, text, DocumentStatus::ACTUAL, { 1, 2 });
+    }
+
+    const vector<string> queries = {
+        "nasty rat -not"s,
+        "not very funny nasty pet"s,
+        "curly hair"s
+    };
+
+    std::vector<std::vector<Document>> result = ProcessQueries(search_server, queries);
+    ASSERT_EQUAL(result[0].size(), 3);
+    ASSERT_EQUAL(result[1].size(), 5);
+    ASSERT_EQUAL(result[2].size(), 2);
+}
+
+void TestProcessQueriesJoined() {
+    SearchServer search_server("and with"s);
+
+    for (
+        int id = 0;
+        const string& text : {
+            "funny pet and nasty rat"s,
+            "funny pet with curly hair"s,
+            "funny pet and not very nasty rat"s,
+            "pet with rat and rat and rat"s,
+            "nasty rat with curly hair"s,
+        }) {
+        search_server.AddDocument(++id, text, DocumentStatus::ACTUAL, { 1, 2 });
+    }
+
+    const vector<string> queries = {
+        "nasty rat -not"s,
+        "not very funny nasty pet"s,
+        "curly hair"s
+    };
+
+    std::vector<Document> result = ProcessQueriesJoined(search_server, queries);
+    ASSERT_EQUAL(result[0].id, 1);
+    ASSERT_EQUAL(result[1].id, 5);
+    ASSERT_EQUAL(result[2].id, 4);
+    ASSERT_EQUAL(result[3].id, 3);
+    ASSERT_EQUAL(result[4].id, 1);
+    ASSERT_EQUAL(result[5].id, 2);
+    ASSERT_EQUAL(result[6].id, 5);
+    ASSERT_EQUAL(result[7].id, 4);
+    ASSERT_EQUAL(result[8].id, 2);
+    ASSERT_EQUAL(result[9].id, 5);
+}
+
+void TestRemoveDocumentMultiTread() {
+    SearchServer search_server("and with"s);
+
+    for (
+        int id = 0;
+        const string& text : {
+            "funny pet and nasty rat"s,
+            "funny pet with curly hair"s,
+            "funny pet and not very nasty rat"s,
+            "pet with rat and rat and rat"s,
+            "nasty rat with curly hair"s,
+        }) {
+        search_server.AddDocument(++id, text, DocumentStatus::ACTUAL, { 1, 2 });
+    }
+
+    const string query = "curly and funny"s;
+
+    ASSERT_EQUAL(search_server.GetDocumentCount(), 5);
+    ASSERT_EQUAL(search_server.FindTopDocuments(query).size(), 4);
+    // single thread version
+    search_server.RemoveDocument(5);
+    ASSERT_EQUAL(search_server.GetDocumentCount(), 4);
+    ASSERT_EQUAL(search_server.FindTopDocuments(query).size(), 3);
+
+    // single thread version
+    search_server.RemoveDocument(execution::seq, 1);
+    ASSERT_EQUAL(search_server.GetDocumentCount(), 3);
+    ASSERT_EQUAL(search_server.FindTopDocuments(query).size(), 2);
+
+    // multi thread version
+    search_server.RemoveDocument(execution::par, 2);
+    ASSERT_EQUAL(search_server.GetDocumentCount(), 2);
+    ASSERT_EQUAL(search_server.FindTopDocuments(query).size(), 1);
+}
+
+void TestMatchDocumentMultiTread() {
+    SearchServer search_server("and with"s);
+
+    for (
+        int id = 0;
+        const string& text : {
+            "funny pet and nasty rat"s,
+            "funny pet with curly hair"s,
+            "funny pet and not very nasty rat"s,
+            "pet with rat and rat and rat"s,
+            "nasty rat with curly hair"s,
+        }) {
+        search_server.AddDocument(++id, text, DocumentStatus::ACTUAL, { 1, 2 });
+    }
+
+    const string query = "curly and funny -not"s;
+
+    {
+        const auto [words, status] = search_server.MatchDocument(query, 1);
+        ASSERT_EQUAL(words.size(), 1);
+    }
+
+    {
+        const auto [words, status] = search_server.MatchDocument(execution::seq, query, 2);
+        ASSERT_EQUAL(words.size(), 2);
+    }
+
+    {
+        const auto [words, status] = search_server.MatchDocument(execution::par, query, 3);
+        ASSERT_EQUAL(words.size(), 0);
+    }
+}
+
+void TestMatchDocumentsBatch() {
+    SearchServer search_server("and with"s);
+
+    for (
+        int id = 0;
+        const string& text : {
+            "funny pet and nasty rat"s,
+            "funny pet with curly hair"s,
+            "funny pet and not very nasty rat"s,
+            "pet with rat and rat and rat"s,
+            "nasty rat with curly hair"s,
+        }) {
+        search_server.AddDocument(++id, text, DocumentStatus::ACTUAL, { 1, 2 });
+    }
+
+    const string query = "curly and funny -not"s;
+    const vector<int> document_ids = { 1, 2, 3, 4, 5 };
+    const vector<size_t> expected_sizes = { 1, 2, 0, 0, 1 };
+
+    const auto seq_results = search_server.MatchDocuments(query, document_ids);
+    const auto par_results = search_server.MatchDocuments(execution::par, query, document_ids);
+
+    ASSERT_EQUAL(seq_results.size(), document_ids.size());
+    ASSERT_EQUAL(par_results.size(), document_ids.size());
+
+    for (size_t i = 0; i < document_ids.size(); ++i) {
+        const auto& [seq_words, seq_status] = seq_results[i];
+        const auto& [par_words, par_status] = par_results[i];
+
+        ASSERT_EQUAL(seq_words.size(), expected_sizes[i]);
+        ASSERT_EQUAL(seq_words, par_words);
+        ASSERT(seq_status == par_status);
+
+        const auto [single_words, _] = search_server.MatchDocument(query, document_ids[i]);
+        ASSERT_EQUAL(seq_words, single_words);
+    }
+
+    // matched words are sorted and do not depend on the query string lifetime
+    const auto [words, status] = search_server.MatchDocument(execution::par, "hair curly pet"s, 2);
+    ASSERT_EQUAL(words, vector<string_view>({ "curly"sv, "hair"sv, "pet"sv }));
+}
+
+void TestMatchAllDocuments() {
+    SearchServer search_server("and with"s);
+
+    for (
+        int id = 0;
+        const string& text : {
+            "funny pet and nasty rat"s,
+            "funny pet with curly hair"s,
+            "funny pet and not very nasty rat"s,
+            "pet with rat and rat and rat"s,
+            "nasty rat with curly hair"s,
+        }) {
+        search_server.AddDocument(++id, text, DocumentStatus::ACTUAL, { 1, 2 });
+    }
+
+    const string query = "curly and funny -not"s;
+
+    const auto matched_documents = search_server.MatchAllDocuments(query);
+
+    // document 3 has a minus word, document 4 has no plus words
+    ASSERT_EQUAL(matched_documents.size(), 3u);
+
+    for (const int document_id : search_server) {
+        const auto [words, status] = search_server.MatchDocument(query, document_id);
+        const auto it = matched_documents.find(document_id);
+
+        if (words.empty()) {
+            ASSERT(it == matched_documents.end());
+        } else {
+            ASSERT(it != matched_documents.end());
+            ASSERT_EQUAL(get<0>(it->second), words);
+            ASSERT(get<1>(it->second) == status);
+        }
+    }
+
+    ASSERT(search_server.MatchAllDocuments("unknown -funny"s).empty());
+}
+
+void TestFindTopDocumentsMultiTread() {
+    SearchServer search_server("and with"s);
+
+    for (
+        int id = 0;
+        const string& text : {
+            "white cat and yellow hat"s,
+            "curly cat curly tail"s,
+            "nasty dog with big eyes"s,
+            "nasty pigeon john"s,
+        }) {
+        search_server.AddDocument(++id, text, DocumentStatus::ACTUAL, { 1, 2 });
+    }
+
+    // seq version by default
+    auto document = search_server.FindTopDocuments("curly nasty cat"s);
+    ASSERT_EQUAL(document[0].id, 2);
+    ASSERT_EQUAL(document[1].id, 4);
+    ASSERT_EQUAL(document[2].id, 1);
+    ASSERT_EQUAL(document[3].id, 3);
+
+    // seq version
+    document = search_server.FindTopDocuments(execution::seq, "curly nasty cat"s, DocumentStatus::BANNED);
+    ASSERT_EQUAL(document.size(), 0);
+
+    // par version
+    document = search_server.FindTopDocuments(execution::par, "curly nasty cat"s, [](int document_id, DocumentStatus status, int rating) { return document_id % 2 == 0; });
+    ASSERT_EQUAL(document[0].id, 2);
+}
+
+void TestFindTopDocumentsExplained() {
+    SearchServer search_server("and with"s);
+
+    search_server.AddDocument(1, "white cat and yellow hat"s, DocumentStatus::ACTUAL, { 1, 2 });
+    search_server.AddDocument(2, "curly cat curly tail"s, DocumentStatus::ACTUAL, { 1, 2 });
+    search_server.AddDocument(3, "nasty dog with big eyes"s, DocumentStatus::ACTUAL, { 1, 2 });
+    search_server.AddDocument(4, "nasty cat john"s, DocumentStatus::BANNED, { 1, 2 });
+
+    const string query = "curly nasty cat -tail -unknown"s;
+
+    // the counts are documents in every scan, doc 4 has two words but is filtered once
+    for (const ScoringMode scoring_mode : { ScoringMode::DOUBLE, ScoringMode::FLOAT }) {
+        search_server.SetScoringMode(scoring_mode);
+
+        for (const bool is_parallel : { false, true }) {
+            const auto [documents, profile] = is_parallel
+                                                  ? search_server.FindTopDocumentsExplained(execution::par, query, [](int document_id, DocumentStatus status, int rating) { return status == DocumentStatus::ACTUAL; })
+                                                  : search_server.FindTopDocumentsExplained(query);
+
+            const auto expected_documents = search_server.FindTopDocuments(query);
+            ASSERT_EQUAL(documents.size(), expected_documents.size());
+
+            for (size_t i = 0; i < documents.size(); ++i) {
+                ASSERT_EQUAL(documents[i].id, expected_documents[i].id);
+            }
+
+            ASSERT(profile.is_parallel == is_parallel);
+            ASSERT_EQUAL(profile.terms.size(), 5u);
+
+            // plus words go first, each group sorted
+            ASSERT_EQUAL(profile.terms[0].word, "cat"sv);
+            ASSERT_EQUAL(profile.terms[0].postings_count, 3u);
+            ASSERT(InTheVicinity(profile.terms[0].inverse_document_freq, log(4.0 / 3.0), 1e-6));
+            ASSERT(profile.terms[3].is_minus);
+            ASSERT_EQUAL(profile.terms[4].postings_count, 0u);
+
+            // cat: 1, 2, 4; curly: 2; nasty: 3, 4
+            ASSERT_EQUAL(profile.postings_scanned, 6u);
+            ASSERT_EQUAL(profile.documents_filtered, 1u);
+            ASSERT_EQUAL(profile.documents_scored, 3u);
+            ASSERT_EQUAL(profile.documents_excluded, 1u);
+            ASSERT_EQUAL(profile.documents_returned, 2u);
+        }
+    }
+
+    // a required word makes the scan start from the documents having it
+    const auto [_, profile] = search_server.FindTopDocumentsExplained("+cat nasty -tail"s);
+    ASSERT_EQUAL(profile.documents_filtered, 1u);
+    ASSERT_EQUAL(profile.documents_scored, 2u);
+    ASSERT_EQUAL(profile.documents_excluded, 1u);
+    ASSERT_EQUAL(profile.documents_returned, 1u);
+}
+
+void TestMetrics() {
+    ResetMetrics();
+
+    ASSERT_EQUAL(LatencyHistogram::GetBucketIndex(5), 5);
+    ASSERT_EQUAL(LatencyHistogram::GetBucketUpperBound(LatencyHistogram::GetBucketIndex(1000)), 1023u);
+
+    for (int i = 1; i <= 100; ++i) {
+        RecordPhaseDuration(MetricsPhase::MATCH, chrono::nanoseconds(i * 1000));
+    }
+
+    AddToCounter(MetricsCounter::POSTINGS_SCANNED, 42);
+
+    // metrics of other threads are merged into the snapshot
+    async(launch::async, [] {
+        AddToCounter(MetricsCounter::POSTINGS_SCANNED, 8);
+    }).get();
+
+    const auto snapshot = GetMetricsSnapshot();
+    const auto& histogram = snapshot.phases[static_cast<size_t>(MetricsPhase::MATCH)];
+
+    ASSERT_EQUAL(histogram.count, 100u);
+    ASSERT_EQUAL(histogram.max_ns, 100000u);
+    ASSERT_EQUAL(snapshot.counters[static_cast<size_t>(MetricsCounter::POSTINGS_SCANNED)], 50u);
+
+    // 12.5% is the precision of the histogram
+    const uint64_t median = histogram.GetPercentile(50.0);
+    ASSERT_HINT(median >= 50000u && median <= 50000u * 9 / 8, "Wrong median "s + to_string(median));
+
+    const string prometheus = FormatMetrics(snapshot, MetricsFormat::PROMETHEUS);
+    ASSERT(prometheus.find("search_server_postings_scanned_total 50\n"s) != string::npos);
+    ASSERT(prometheus.find("search_server_phase_duration_ns_count{phase=\"match\"} 100\n"s) != string::npos);
+
+    const string json = FormatMetrics(snapshot, MetricsFormat::JSON);
+    ASSERT(json.find("\"postings_scanned\":50"s) != string::npos);
+
+    ResetMetrics();
+    ASSERT_EQUAL(GetMetricsSnapshot().phases[static_cast<size_t>(MetricsPhase::MATCH)].count, 0u);
 }
 
 // Entry point
@@ -806,18 +2453,42 @@ void TestSearchServer() {
     RUN_TEST(TestExeptionMatchDocumentAnotherMinus);
 
     RUN_TEST(TestPaginator);
+    RUN_TEST(TestDeepPagination);
     RUN_TEST(TestRequestQueue);
+    RUN_TEST(TestRequestQueueMultiThread);
 
     RUN_TEST(TestRemoveDocument);
+    RUN_TEST(TestDocumentOrdinals);
+    RUN_TEST(TestForwardIndex);
+    RUN_TEST(TestFloatScoringMode);
+    RUN_TEST(TestBm25Ranking);
+    RUN_TEST(TestPhraseQueries);
+    RUN_TEST(TestRequiredWords);
+    RUN_TEST(TestMinusWordBitmaps);
+    RUN_TEST(TestImpactOrderedPostings);
+    RUN_TEST(TestPrefixQueries);
+    RUN_TEST(TestFuzzyMatching);
+    RUN_TEST(TestShardedSearchServer);
+    RUN_TEST(TestQueryProtocol);
+    RUN_TEST(TestAsyncQueries);
+    RUN_TEST(TestAdmissionControl);
+    RUN_TEST(TestWriteAheadLog);
     RUN_TEST(TestDuplicateDocumentsRemove);
+    RUN_TEST(TestNearDuplicateDocumentsRemove);
+    RUN_TEST(TestDuplicatePolicyOnAdd);
 
     RUN_TEST(TestProcessQueries);
     RUN_TEST(TestProcessQueriesJoined);
 
     RUN_TEST(TestRemoveDocumentMultiTread);
     RUN_TEST(TestMatchDocumentMultiTread);
+    RUN_TEST(TestMatchDocumentsBatch);
+    RUN_TEST(TestMatchAllDocuments);
 
     RUN_TEST(TestFindTopDocumentsMultiTread);
 
+    RUN_TEST(TestFindTopDocumentsExplained);
+    RUN_TEST(TestMetrics);
+
     cout << endl; // To separate test check and program output
 }
@@ -1,13 +1,21 @@
 #pragma once
 
 #include "process_queries.h"
+#include "query_protocol.h"
+#include "query_scheduler.h"
 #include "remove_duplicates.h"
 #include "request_queue.h"
 #include "search_server.h"
+#include "sharded_search_server.h"
+#include "write_ahead_log.h"
 
+#include <filesystem>
+#include <fstream>
 #include <iomanip>
 #include <iostream>
 #include <map>
+#include <numeric>
+#include <random>
 #include <set>
 #include <vector>
 
@@ -134,13 +142,34 @@ void TestExeptionMatchDocumentAnotherMinus();
 
 // sprint 4 Added Paginator and ReguestQueue class
 void TestPaginator();
+void TestDeepPagination();
 void TestRequestQueue();
+void TestRequestQueueMultiThread();
 
 // sprint 5 Added RemoveDuplicate function
 bool InTheVicinity(const double d1, const double d2, const double delta);
+// Same ids in the same order with the same relevance
+void AssertSameDocuments(const std::vector<Document>& found, const std::vector<Document>& expected);
 void TestRemoveDocument();
+void TestDocumentOrdinals();
+void TestForwardIndex();
+void TestFloatScoringMode();
+void TestBm25Ranking();
+void TestPhraseQueries();
+void TestRequiredWords();
+void TestMinusWordBitmaps();
+void TestImpactOrderedPostings();
+void TestPrefixQueries();
+void TestFuzzyMatching();
+void TestShardedSearchServer();
+void TestQueryProtocol();
+void TestAsyncQueries();
+void TestAdmissionControl();
+void TestWriteAheadLog();
 
 void TestDuplicateDocumentsRemove();
+void TestNearDuplicateDocumentsRemove();
+void TestDuplicatePolicyOnAdd();
 
 // sprint 8 Added
 void TestProcessQueries();
@@ -148,8 +177,13 @@ void TestProcessQueriesJoined();
 
 void TestRemoveDocumentMultiTread();
 void TestMatchDocumentMultiTread();
+void TestMatchDocumentsBatch();
+void TestMatchAllDocuments();
 
 void TestFindTopDocumentsMultiTread();
 
+void TestFindTopDocumentsExplained();
+void TestMetrics();
+
 // Entry point
 void TestSearchServer();
@@ -0,0 +1,567 @@
+#include "write_ahead_log.h"
+
+#include <algorithm>
+#include <array>
+#include <cerrno>
+#include <cstring>
+#include <filesystem>
+#include <stdexcept>
+#include <unordered_map>
+
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+using namespace std;
+
+namespace {
+
+// A record is <payload size: uint32> <CRC32 of the payload: uint32> <payload>, the payload is
+// <type: uint8> <sequence: uint64> <document id: int32> and for ADD_DOCUMENT
+// <status: uint8> <rating count: uint32> <ratings: int32...> <text size: uint32> <text>
+enum class RecordType : uint8_t {
+    ADD_DOCUMENT = 1,
+    REMOVE_DOCUMENT = 2,
+    CHECKPOINT = 3, // the first record of a snapshot, its sequence is the last one in the snapshot
+};
+
+constexpr size_t RECORD_HEADER_SIZE = 2 * sizeof(uint32_t);
+constexpr size_t SNAPSHOT_WRITE_SIZE = size_t(1) << 20;
+
+struct Record {
+    RecordType type;
+    uint64_t sequence;
+    int document_id;
+    DocumentStatus status = DocumentStatus::ACTUAL;
+    vector<int> ratings;
+    string_view text; // points into the read file
+};
+
+array<uint32_t, 256> MakeCrc32Table() {
+    array<uint32_t, 256> table{};
+
+    for (uint32_t i = 0; i < table.size(); ++i) {
+        uint32_t crc = i;
+
+        for (int bit = 0; bit < 8; ++bit) {
+            crc = crc & 1 ? (crc >> 1) ^ 0xEDB88320u : crc >> 1;
+        }
+
+        table[i] = crc;
+    }
+
+    return table;
+}
+
+uint32_t ComputeCrc32(string_view data) {
+    static const array<uint32_t, 256> table = MakeCrc32Table();
+
+    uint32_t crc = 0xFFFFFFFFu;
+
+    for (const char c : data) {
+        crc = table[(crc ^ static_cast<uint8_t>(c)) & 0xFF] ^ (crc >> 8);
+    }
+
+    return crc ^ 0xFFFFFFFFu;
+}
+
+void ThrowSystemError(const string& what) {
+    throw runtime_error(what + ": "s + strerror(errno));
+}
+
+template <typename T>
+void AppendValue(string& out, T value) {
+    out.append(reinterpret_cast<const char*>(&value), sizeof(value));
+}
+
+// false if data is too short
+template <typename T>
+bool TakeValue(string_view& data, T& value) {
+    if (data.size() < sizeof(value)) {
+        return false;
+    }
+
+    memcpy(&value, data.data(), sizeof(value));
+    data.remove_prefix(sizeof(value));
+
+    return true;
+}
+
+void AppendRecord(string& out, RecordType type, uint64_t sequence, int document_id,
+                  DocumentStatus status = DocumentStatus::ACTUAL, const vector<int>& ratings = {}, string_view text = {}) {
+    const size_t header_offset = out.size();
+    out.resize(header_offset + RECORD_HEADER_SIZE);
+
+    AppendValue(out, static_cast<uint8_t>(type));
+    AppendValue(out, sequence);
+    AppendValue(out, static_cast<int32_t>(document_id));
+
+    if (type == RecordType::ADD_DOCUMENT) {
+        AppendValue(out, static_cast<uint8_t>(status));
+        AppendValue(out, static_cast<uint32_t>(ratings.size()));
+
+        for (const int rating : ratings) {
+            AppendValue(out, static_cast<int32_t>(rating));
+        }
+
+        AppendValue(out, static_cast<uint32_t>(text.size()));
+        out.append(text);
+    }
+
+    const string_view payload = string_view(out).substr(header_offset + RECORD_HEADER_SIZE);
+    const uint32_t header[] = { static_cast<uint32_t>(payload.size()), ComputeCrc32(payload) };
+    memcpy(out.data() + header_offset, header, sizeof(header));
+}
+
+bool ParsePayload(string_view payload, Record& record) {
+    uint8_t type = 0;
+    int32_t document_id = 0;
+
+    if (!TakeValue(payload, type) || !TakeValue(payload, record.sequence) || !TakeValue(payload, document_id)) {
+        return false;
+    }
+
+    record.type = static_cast<RecordType>(type);
+    record.document_id = document_id;
+
+    if (record.type == RecordType::ADD_DOCUMENT) {
+        uint8_t status = 0;
+        uint32_t rating_count = 0;
+
+        if (!TakeValue(payload, status) || !TakeValue(payload, rating_count) || payload.size() / sizeof(int32_t) < rating_count) {
+            return false;
+        }
+
+        record.status = static_cast<DocumentStatus>(status);
+        record.ratings.resize(rating_count);
+
+        for (int& rating : record.ratings) {
+            int32_t value = 0;
+            TakeValue(payload, value);
+            rating = value;
+        }
+
+        uint32_t text_size = 0;
+
+        if (!TakeValue(payload, text_size) || payload.size() != text_size) {
+            return false;
+        }
+
+        record.text = payload;
+        return true;
+    }
+
+    return payload.empty() && (record.type == RecordType::REMOVE_DOCUMENT || record.type == RecordType::CHECKPOINT);
+}
+
+// Parses the records up to the first torn or corrupted one, returns the size of the valid part
+size_t ParseRecords(string_view data, vector<Record>& records) {
+    const size_t data_size = data.size();
+    uint32_t header[2];
+
+    while (data.size() >= RECORD_HEADER_SIZE) {
+        memcpy(header, data.data(), sizeof(header));
+
+        if (data.size() - RECORD_HEADER_SIZE < header[0]) {
+            break;
+        }
+
+        const string_view payload = data.substr(RECORD_HEADER_SIZE, header[0]);
+        Record record;
+
+        if (ComputeCrc32(payload) != header[1] || !ParsePayload(payload, record)) {
+            break;
+        }
+
+        records.push_back(move(record));
+        data.remove_prefix(RECORD_HEADER_SIZE + header[0]);
+    }
+
+    return data_size - data.size();
+}
+
+// The whole file with one read, empty if there is no file
+string ReadFile(const string& path) {
+    const int fd = open(path.c_str(), O_RDONLY | O_CLOEXEC);
+
+    if (fd < 0) {
+        if (errno == ENOENT) {
+            return {};
+        }
+
+        ThrowSystemError("Can't open "s + path);
+    }
+
+    struct stat file_stat {};
+    string data;
+
+    if (fstat(fd, &file_stat) == 0) {
+        data.resize(static_cast<size_t>(file_stat.st_size));
+    }
+
+    size_t size = 0;
+
+    while (size < data.size()) {
+        const ssize_t count = read(fd, data.data() + size, data.size() - size);
+
+        if (count <= 0) {
+            close(fd);
+            ThrowSystemError("Can't read "s + path);
+        }
+
+        size += static_cast<size_t>(count);
+    }
+
+    close(fd);
+
+    return data;
+}
+
+void WriteAll(int fd, string_view data) {
+    while (!data.empty()) {
+        const ssize_t count = write(fd, data.data(), data.size());
+
+        if (count < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+
+            ThrowSystemError("Can't write the write-ahead log"s);
+        }
+
+        data.remove_prefix(static_cast<size_t>(count));
+    }
+}
+
+// Skips the documents which are removed later in the log, they are never indexed then.
+// Another duplicate policy may remove or flag documents on its own, so it gets every record
+void ApplyRecords(SearchServer& search_server, const vector<Record>& records) {
+    vector<bool> is_skipped(records.size(), false);
+
+    if (search_server.GetDuplicatePolicy() == DuplicatePolicy::ALLOW) {
+        // document id -> index of its next remove record
+        unordered_map<int, size_t> removes;
+
+        for (size_t i = records.size(); i-- > 0;) {
+            const Record& record = records[i];
+
+            if (record.type == RecordType::REMOVE_DOCUMENT) {
+                removes[record.document_id] = i;
+            } else if (record.type == RecordType::ADD_DOCUMENT) {
+                const auto it_remove = removes.find(record.document_id);
+
+                if (it_remove != removes.end()) {
+                    is_skipped[i] = is_skipped[it_remove->second] = true;
+                    removes.erase(it_remove);
+                }
+            }
+        }
+    }
+
+    for (size_t i = 0; i < records.size(); ++i) {
+        const Record& record = records[i];
+
+        if (is_skipped[i]) {
+            continue;
+        }
+
+        if (record.type == RecordType::ADD_DOCUMENT) {
+            search_server.AddDocument(record.document_id, record.text, record.status, record.ratings);
+        } else if (record.type == RecordType::REMOVE_DOCUMENT) {
+            search_server.RemoveDocument(record.document_id);
+        }
+    }
+}
+
+} // namespace
+
+WriteAheadLog::WriteAheadLog(const string& path, SearchServer& search_server, WriteAheadLogOptions options)
+    : path_(path)
+    , options_(options) {
+    if (options_.sync_policy == LogSyncPolicy::BATCH && options_.batch_size == 0) {
+        throw invalid_argument("Batch size must be positive"s);
+    }
+
+    fd_ = open(path_.c_str(), O_WRONLY | O_CREAT | O_APPEND | O_CLOEXEC, 0644);
+
+    if (fd_ < 0) {
+        ThrowSystemError("Can't open "s + path_);
+    }
+
+    try {
+        Recover(search_server);
+    } catch (...) {
+        close(fd_);
+        throw;
+    }
+}
+
+WriteAheadLog::~WriteAheadLog() {
+    try {
+        Sync();
+    } catch (const exception&) {
+    }
+
+    close(fd_);
+}
+
+uint64_t WriteAheadLog::AppendAddDocument(int document_id, string_view document, DocumentStatus status, const vector<int>& ratings) {
+    lock_guard lock(mutex_);
+    ThrowIfFailed();
+    AppendRecord(buffer_, RecordType::ADD_DOCUMENT, ++last_sequence_, document_id, status, ratings, document);
+
+    return last_sequence_;
+}
+
+uint64_t WriteAheadLog::AppendRemoveDocument(int document_id) {
+    lock_guard lock(mutex_);
+    ThrowIfFailed();
+    AppendRecord(buffer_, RecordType::REMOVE_DOCUMENT, ++last_sequence_, document_id);
+
+    return last_sequence_;
+}
+
+void WriteAheadLog::Commit(uint64_t sequence) {
+    Flush(sequence, options_.sync_policy == LogSyncPolicy::EVERY_COMMIT);
+}
+
+void WriteAheadLog::Sync() {
+    uint64_t sequence = 0;
+
+    {
+        lock_guard lock(mutex_);
+        sequence = last_sequence_;
+    }
+
+    Flush(sequence, true);
+}
+
+void WriteAheadLog::Checkpoint(const SearchServer& search_server) {
+    unique_lock lock(mutex_);
+    flushed_.wait(lock, [this] { return !is_flushing_; });
+
+    // the flag keeps the committers off the file
+    is_flushing_ = true;
+    const uint64_t sequence = last_sequence_;
+    const size_t buffered_size = buffer_.size();
+    lock.unlock();
+
+    try {
+        WriteSnapshot(search_server, sequence);
+
+        if (ftruncate(fd_, 0) < 0) {
+            ThrowSystemError("Can't truncate "s + path_);
+        }
+    } catch (...) {
+        lock.lock();
+        is_flushing_ = false;
+        flushed_.notify_all();
+        throw;
+    }
+
+    lock.lock();
+    buffer_.erase(0, buffered_size);
+    written_sequence_ = synced_sequence_ = sequence;
+    log_size_ = 0;
+    is_failed_ = false;
+    is_flushing_ = false;
+    flushed_.notify_all();
+}
+
+bool WriteAheadLog::IsFailed() const {
+    lock_guard lock(mutex_);
+    return is_failed_;
+}
+
+bool WriteAheadLog::IsCheckpointDue() const {
+    lock_guard lock(mutex_);
+    return log_size_ >= options_.checkpoint_log_size;
+}
+
+size_t WriteAheadLog::GetRecoveredRecordCount() const {
+    return recovered_record_count_;
+}
+
+uint64_t WriteAheadLog::GetLastSequence() const {
+    lock_guard lock(mutex_);
+    return last_sequence_;
+}
+
+size_t WriteAheadLog::GetLogSize() const {
+    lock_guard lock(mutex_);
+    return log_size_;
+}
+
+size_t WriteAheadLog::GetSyncCount() const {
+    lock_guard lock(mutex_);
+    return sync_count_;
+}
+
+void WriteAheadLog::Recover(SearchServer& search_server) {
+    if (search_server.GetDocumentCount() != 0) {
+        throw invalid_argument("Write-ahead log is replayed into an empty server only"s);
+    }
+
+    uint64_t snapshot_sequence = 0;
+
+    {
+        const string snapshot_path = path_ + ".snapshot"s;
+        const string snapshot = ReadFile(snapshot_path);
+        vector<Record> records;
+
+        // a snapshot is renamed into place complete, so it must be valid to the end
+        if (ParseRecords(snapshot, records) != snapshot.size()
+            || (!records.empty() && records.front().type != RecordType::CHECKPOINT)) {
+            throw runtime_error("Snapshot "s + snapshot_path + " is corrupted"s);
+        }
+
+        if (!records.empty()) {
+            snapshot_sequence = records.front().sequence;
+            ApplyRecords(search_server, records);
+            recovered_record_count_ += records.size() - 1;
+        }
+    }
+
+    const string log = ReadFile(path_);
+    vector<Record> records;
+    const size_t valid_size = ParseRecords(log, records);
+
+    // the tail left by a crash in the middle of a write
+    if (valid_size != log.size() && ftruncate(fd_, static_cast<off_t>(valid_size)) < 0) {
+        ThrowSystemError("Can't truncate "s + path_);
+    }
+
+    // records of the snapshot are left by a crash before the truncation
+    records.erase(remove_if(records.begin(), records.end(),
+                            [snapshot_sequence](const Record& record) {
+                                return record.sequence <= snapshot_sequence;
+                            }),
+                  records.end());
+
+    ApplyRecords(search_server, records);
+    recovered_record_count_ += records.size();
+
+    last_sequence_ = records.empty() ? snapshot_sequence : records.back().sequence;
+
+    written_sequence_ = synced_sequence_ = last_sequence_;
+    log_size_ = valid_size;
+}
+
+void WriteAheadLog::Flush(uint64_t sequence, bool is_sync_required) {
+    unique_lock lock(mutex_);
+
+    // the first committer writes the records of all the others which are waiting
+    while (is_sync_required ? synced_sequence_ < sequence : written_sequence_ < sequence) {
+        ThrowIfFailed();
+
+        if (is_flushing_) {
+            flushed_.wait(lock);
+            continue;
+        }
+
+        is_flushing_ = true;
+
+        string records;
+        records.swap(buffer_);
+
+        const uint64_t last_sequence = last_sequence_;
+        const bool is_synced = is_sync_required || options_.sync_policy == LogSyncPolicy::EVERY_COMMIT
+                               || (options_.sync_policy == LogSyncPolicy::BATCH && last_sequence - synced_sequence_ >= options_.batch_size);
+
+        lock.unlock();
+
+        exception_ptr error;
+
+        try {
+            WriteAll(fd_, records);
+
+            if (is_synced && fdatasync(fd_) < 0) {
+                ThrowSystemError("Can't sync "s + path_);
+            }
+        } catch (...) {
+            error = current_exception();
+
+            // a part of a record would stop replay before the records written after it,
+            // so the file is cut back to the last record which is written completely
+            if (ftruncate(fd_, static_cast<off_t>(log_size_)) < 0) {
+                error = make_exception_ptr(runtime_error("Can't truncate "s + path_ + " after a failed write"s));
+            }
+        }
+
+        lock.lock();
+        is_flushing_ = false;
+        flushed_.notify_all();
+
+        if (error) {
+            // the records of the failed write are lost, so are the later ones, which
+            // must not reach the file after them
+            is_failed_ = true;
+            rethrow_exception(error);
+        }
+
+        written_sequence_ = last_sequence;
+        log_size_ += records.size();
+
+        if (is_synced) {
+            synced_sequence_ = last_sequence;
+            ++sync_count_;
+        }
+    }
+}
+
+void WriteAheadLog::ThrowIfFailed() const {
+    if (is_failed_) {
+        throw runtime_error("Write-ahead log "s + path_ + " has failed, a checkpoint restores it"s);
+    }
+}
+
+void WriteAheadLog::WriteSnapshot(const SearchServer& search_server, uint64_t sequence) const {
+    const string snapshot_path = path_ + ".snapshot"s;
+    const string temporary_path = snapshot_path + ".tmp"s;
+
+    const int fd = open(temporary_path.c_str(), O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+
+    if (fd < 0) {
+        ThrowSystemError("Can't open "s + temporary_path);
+    }
+
+    try {
+        string records;
+        AppendRecord(records, RecordType::CHECKPOINT, sequence, 0);
+
+        // the average rating gives the same average again
+        for (const int document_id : search_server) {
+            const DocumentData document = search_server.GetDocumentById(document_id);
+            AppendRecord(records, RecordType::ADD_DOCUMENT, sequence, document_id, document.status, { document.rating }, document.text);
+
+            if (records.size() >= SNAPSHOT_WRITE_SIZE) {
+                WriteAll(fd, records);
+                records.clear();
+            }
+        }
+
+        WriteAll(fd, records);
+
+        if (fsync(fd) < 0) {
+            ThrowSystemError("Can't sync "s + temporary_path);
+        }
+    } catch (...) {
+        close(fd);
+        throw;
+    }
+
+    close(fd);
+
+    if (rename(temporary_path.c_str(), snapshot_path.c_str()) < 0) {
+        ThrowSystemError("Can't rename "s + temporary_path);
+    }
+
+    // the rename is durable once the directory is synced
+    const string directory = filesystem::path(snapshot_path).parent_path().string();
+    const int directory_fd = open(directory.empty() ? "." : directory.c_str(), O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+
+    if (directory_fd >= 0) {
+        fsync(directory_fd);
+        close(directory_fd);
+    }
+}
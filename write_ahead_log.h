@@ -0,0 +1,105 @@
+#pragma once
+
+#include "search_server.h"
+
+#include <condition_variable>
+#include <cstdint>
+#include <mutex>
+#include <string>
+#include <string_view>
+#include <vector>
+
+// When the records of committed mutations reach the disk
+enum class LogSyncPolicy {
+    EVERY_COMMIT, // fsync before Commit returns, concurrent commits share one fsync
+    BATCH,        // fsync once batch_size records are unsynced, a crash of the machine loses at most them
+    NONE,         // records are written by Commit and synced by the OS, survive a crash of the process only
+};
+
+struct WriteAheadLogOptions {
+    LogSyncPolicy sync_policy = LogSyncPolicy::EVERY_COMMIT;
+    size_t batch_size = 64;
+    // IsCheckpointDue once the log grows that big
+    size_t checkpoint_log_size = size_t(64) << 20;
+};
+
+// Append-only log of AddDocument and RemoveDocument calls, so a restarted server gets back the
+// documents added since the last snapshot. Records have a CRC32 checksum; replay stops at the
+// first torn or corrupted record and the log is cut there. Checkpoint writes a snapshot of all
+// the documents next to the log, path + ".snapshot", and truncates the log.
+//
+// Mutations are logged after they are applied, under the same writer lock, so a mutation the
+// server refused is never logged. The lock is released before Commit, so the writers waiting
+// for the disk share one write and fsync:
+//
+//     uint64_t sequence;
+//     {
+//         std::unique_lock lock(mutex);
+//         search_server.AddDocument(id, text, status, ratings);
+//         sequence = log.AppendAddDocument(id, text, status, ratings);
+//     }
+//     log.Commit(sequence); // the mutation is durable from here
+//
+// Files are written in the byte order of the machine
+class WriteAheadLog {
+public:
+    // Opens the log, creating it if needed, loads the latest snapshot into the server and
+    // replays the log on top of it. The server must be empty and have the stop words and
+    // the duplicate policy of the server that wrote the log. Throws std::runtime_error if
+    // the files can't be read or the snapshot is corrupted
+    WriteAheadLog(const std::string& path, SearchServer& search_server, WriteAheadLogOptions options = {});
+
+    // Syncs the records which are not synced yet
+    ~WriteAheadLog();
+
+    WriteAheadLog(const WriteAheadLog&) = delete;
+    WriteAheadLog& operator=(const WriteAheadLog&) = delete;
+
+    // Return the sequence number of the record for Commit
+    uint64_t AppendAddDocument(int document_id, std::string_view document, DocumentStatus status, const std::vector<int>& ratings);
+    uint64_t AppendRemoveDocument(int document_id);
+
+    // Writes the records up to the sequence number and syncs them as the policy says.
+    // A failed write or sync fails the log: the records which are not written yet are
+    // dropped, and Append, Commit and Sync throw std::runtime_error until a checkpoint.
+    // The caller rolls back the mutations it has not got committed
+    void Commit(uint64_t sequence);
+
+    // Writes and syncs all the appended records whatever the policy is
+    void Sync();
+
+    // Snapshots the server with all the appended mutations applied and truncates the log,
+    // a failed log works again after it. Nothing may be appended meanwhile, commits may wait
+    void Checkpoint(const SearchServer& search_server);
+    bool IsFailed() const;
+    bool IsCheckpointDue() const;
+
+    // Records applied by the constructor, snapshot documents included
+    size_t GetRecoveredRecordCount() const;
+    uint64_t GetLastSequence() const;
+    size_t GetLogSize() const;
+    size_t GetSyncCount() const;
+
+private:
+    void Recover(SearchServer& search_server);
+    void Flush(uint64_t sequence, bool is_sync_required);
+    void WriteSnapshot(const SearchServer& search_server, uint64_t sequence) const;
+    void ThrowIfFailed() const;
+
+    const std::string path_;
+    const WriteAheadLogOptions options_;
+    int fd_ = -1;
+
+    size_t recovered_record_count_ = 0;
+
+    mutable std::mutex mutex_;
+    std::condition_variable flushed_;
+    std::string buffer_; // appended records which are not written yet
+    uint64_t last_sequence_ = 0;
+    uint64_t written_sequence_ = 0;
+    uint64_t synced_sequence_ = 0;
+    bool is_flushing_ = false;
+    bool is_failed_ = false;
+    size_t log_size_ = 0; // of the records written completely
+    size_t sync_count_ = 0;
+};